@@ -1,8 +1,9 @@
 JAVA="$1"
 CLASS="$2"
 JAVA_HOME="$3"
+# $SCHOKOVM_OPTIONS are only passed to SchokoVM, $TEST_NAME separates the output of runs with different options
 
-OUT="out/$CLASS"
+OUT="out/${TEST_NAME:-$CLASS}"
 mkdir -p "$OUT" || exit 42
 
 R_OUT="$OUT/reference_stdout"
@@ -16,8 +17,8 @@ S_STATUS="$OUT/schoko_status"
 "$JAVA" -Djava.library.path="$PWD" -classpath tests.jar "$CLASS" $4 1>"$R_OUT" 2>"$R_ERR"
 echo "$?" > "$R_STATUS"
 
-./SchokoVM --java-home $JAVA_HOME -classpath tests.jar "$CLASS" $4 1>"$S_OUT" 2>"$S_ERR"
-# "$JAVA" -XXaltjvm="$PWD" -Xbootclasspath:../jdk/exploded-modules -Xjavahome:$JAVA_HOME -classpath tests.jar "$CLASS" 1>"$S_OUT" 2>"$S_ERR"
+./SchokoVM --java-home $JAVA_HOME $SCHOKOVM_OPTIONS -classpath tests.jar "$CLASS" $4 1>"$S_OUT" 2>"$S_ERR"
+# "$JAVA" -XXaltjvm="$PWD" -Xbootclasspath:$JAVA_HOME/lib/modules -Xjavahome:$JAVA_HOME -classpath tests.jar "$CLASS" 1>"$S_OUT" 2>"$S_ERR"
 echo "$?" > "$S_STATUS"
 
 X=0
@@ -0,0 +1,23 @@
+# Like compare.sh, but SchokoVM runs the test through --connect in a fork of a VM that was started with --server
+JAVA="$1"
+CLASS="$2"
+JAVA_HOME="$3"
+
+# The path of a unix socket is limited to ~100 bytes, the server and the client run in the same directory
+SOCKET="out/$CLASS.socket"
+mkdir -p out || exit 42
+rm -f "$SOCKET"
+
+./SchokoVM --java-home $JAVA_HOME -classpath tests.jar --server "$SOCKET" &
+SERVER="$!"
+TRIES=0
+while [ ! -S "$SOCKET" ] && [ "$TRIES" -lt 300 ]; do
+    sleep 0.1
+    TRIES=$((TRIES + 1))
+done
+
+SCHOKOVM_OPTIONS="--connect $SOCKET" TEST_NAME="${CLASS}_Server" sh "$(dirname "$0")/compare.sh" "$JAVA" "$CLASS" "$JAVA_HOME" "$4"
+X="$?"
+kill "$SERVER"
+rm -f "$SOCKET"
+exit "$X"
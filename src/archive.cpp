@@ -0,0 +1,195 @@
+#include "archive.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+constexpr u4 archive_magic = 0x5C0C0A5C;
+constexpr u4 archive_version = 1;
+
+// All values are in the byte order of the host
+struct Header {
+    u4 magic;
+    u4 version;
+    u4 entry_count;
+    u4 class_count;
+    // The stamps of the class path entries follow the header: s8 modification time, u8 size, u4 path length, path
+    u8 table_offset;
+};
+
+size_t align(size_t offset) {
+    return (offset + 7) & ~size_t{7};
+}
+}
+
+std::unique_ptr<ClassArchive> ClassArchive::open(std::string const &path, std::vector<ClassPathEntry> const &entries) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        std::cerr << "Warning: the shared archive " << path << " does not exist\n";
+        return nullptr;
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(Header))) {
+        close(fd);
+        std::cerr << "Warning: the shared archive " << path << " is invalid\n";
+        return nullptr;
+    }
+    auto size = static_cast<size_t>(status.st_size);
+    void *memory = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        std::cerr << "Warning: failed to map the shared archive " << path << "\n";
+        return nullptr;
+    }
+    // Owns the mapping from here on
+    std::unique_ptr<ClassArchive> archive{new ClassArchive(static_cast<u1 const *>(memory), size)};
+
+    auto invalid = [&path](char const *reason) {
+        std::cerr << "Warning: the shared archive " << path << " can't be used: " << reason << "\n";
+        return nullptr;
+    };
+
+    Header header{};
+    std::memcpy(&header, archive->m_data, sizeof(Header));
+    if (header.magic != archive_magic || header.version != archive_version) {
+        return invalid("wrong version");
+    }
+    if (header.entry_count != entries.size()) {
+        return invalid("the class path differs");
+    }
+
+    size_t offset = sizeof(Header);
+    for (auto const &entry : entries) {
+        FileStamp stamp{"", 0, 0};
+        u4 path_length;
+        if (offset + sizeof(s8) + sizeof(u8) + sizeof(u4) > size) {
+            return invalid("truncated");
+        }
+        std::memcpy(&stamp.modification_time, archive->m_data + offset, sizeof(s8));
+        std::memcpy(&stamp.size, archive->m_data + offset + 8, sizeof(u8));
+        std::memcpy(&path_length, archive->m_data + offset + 16, sizeof(u4));
+        offset += 20;
+        if (offset + path_length > size) {
+            return invalid("truncated");
+        }
+        stamp.path.assign(reinterpret_cast<char const *>(archive->m_data + offset), path_length);
+        offset += path_length;
+
+        if (stamp.path != entry.path()) {
+            return invalid("the class path differs");
+        }
+        if (FileStamp::of(stamp.path) != stamp) {
+            return invalid("a class path entry was modified");
+        }
+    }
+
+    if (header.table_offset % alignof(TableEntry) != 0 ||
+        header.table_offset + static_cast<u8>(header.class_count) * sizeof(TableEntry) > size) {
+        return invalid("truncated");
+    }
+    archive->m_table = {reinterpret_cast<TableEntry const *>(archive->m_data + header.table_offset),
+                        header.class_count};
+    for (auto const &entry : archive->m_table) {
+        if (entry.name_offset + entry.name_length > size || entry.bytes_offset + entry.size > size ||
+            entry.entry_index >= entries.size()) {
+            return invalid("truncated");
+        }
+    }
+
+    return archive;
+}
+
+ClassArchive::~ClassArchive() {
+    munmap(const_cast<u1 *>(m_data), m_size);
+}
+
+std::optional<ArchivedClass> ClassArchive::find(std::string_view name) const {
+    auto name_of = [this](TableEntry const &entry) {
+        return std::string_view{reinterpret_cast<char const *>(m_data + entry.name_offset), entry.name_length};
+    };
+    auto found = std::lower_bound(m_table.begin(), m_table.end(), name, [&name_of](auto const &entry, auto name) {
+        return name_of(entry) < name;
+    });
+    if (found == m_table.end() || name_of(*found) != name) {
+        return {};
+    }
+    return ArchivedClass{found->entry_index, {m_data + found->bytes_offset, found->size}};
+}
+
+void ClassArchive::write(std::string const &path, std::vector<ClassPathEntry> const &entries,
+                         std::vector<Class> classes) {
+    std::sort(classes.begin(), classes.end(), [](auto const &a, auto const &b) { return a.name < b.name; });
+
+    std::vector<u1> stamps;
+    auto append = [&stamps](void const *data, size_t size) {
+        auto *bytes = static_cast<u1 const *>(data);
+        stamps.insert(stamps.end(), bytes, bytes + size);
+    };
+    for (auto const &entry : entries) {
+        auto stamp = FileStamp::of(entry.path());
+        auto path_length = static_cast<u4>(stamp.path.size());
+        append(&stamp.modification_time, sizeof(s8));
+        append(&stamp.size, sizeof(u8));
+        append(&path_length, sizeof(u4));
+        append(stamp.path.data(), stamp.path.size());
+    }
+
+    Header header{archive_magic, archive_version, static_cast<u4>(entries.size()), static_cast<u4>(classes.size()),
+                  align(sizeof(Header) + stamps.size())};
+
+    // Names and class files are 8-byte aligned, like the table
+    std::vector<TableEntry> table;
+    size_t offset = header.table_offset + classes.size() * sizeof(TableEntry);
+    for (auto const &clazz : classes) {
+        TableEntry entry{};
+        entry.name_offset = offset;
+        entry.name_length = static_cast<u4>(clazz.name.size());
+        offset = align(offset + clazz.name.size());
+        entry.bytes_offset = offset;
+        entry.size = static_cast<u4>(clazz.bytes.size());
+        offset = align(offset + clazz.bytes.size());
+        entry.entry_index = static_cast<u4>(clazz.entry_index);
+        table.push_back(entry);
+    }
+
+    // Written to a temporary file first, so a VM that starts concurrently never maps a partial archive
+    auto temporary_path = path + "." + std::to_string(getpid());
+    std::ofstream out{temporary_path, std::ios::out | std::ios::binary | std::ios::trunc};
+    auto pad = [&out]() {
+        while (out.tellp() % 8 != 0) {
+            out.put(0);
+        }
+    };
+    out.write(reinterpret_cast<char const *>(&header), sizeof(Header));
+    out.write(reinterpret_cast<char const *>(stamps.data()), static_cast<std::streamsize>(stamps.size()));
+    pad();
+    out.write(reinterpret_cast<char const *>(table.data()),
+              static_cast<std::streamsize>(table.size() * sizeof(TableEntry)));
+    for (auto const &clazz : classes) {
+        out.write(clazz.name.data(), static_cast<std::streamsize>(clazz.name.size()));
+        pad();
+        out.write(reinterpret_cast<char const *>(clazz.bytes.data()), static_cast<std::streamsize>(clazz.bytes.size()));
+        pad();
+    }
+    out.close();
+
+    std::error_code error;
+    if (!out) {
+        std::cerr << "Warning: failed to write the shared archive " << path << "\n";
+        std::filesystem::remove(temporary_path, error);
+        return;
+    }
+    std::filesystem::rename(temporary_path, path, error);
+    if (error) {
+        std::cerr << "Warning: failed to write the shared archive " << path << "\n";
+        std::filesystem::remove(temporary_path, error);
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef SCHOKOVM_ARCHIVE_HPP
+#define SCHOKOVM_ARCHIVE_HPP
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "classpath.hpp"
+#include "types.hpp"
+
+// -Xshare
+enum class ShareMode {
+    // The archive is not used
+    Off,
+    // The archive is used if it matches the class path
+    Auto,
+    // Like Auto, but the VM fails to start if the archive can't be used
+    On,
+    // The classes that the boot loader decompressed from jars and jimages are written to the archive when the VM exits.
+    // With an uncompressed lib/modules and no deflated jars on the boot class path, the archive is empty.
+    Dump,
+};
+
+struct ArchivedClass {
+    // The class path entry that the class was loaded from when the archive was dumped
+    size_t entry_index;
+    std::span<u1 const> bytes;
+};
+
+// Class data sharing: A file with the class files that the boot loader decompressed from jars and jimages. It is mapped
+// read-only, so the pages are shared between all VMs that use it, and the classes are parsed right from the mapping,
+// without looking them up in the class path entries or decompressing them. Stored jar entries and uncompressed jimage
+// resources (like the whole lib/modules of a default JDK build) are already parsed in place, they are not archived.
+// The archive is only valid for the class path it was dumped with, every entry is stamped.
+struct ClassArchive {
+    // Returns nullptr (and prints why) if the archive does not exist or does not match the class path
+    static std::unique_ptr<ClassArchive> open(std::string const &path, std::vector<ClassPathEntry> const &entries);
+
+    struct Class {
+        std::string_view name;
+        size_t entry_index;
+        std::span<u1 const> bytes;
+    };
+
+    static void write(std::string const &path, std::vector<ClassPathEntry> const &entries, std::vector<Class> classes);
+
+    ClassArchive(ClassArchive const &) = delete;
+
+    ClassArchive &operator=(ClassArchive const &) = delete;
+
+    ~ClassArchive();
+
+    [[nodiscard]] std::optional<ArchivedClass> find(std::string_view name) const;
+
+private:
+    ClassArchive(u1 const *data, size_t size) : m_data(data), m_size(size) {}
+
+    u1 const *m_data;
+    size_t m_size;
+
+    // Sorted by name, the offsets are from the start of the file
+    struct TableEntry {
+        u8 name_offset;
+        u8 bytes_offset;
+        u4 name_length;
+        u4 size;
+        u4 entry_index;
+        u4 padding;
+    };
+    std::span<TableEntry const> m_table;
+};
+
+#endif //SCHOKOVM_ARCHIVE_HPP
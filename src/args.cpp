@@ -8,17 +8,52 @@ std::optional<Arguments> parse_args(int argc, char *argv[]) {
             std::cerr << "Error: " << error_message << "\n";
         }
         std::cerr << "Usage: " << argv[0] << " [options] <mainclass> [args...]\n"
+                  << "   or: " << argv[0] << " [options] --server <socket>\n"
                   << "  where the options are:\n"
                   << "    -cp <classpath>\n"
                   << "    -classpath <classpath>\n"
                   << "    --class-path <classpath>\n"
-                  << "        The <classpath> is a ':' separated list of directories, jar or zip files. The default is the current directory.\n";
+                  << "        The <classpath> is a ':' separated list of directories, jar or zip files. The default is the current directory.\n"
+                  << "    -XX:+UseStringDeduplication\n"
+                  << "        Strings with the same contents share their character array after they survived a garbage collection.\n"
+                  << "    -XX:+PrintMetaspaceStatisticsAtExit\n"
+                  << "        Prints the memory that is used for class metadata when the VM exits.\n"
+                  << "    -Xshare:off|auto|on|dump\n"
+                  << "    -XX:SharedArchiveFile=<file>\n"
+                  << "        With dump, the classes that were decompressed from jars and jimages are written to <file> when the VM\n"
+                  << "        exits. This only saves work for deflated jar entries and compressed jimage resources (jlink --compress),\n"
+                  << "        all other classes are parsed in place anyway. The lib/modules of a default JDK build is not compressed,\n"
+                  << "        so none of its classes are archived.\n"
+                  << "        With auto and on, they are loaded from <file> if it matches the class path (on fails otherwise).\n"
+                  << "    -Xverify:none|remote|all\n"
+                  << "        Which classes are verified before they are initialized. The default is remote: all classes that are\n"
+                  << "        not loaded from the runtime image of the JDK.\n"
+                  << "    -XX:PackageIndexCache=<file>\n"
+                  << "        Caches the index of the packages in the jars and jimages of the class path in <file>, it is rebuilt when\n"
+                  << "        they change. Directories are not indexed.\n"
+                  << "    -XX:PreloadThreads=<n>\n"
+                  << "        Reads, inflates and parses the classes that are referenced by loaded classes on <n> background\n"
+                  << "        threads. Loading such a class only adds it to the heap.\n"
+                  << "    -XX:PreloadClassList=<file>\n"
+                  << "        Preloads the classes in <file> (one per line) right after startup.\n"
+                  << "    -XX:DumpLoadedClassList=<file>\n"
+                  << "        Writes the classes in the order they were loaded to <file> when the VM exits.\n"
+                  << "    --server <socket>\n"
+                  << "        Boots the VM and waits for connections on the unix socket. Every connection runs in a fork of the\n"
+                  << "        booted VM, so it does not have to initialize the JDK again.\n"
+                  << "    --connect <socket>\n"
+                  << "        Runs the main class in a VM of --server (with the same classpath) instead of booting a new one. It runs\n"
+                  << "        in the working directory and with the environment of this process. VM options are rejected, the ones the\n"
+                  << "        server was started with apply.\n";
         return std::optional<Arguments>{};
     };
 
     std::optional<std::string> classpath{};
     std::optional<std::string> java_home{};
     std::optional<std::string> mainclass{};
+    std::string server_socket;
+    std::string connect_socket;
+    std::vector<std::string> vm_options;
     std::vector<std::string> remaining;
 
     int index = 1;
@@ -38,6 +73,13 @@ std::optional<Arguments> parse_args(int argc, char *argv[]) {
             }
         } else if (arg == "--java-home") {
             java_home = argv[index++];
+        } else if (arg == "--server" || arg == "--connect") {
+            if (index >= argc) {
+                return usage("Expected argument after " + arg);
+            }
+            (arg == "--server" ? server_socket : connect_socket) = argv[index++];
+        } else if (arg.starts_with("-XX:") || arg.starts_with("-Xshare:") || arg.starts_with("-Xverify:")) {
+            vm_options.push_back(arg);
         } else {
             mainclass = arg;
             break;
@@ -47,19 +89,28 @@ std::optional<Arguments> parse_args(int argc, char *argv[]) {
         remaining.emplace_back(argv[index++]);
     }
 
-    if (!mainclass)
+    if (!server_socket.empty() && !connect_socket.empty())
+        return usage("--server and --connect can't be combined!");
+
+    if (!connect_socket.empty() && !vm_options.empty())
+        return usage("VM options can't be combined with --connect, the server's are used!");
+
+    if (!mainclass && server_socket.empty())
         return usage("mainclass must be specified!");
 
-    if (!java_home)
+    if (!java_home && connect_socket.empty())
         return usage("java-home must be specified!");
 
     if (!classpath)
         classpath = ".";
 
     return Arguments{
-            *mainclass,
+            mainclass.value_or(""),
             *classpath,
-            *java_home,
+            java_home.value_or(""),
+            server_socket,
+            connect_socket,
+            vm_options,
             remaining,
     };
 }
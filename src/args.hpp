@@ -9,6 +9,12 @@ struct Arguments {
     std::string mainclass;
     std::string classpath;
     std::string java_home;
+    // --server <socket>: boot the VM once and run the requests of --connect in forks of it
+    std::string server_socket;
+    // --connect <socket>: run the main class in the VM of a --server instead of booting a new one
+    std::string connect_socket;
+    // -XX: options, they are passed on to the VM
+    std::vector<std::string> vm_options;
     std::vector<std::string> remaining;
 };
 
@@ -1,12 +1,15 @@
 #ifndef SCHOKOVM_CLASSFILE_HPP
 #define SCHOKOVM_CLASSFILE_HPP
 
+#include <algorithm>
 #include <bitset>
 #include <condition_variable>
 #include <vector>
 #include <variant>
 #include <cassert>
+#include <span>
 #include <string>
+#include <string_view>
 
 #include "memory.hpp"
 #include "native.hpp"
@@ -107,7 +110,12 @@ struct CONSTANT_Fieldref_info {
     ValueCategory category;
     // Might be a superclass of class_
     ClassFile *value_clazz;
+    // Static fields: index into value_clazz->static_field_values
     size_t index;
+    // Instance fields: offset in bytes from the start of the object
+    size_t offset;
+    // First character of the field descriptor
+    char type;
 };
 
 
@@ -130,6 +138,8 @@ struct CONSTANT_InterfaceMethodref_info {
 struct CONSTANT_String_info {
     u2 string_index;
     CONSTANT_Utf8_info *string;
+    // The interned string, set on first use by Heap::load_string
+    Reference java_string = JAVA_NULL;
 };
 
 struct CONSTANT_Integer_info {
@@ -156,7 +166,8 @@ struct CONSTANT_NameAndType_info {
 };
 
 struct CONSTANT_Utf8_info {
-    std::string value;
+    // Points into ClassFile::class_file_bytes (or into the arena for builtin classes)
+    std::string_view value;
 };
 
 enum MethodHandleKind : u1 {
@@ -237,16 +248,39 @@ struct field_info {
     u2 access_flags;
     CONSTANT_Utf8_info *name_index;
     CONSTANT_Utf8_info *descriptor_index;
-    std::vector<attribute_info> attributes;
+    MetadataVector<attribute_info> attributes;
 
     ClassFile *clazz;
+    // Static fields: index into clazz->static_field_values
     size_t index;
+    // Instance fields: offset in bytes from the start of the object
+    size_t offset;
     ValueCategory category;
 
     [[nodiscard]] inline bool is_static() const {
         return (access_flags & static_cast<u2>(FieldInfoAccessFlags::ACC_STATIC)) != 0;
     }
 
+    // Number of bytes that the field occupies inside of an instance
+    [[nodiscard]] inline size_t size() const {
+        switch (descriptor_index->value[0]) {
+            case 'B':
+            case 'Z':
+                return 1;
+            case 'C':
+            case 'S':
+                return 2;
+            case 'F':
+            case 'I':
+                return 4;
+            case 'D':
+            case 'J':
+                return 8;
+            default:
+                return sizeof(Reference);
+        }
+    }
+
     [[nodiscard]] inline bool is_reference_type() const {
         auto const &descriptor = descriptor_index->value;
         return descriptor.starts_with("L") || descriptor.starts_with("[");
@@ -268,11 +302,26 @@ enum class MethodInfoAccessFlags : u2 {
     ACC_SYNTHETIC = 0x1000,
 };
 
+// The parameter and return types of a method, taken from its descriptor when the class is parsed so that calls don't
+// need to parse it again
+struct MethodSignature {
+    struct Parameter {
+        // The first character of the field descriptor, but L for arrays as well
+        char type;
+        // Index of the first local variable of the parameter, `this` of instance methods is at 0
+        u2 slot;
+    };
+
+    MetadataVector<Parameter> parameters;
+    // Like Parameter::type, or V
+    char return_type;
+};
+
 struct method_info {
     u2 access_flags;
     CONSTANT_Utf8_info *name_index;
     CONSTANT_Utf8_info *descriptor_index;
-    std::vector<attribute_info> attributes;
+    MetadataVector<attribute_info> attributes;
     Code_attribute *code_attribute;
 
     // This is called nargs in the invoke* descriptions: https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-6.html#jvms-6.5.invokestatic
@@ -282,8 +331,11 @@ struct method_info {
 
     u1 return_category; // 0, 1, 2
 
+    MethodSignature signature;
+
     ClassFile *clazz;
-    std::optional<NativeFunction> native_function;
+    // Bound lazily or by RegisterNatives, see ClassLoaderData::add_native_function
+    NativeFunction *native_function = nullptr;
 
     [[nodiscard]] inline bool is_static() const {
         return (access_flags & static_cast<u2>(MethodInfoAccessFlags::ACC_STATIC)) != 0;
@@ -323,12 +375,53 @@ struct ExceptionTableEntry {
     u2 catch_type;
 };
 
+// The kinds of values that the verifier distinguishes. Classes are not distinguished, every object or array is a
+// Reference. Long and Double occupy two slots, the second one is Top.
+enum class VerificationType : u1 {
+    Top,
+    Integer,
+    Float,
+    Long,
+    Double,
+    Null,
+    Reference,
+    // The receiver of a constructor before it called another constructor
+    UninitializedThis,
+    // An object that was created by new and whose constructor was not called yet
+    Uninitialized,
+};
+
+// The types of the local variables and of the operand stack before every reachable instruction of a method, as
+// computed by the verifier. The garbage collector uses them to find the references in the local variables.
+struct MethodTypeMap {
+    struct Entry {
+        u2 bci;
+        u2 stack_depth;
+        // Index into types: max_locals types of the local variables, followed by stack_depth types of the operands
+        u4 offset;
+    };
+
+    // Sorted by bci, empty if the method was not verified
+    MetadataVector<Entry> entries;
+    MetadataVector<VerificationType> types;
+
+    // nullptr if the method was not verified or if the instruction is not reachable
+    [[nodiscard]] Entry const *at(size_t bci) const {
+        auto it = std::lower_bound(entries.begin(), entries.end(), bci, [](Entry const &entry, size_t value) {
+            return entry.bci < value;
+        });
+        return it != entries.end() && it->bci == bci ? &*it : nullptr;
+    }
+};
+
 struct Code_attribute {
     u2 max_stack;
     u2 max_locals;
-    std::vector<u1> code;
-    std::vector<ExceptionTableEntry> exception_table;
-    std::vector<attribute_info> attributes;
+    MetadataVector<u1> code;
+    MetadataVector<ExceptionTableEntry> exception_table;
+    MetadataVector<attribute_info> attributes;
+    // Set by verify_class
+    MethodTypeMap type_map;
 };
 
 #if 0
@@ -440,7 +533,7 @@ struct full_frame {
 #endif
 
 struct Exceptions_attribute {
-    std::vector<CONSTANT_Class_info *> exception_index_table;
+    MetadataVector<CONSTANT_Class_info *> exception_index_table;
 };
 
 struct InnerClasses_attribute {
@@ -470,7 +563,7 @@ struct SourceFile_attribute {
 };
 
 struct SourceDebugExtension_attribute {
-    std::string debug_extension;
+    std::string_view debug_extension;
 };
 
 struct LineNumberTableEntry {
@@ -479,7 +572,7 @@ struct LineNumberTableEntry {
 };
 
 struct LineNumberTable_attribute {
-    std::vector<LineNumberTableEntry> line_number_table;
+    MetadataVector<LineNumberTableEntry> line_number_table;
 };
 
 struct LocalVariableTable_attribute {
@@ -658,11 +751,11 @@ struct AnnotationDefault_attribute {
 
 struct BootstrapMethod {
     CONSTANT_MethodHandle_info *bootstrap_method_ref;
-    std::vector<u2> bootstrap_arguments;
+    MetadataVector<u2> bootstrap_arguments;
 };
 
 struct BootstrapMethods_attribute {
-    std::vector<BootstrapMethod> bootstrap_methods;
+    MetadataVector<BootstrapMethod> bootstrap_methods;
 };
 
 struct MethodParameter {
@@ -671,7 +764,7 @@ struct MethodParameter {
 };
 
 struct MethodParameters_attribute {
-    std::vector<MethodParameter> parameters;
+    MetadataVector<MethodParameter> parameters;
 };
 
 struct Module_attribute {
@@ -728,7 +821,7 @@ struct NestHost_attribute {
 };
 
 struct NestMembers_attribute {
-    std::vector<CONSTANT_Class_info *> classes;
+    MetadataVector<CONSTANT_Class_info *> classes;
 };
 
 struct Record_attribute {
@@ -743,13 +836,20 @@ struct record_component_info {
 //    attribute_info attributes[attributes_count];
 };
 
+// Attributes that are not needed for execution are kept as raw bytes until they are accessed, see find_attribute
+struct Unparsed_attribute {
+};
+
 struct attribute_info {
-    // TODO: Do we even need to store these two fields?
     CONSTANT_Utf8_info *attribute_name_index;
     u4 attribute_length;
+    // The contents of the attribute in ClassFile::class_file_bytes
+    u1 const *bytes;
     std::variant<
+            Unparsed_attribute,
             ConstantValue_attribute,
-            Code_attribute,
+            // NOTE: Stored in ClassFile::code_attributes, so that the other attributes stay small
+            Code_attribute *,
             Exceptions_attribute,
             Signature_attribute,
             SourceFile_attribute,
@@ -764,8 +864,44 @@ struct attribute_info {
     > variant;
 };
 
+// The final value of a constant pool entry as the interpreter needs it, filled when an instruction uses the entry for
+// the first time. The interpreter reads it with one load instead of dispatching on the variant of cp_info and
+// following its pointers, the variants are only needed for the resolution itself and for reflection.
+struct ResolvedConstant {
+    enum Kind : u1 {
+        Unresolved,
+        // Integer, Float, Long, Double and String constants: value
+        Constant,
+        Class,
+        // Only cached once the class of the field is initialized
+        StaticField,
+        InstanceField,
+        // The declared method of invokevirtual and invokeinterface, the resolved method of invokespecial and
+        // invokestatic (only cached once its class is initialized)
+        Method,
+    };
+
+    // Written last with a release store, see load_acquire
+    Kind kind = Unresolved;
+    // Fields: the first character of the descriptor
+    char type = 0;
+    // Instance fields: offset in bytes from the start of the object
+    u4 offset = 0;
+    union {
+        Value value{};
+        ClassFile *clazz;
+        // Static fields: the element of static_field_values
+        Value *static_value;
+        method_info *method;
+    };
+};
+
+static_assert(sizeof(ResolvedConstant) == 16);
+
 struct ConstantPool {
-    std::vector<cp_info> table;
+    MetadataVector<cp_info> table;
+    // Indexed like table
+    MetadataVector<ResolvedConstant> resolved;
 
     template<class T>
     inline T &get(u2 index) {
@@ -785,11 +921,23 @@ enum class ClassFileAccessFlags : u2 {
     ACC_MODULE = 0x8000,
 };
 
+// The strength of java.lang.ref.Reference subclasses, inherited from the superclass
+enum class ReferenceKind : u1 {
+    None,
+    Soft,
+    Weak,
+    Final,
+    Phantom,
+};
+
 struct ClassFile {
+    // NOTE: The header is smaller than the one of arrays, see Object and Array
     Object header;
-    Value padding_for_java_instance_fields_a[6]; // TODO
-    Value field_component_type;
-    Value padding_for_java_instance_fields_b[13]; // TODO
+    // Storage for the instance fields of java.lang.Class, the layout is computed in resolve_class
+    Value java_instance_fields[20];
+
+    // The class file that the metadata was parsed from, it is allocated in the arena of the class loader
+    std::span<u1 const> class_file_bytes;
 
     u4 magic;
     u2 minor_version;
@@ -801,30 +949,47 @@ struct ClassFile {
     CONSTANT_Class_info *super_class_ref;
     // nullptr for class Object and before resolution
     ClassFile *super_class;
-    std::vector<CONSTANT_Class_info *> interfaces;
-    std::vector<field_info> fields;
-    std::vector<method_info> methods;
-    std::vector<attribute_info> attributes;
+    MetadataVector<CONSTANT_Class_info *> interfaces;
+    MetadataVector<field_info> fields;
+    MetadataVector<method_info> methods;
+    MetadataVector<attribute_info> attributes;
+    // The Code attributes of the methods, reserved for all methods so that pointers to them stay valid
+    MetadataVector<Code_attribute> code_attributes;
 
     int clinit_index = -1;
 
     size_t declared_instance_field_count;
-    size_t total_instance_field_count;
-    std::vector<Value> static_field_values;
+    // Size of an instance in bytes including the header (but without padding at the end)
+    size_t instance_size;
+    // Offsets of all reference fields of an instance, including those declared in superclasses
+    MetadataVector<size_t> reference_field_offsets;
+    MetadataVector<Value> static_field_values;
 
     ClassFile *array_element_type = nullptr; // set iff this is an array of references
 
+    // Position in Heap::class_table, stored in the header of instances
+    u4 class_table_index;
+
+    // The class loader that defined this class, its arena holds the metadata of the class
+    struct ClassLoaderData *loader_data = nullptr;
+
+    // Loaded from the runtime image, such classes are not verified with -Xverify:remote
+    bool is_trusted = false;
+
     bool resolved = false;
 
-    std::mutex initialization_lock{};
-    std::condition_variable initialization_condition_variable{};
+    // Instances of these classes are discovered by the garbage collector, see Heap::process_references
+    ReferenceKind reference_kind = ReferenceKind::None;
+
+    // NOTE: The initialization lock is not embedded, see initialize_class
+    // Written with store_release once the static initializer ran, it is read with load_acquire outside of the lock
     bool is_initialized = false;
     struct Thread *initializing_thread = nullptr;
     bool is_erroneous_state = false;
 
     std::string_view package_name;
     // For primitive classes: the size of the primitive value
-    // For non-primitive classes: the size of each field
+    // For non-primitive classes: the size of a reference
     // For arrays: the element size
     size_t element_size;
     size_t offset_of_array_after_header;
@@ -869,7 +1034,7 @@ struct ClassFile {
         return (access_flags & static_cast<u2>(ClassFileAccessFlags::ACC_INTERFACE)) != 0;
     }
 
-    [[nodiscard]] inline std::string const &name() const { return this_class->name->value; }
+    [[nodiscard]] inline std::string_view name() const { return this_class->name->value; }
 
     [[nodiscard]] bool is_array() const {
         return !name().empty() && name()[0] == '[';
@@ -893,7 +1058,7 @@ struct ClassFile {
     }
 
     [[nodiscard]] std::string as_array_element() const {
-        std::string const &n = name();
+        std::string n{name()};
         if (!n.empty() && n[0] == '[') {
             return "[" + n;
         } else {
@@ -1,29 +1,62 @@
+#include <algorithm>
+#include <array>
 #include <filesystem>
+#include <fstream>
+#include <iostream>
 #include <utility>
 #include <mutex>
+#include <thread>
 
 #include "classloading.hpp"
+#include "exceptions.hpp"
 #include "memory.hpp"
 #include "parser.hpp"
 #include "util.hpp"
-#include "zip.hpp"
 
 BootstrapClassLoader BootstrapClassLoader::the_bootstrap_class_loader;
 
 void BootstrapClassLoader::initialize_with_boot_classpath(std::string const &bootclasspath) {
+    m_preloader = nullptr;
     m_class_path_entries = std::vector<ClassPathEntry>();
-    m_classes = std::unordered_map<std::string, ClassFile *>();
+    m_classes.clear();
 
     for (auto &path : split(bootclasspath, ':')) {
         if (path.ends_with(".jar") || path.ends_with(".zip")) {
-            m_class_path_entries.push_back({"", ZipArchive(path)});
+            m_class_path_entries.push_back({"", std::make_unique<ZipArchive>(path), {}});
+        } else if (path.ends_with("/modules") || path.ends_with(".jimage")) {
+            // lib/modules of a JDK
+            m_class_path_entries.push_back({"", {}, std::make_unique<JImage>(path)});
         } else {
-            m_class_path_entries.push_back({path, {}});
+            m_class_path_entries.push_back({path, {}, {}});
+        }
+    }
+    // Classes are only looked up in the entries that contain their package
+    m_package_index.build(m_class_path_entries, package_index_cache);
+
+    m_archive = nullptr;
+    m_loaded_classes.clear();
+    m_record_loaded_classes = share_mode == ShareMode::Dump || !dump_loaded_class_list.empty();
+    if (share_mode == ShareMode::Auto || share_mode == ShareMode::On) {
+        m_archive = ClassArchive::open(shared_archive_file, m_class_path_entries);
+        if (m_archive == nullptr && share_mode == ShareMode::On) {
+            throw std::runtime_error("Unable to use the shared archive " + shared_archive_file);
+        }
+    }
+
+    if (preload_threads > 0) {
+        m_preloader = std::make_unique<ClassPreloader>(preload_threads, [this](std::string const &name) {
+            return parse_class(name);
+        });
+        if (!preload_class_list.empty()) {
+            std::ifstream in{preload_class_list};
+            for (std::string name; std::getline(in, name);) {
+                m_preloader->request(name);
+            }
         }
     }
 
     m_constants.java_lang_Class = load_or_throw(Names::java_lang_Class);
-    m_constants.java_lang_Class->header.clazz = m_constants.java_lang_Class;
+    m_constants.java_lang_Class->header.class_index = m_constants.java_lang_Class->class_table_index;
 
     m_constants.java_io_Serializable = load_or_throw(Names::java_io_Serializable);
     m_constants.java_lang_Cloneable = load_or_throw(Names::java_lang_Cloneable);
@@ -47,28 +80,106 @@ void BootstrapClassLoader::initialize_with_boot_classpath(std::string const &boo
 
 }
 
-// https://stackoverflow.com/a/7782037
-struct membuf : std::streambuf {
-    membuf(char *begin, char *end) {
-        this->setg(begin, begin, end);
+void BootstrapClassLoader::dump_shared_archive() {
+    std::vector<ClassArchive::Class> classes;
+    for (auto const &loaded : m_loaded_classes) {
+        // Only the archived copy of a decompressed class saves work. The others are parsed right from the mapping of
+        // their jar or jimage anyway, and the archive could not tell if classes from directories changed.
+        if (loaded.decompressed) {
+            classes.push_back({loaded.name, loaded.entry_index, m_classes.at(loaded.name)->class_file_bytes});
+        }
     }
-};
+    if (classes.empty()) {
+        std::cerr << "Warning: no decompressed classes were loaded, the shared archive " << shared_archive_file
+                  << " is empty\n";
+    }
+    ClassArchive::write(shared_archive_file, m_class_path_entries, std::move(classes));
+}
+
+void BootstrapClassLoader::dump_loaded_class_list_file() const {
+    std::ofstream out{dump_loaded_class_list};
+    for (auto const &loaded : m_loaded_classes) {
+        out << loaded.name << "\n";
+    }
+    if (!out) {
+        std::cerr << "Warning: failed to write the class list " << dump_loaded_class_list << "\n";
+    }
+}
 
-ClassFile *BootstrapClassLoader::load_or_throw(std::string const &name) {
+ClassFile *BootstrapClassLoader::load_or_throw(std::string_view name) {
     ClassFile *clazz = load(name);
     if (clazz == nullptr) {
-        throw std::runtime_error("Failed to load " + name);
+        throw std::runtime_error("Failed to load " + std::string(name));
     }
     return clazz;
 }
 
-ClassFile *BootstrapClassLoader::load(std::string const &name) {
-    if (auto found = m_classes.find(name); found != m_classes.end()) {
-        return found->second;
+ClassFile *BootstrapClassLoader::load(std::string_view name) {
+    {
+        // A placeholder marks a class that is being loaded, other threads wait for its result
+        std::unique_lock lock{m_mutex};
+        while (true) {
+            if (auto found = m_classes.find(name); found != m_classes.end()) {
+                return found->second;
+            }
+            auto placeholder = m_placeholders.find(name);
+            if (placeholder == m_placeholders.end()) {
+                break;
+            }
+            if (placeholder->second == std::this_thread::get_id()) {
+                // see https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-5.html#jvms-5.3.5
+                lock.unlock();
+                throw_new(this_thread, Names::java_lang_ClassCircularityError, std::string(name).c_str());
+                return nullptr;
+            }
+            m_class_loaded.wait(lock);
+        }
+        m_placeholders.emplace(std::string(name), std::this_thread::get_id());
+    }
+
+    ClassFile *result;
+    try {
+        result = load_uncached(name);
+    } catch (...) {
+        {
+            std::lock_guard lock{m_mutex};
+            m_placeholders.erase(m_placeholders.find(name));
+        }
+        m_class_loaded.notify_all();
+        throw;
+    }
+
+    {
+        std::lock_guard lock{m_mutex};
+        m_classes.insert({std::string(name), result});
+        m_placeholders.erase(m_placeholders.find(name));
+    }
+    m_class_loaded.notify_all();
+
+    if (result != nullptr && m_preloader != nullptr) {
+        // The classes in the constant pool are likely the next ones to be loaded
+        for (auto const &constant : result->constant_pool.table) {
+            if (auto class_info = std::get_if<CONSTANT_Class_info>(&constant.variant)) {
+                std::string_view referenced = class_info->name->value;
+                while (referenced.starts_with('[')) {
+                    referenced.remove_prefix(1);
+                }
+                if (referenced.starts_with('L') && referenced.ends_with(';')) {
+                    referenced = referenced.substr(1, referenced.size() - 2);
+                } else if (referenced.size() != class_info->name->value.size()) {
+                    continue; // primitive array
+                }
+                // The preloader ignores classes that it was asked for before
+                m_preloader->request(referenced);
+            }
+        }
     }
+    return result;
+}
 
+ClassFile *BootstrapClassLoader::load_uncached(std::string_view name) {
     if (name.size() >= 2 && name[0] == '[') {
-        std::string element_name;
+        std::string_view element_name;
         if (name[1] == 'L') {
             // turn [Ljava.lang.Boolean; into java.lang.Boolean
             element_name = name.substr(2, name.size() - 3);
@@ -82,59 +193,130 @@ ClassFile *BootstrapClassLoader::load(std::string const &name) {
         if (element_type == nullptr) {
             return nullptr;
         }
-        ClassFile *array_class = make_builtin_class(name, element_type);
+        ClassFile *array_class = make_builtin_class(std::string(name), element_type);
         return array_class;
     }
 
-    ClassFile *result = nullptr;
-    for (auto &cp_entry : m_class_path_entries) {
-        if (!cp_entry.directory.empty()) {
-            auto path = cp_entry.directory + "/" + name + ".class";
-            std::ifstream in{path, std::ios::in | std::ios::binary};
+    std::optional<ParsedClass> prefetched = m_preloader != nullptr ? m_preloader->take(name) : std::nullopt;
+    ParsedClass parsed = prefetched ? *prefetched : parse_class(name);
+    if (parsed.clazz == nullptr) {
+        return nullptr;
+    }
 
-            if (in) {
-                Parser parser{in};
-                result = Heap::get().allocate_class();
-                parser.parse(result);
-                break;
-            }
-        } else if (!cp_entry.zip.path.empty()) {
-            auto path = name + ".class";
+    if (m_record_loaded_classes) {
+        std::lock_guard lock{m_mutex};
+        m_loaded_classes.push_back({std::string(name), parsed.entry_index, parsed.decompressed});
+    }
+    auto &loader_data = Heap::get().class_loader_data(JAVA_NULL);
+    return Heap::get().add_class(loader_data, std::move(*parsed.clazz));
+}
 
-            if (ZipEntry const *zip_entry = cp_entry.zip.entry_for_path(path); zip_entry != nullptr) {
-                cp_entry.zip.read(*zip_entry, m_buffer);
+ParsedClass BootstrapClassLoader::parse_class(std::string_view name) {
+    // The class file is read into the arena (or used directly from a stored jar entry), the metadata borrows its
+    // strings from there
+    auto &loader_data = Heap::get().class_loader_data(JAVA_NULL);
+    auto class_file = read_class_file(name, [&loader_data](size_t size) {
+        return loader_data.allocate_bytes(size);
+    });
+    if (!class_file) {
+        return {nullptr, 0, false};
+    }
+
+    // Classes are parsed in parallel, each into a parse buffer of its own. Still serialized are: taking a parse
+    // buffer or a new chunk for one (the arena lock), adding the class to the heap (the metadata lock), publishing it
+    // in m_classes (m_mutex), and later all class and field resolution (resolution_lock).
+    ClassLoaderData::ParseScope scope{loader_data};
+    Parser parser{class_file->bytes};
+    // Moved into the heap by the loading thread, the moved-from ClassFile stays behind in the arena
+    auto *result = new(current_metadata_resource->allocate(sizeof(ClassFile), alignof(ClassFile))) ClassFile();
+    parser.parse(result);
+
+    if (name != result->name()) {
+        throw ParseError("unexpected name");
+    }
+    result->is_trusted = m_class_path_entries[class_file->entry_index].jimage != nullptr;
+    result->element_size = sizeof(StoredReference);
+    result->offset_of_array_after_header = offset_of_array_after_header<Array, StoredReference>();
+    return {result, class_file->entry_index, class_file->decompressed};
+}
 
-                membuf buf{m_buffer.data(), m_buffer.data() + m_buffer.size()};
-                std::istream in{&buf};
+std::optional<ClassFileBytes>
+BootstrapClassLoader::read_class_file(std::string_view name, std::function<u1 *(size_t)> const &allocate) const {
+    auto package_end = name.rfind('/');
+    auto package = package_end == std::string_view::npos ? std::string_view{} : name.substr(0, package_end);
 
-                Parser parser{in};
-                result = Heap::get().allocate_class();
-                parser.parse(result);
-                break;
-            }
-        }
+    std::optional<ArchivedClass> archived;
+    if (m_archive != nullptr) {
+        archived = m_archive->find(name);
     }
 
-    if (result != nullptr) {
-        if (name != result->name()) {
-            throw ParseError("unexpected name");
+    for (auto entry_index : m_package_index.entries_for(package)) {
+        auto &cp_entry = m_class_path_entries[entry_index];
+        if (archived && archived->entry_index == entry_index) {
+            // The archive stays mapped as long as the class loader exists
+            return ClassFileBytes{entry_index, archived->bytes};
+        } else if (!cp_entry.directory.empty()) {
+            auto path = cp_entry.directory + "/" + std::string(name) + ".class";
+            std::ifstream in{path, std::ios::in | std::ios::binary | std::ios::ate};
+
+            if (in) {
+                auto size = static_cast<size_t>(in.tellg());
+                auto *bytes = allocate(size);
+                in.seekg(0);
+                if (!in.read(reinterpret_cast<char *>(bytes), static_cast<std::streamsize>(size))) {
+                    throw std::runtime_error("Failed to read " + path);
+                }
+                return ClassFileBytes{entry_index, {bytes, size}};
+            }
+        } else if (cp_entry.zip != nullptr) {
+            auto path = std::string(name) + ".class";
+
+            if (auto zip_entry = cp_entry.zip->entry_for_path(path)) {
+                if (zip_entry->is_stored()) {
+                    // The archive stays mapped as long as the class loader exists
+                    return ClassFileBytes{entry_index, cp_entry.zip->stored_contents(*zip_entry)};
+                }
+                auto *bytes = allocate(zip_entry->size);
+                cp_entry.zip->read(*zip_entry, bytes);
+                return ClassFileBytes{entry_index, {bytes, zip_entry->size}, true};
+            }
+        } else if (cp_entry.jimage != nullptr) {
+            // Resources are named /module/package/Class.class, the module is found through the package
+            auto module = cp_entry.jimage->package_to_module(package);
+            if (!module) {
+                continue;
+            }
+            auto path = "/" + std::string(*module) + "/" + std::string(name) + ".class";
+
+            if (auto location = cp_entry.jimage->find_location(path)) {
+                if (!location->is_compressed()) {
+                    // The image stays mapped as long as the class loader exists
+                    return ClassFileBytes{entry_index, cp_entry.jimage->uncompressed_contents(*location)};
+                }
+                auto *bytes = allocate(location->uncompressed_size);
+                cp_entry.jimage->read(*location, bytes);
+                return ClassFileBytes{entry_index, {bytes, location->uncompressed_size}, true};
+            }
         }
-        result->element_size = sizeof(Value);
-        result->offset_of_array_after_header = offset_of_array_after_header<Object, Value>();
     }
+    return {};
+}
 
-    m_classes.insert({name, result});
-    return result;
+// Class.componentType is a Java field, so we can only set it once the layout of java.lang.Class is known
+static void store_component_type(ClassFile *array_class, size_t offset) {
+    *Reference{array_class}.element_at_offset<StoredReference>(offset) = Reference{array_class->array_element_type};
 }
 
 ClassFile *BootstrapClassLoader::make_builtin_class(std::string name, ClassFile *array_element_type) {
-    auto clazz = Heap::get().allocate_class();
+    auto &loader_data = Heap::get().class_loader_data(JAVA_NULL);
+    ClassLoaderData::Scope scope{loader_data};
+    auto clazz = Heap::get().allocate_class(loader_data);
 
     u2 index = 0;
-    auto add_name_and_class = [&clazz, &name, &index](ClassFile *c) -> CONSTANT_Class_info * {
+    auto add_name_and_class = [&clazz, &name, &index, &loader_data](ClassFile *c) -> CONSTANT_Class_info * {
         assert(c);
         clazz->constant_pool.table[index].variant = CONSTANT_Utf8_info{
-                c == clazz ? name : c->name()
+                c == clazz ? loader_data.store_string(name) : c->name()
         };
         clazz->constant_pool.table[index + 1].variant = CONSTANT_Class_info{
                 index,
@@ -148,14 +330,18 @@ ClassFile *BootstrapClassLoader::make_builtin_class(std::string name, ClassFile
 
     if (array_element_type != nullptr) {
         clazz->constant_pool.table.resize(4 * 2);
+        clazz->constant_pool.resolved.resize(4 * 2);
         clazz->super_class_ref = add_name_and_class(clazz->super_class = constants().java_lang_Object);
         clazz->interfaces.push_back(add_name_and_class(constants().java_lang_Cloneable));
         clazz->interfaces.push_back(add_name_and_class(constants().java_io_Serializable));
-        clazz->field_component_type = Value{Reference{array_element_type}};
+        if (constants().java_lang_Class_componentType != 0) {
+            store_component_type(clazz, constants().java_lang_Class_componentType);
+        }
         clazz->element_size = array_element_type->element_size;
         clazz->offset_of_array_after_header = array_element_type->offset_of_array_after_header;
     } else {
         clazz->constant_pool.table.resize(1 * 2);
+        clazz->constant_pool.resolved.resize(1 * 2);
         // `element_size` and `offset_of_array_after_header` will be set in `initialize_with_boot_classpath`
     }
     clazz->this_class = add_name_and_class(clazz);
@@ -163,7 +349,10 @@ ClassFile *BootstrapClassLoader::make_builtin_class(std::string name, ClassFile
 
     // TODO add array clone method here?
 
-    m_classes.insert({std::move(name), clazz});
+    {
+        std::lock_guard lock{m_mutex};
+        m_classes.insert({std::move(name), clazz});
+    }
     return clazz;
 }
 
@@ -179,7 +368,7 @@ static void initialize_static_fields(ClassFile *clazz) {
                         assert(false);
                     }
                     fail = true;
-                    auto const &value = clazz->constant_pool.table[constant_value_attribute->constantvalue_index].variant;
+                    auto &value = clazz->constant_pool.table[constant_value_attribute->constantvalue_index].variant;
 
                     auto &descriptor = field.descriptor_index->value;
                     if (descriptor == "I" || descriptor == "S" || descriptor == "C" || descriptor == "B" ||
@@ -192,7 +381,7 @@ static void initialize_static_fields(ClassFile *clazz) {
                     } else if (descriptor == "D") {
                         clazz->static_field_values[field.index] = Value(std::get<CONSTANT_Double_info>(value).value);
                     } else if (descriptor == "Ljava/lang/String;") {
-                        auto java_string = Heap::get().load_string(std::get<CONSTANT_String_info>(value).string);
+                        auto java_string = Heap::get().load_string(std::get<CONSTANT_String_info>(value));
                         clazz->static_field_values[field.index] = Value(java_string);
                     } else {
                         assert(false);
@@ -225,16 +414,44 @@ static Result recursively_initialize_interfaces(ClassFile *clazz, Thread &thread
     return ResultOk;
 };
 
+namespace {
+// The initialization lock of a class is only needed until the class is initialized, so ClassFile does not embed it.
+// Classes share the locks by their position in the class table, waiting threads recheck their condition.
+struct InitializationLock {
+    std::mutex mutex;
+    std::condition_variable condition_variable;
+};
+
+std::array<InitializationLock, 64> initialization_locks;
+
+InitializationLock &initialization_lock(ClassFile *C) {
+    return initialization_locks[C->class_table_index % initialization_locks.size()];
+}
+}
+
+static bool should_verify(ClassFile *C) {
+    switch (BootstrapClassLoader::get().verify_mode) {
+        case VerifyMode::None:
+            return false;
+        case VerifyMode::Remote:
+            return !C->is_trusted;
+        case VerifyMode::All:
+            return true;
+    }
+    return true;
+}
+
 // https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-5.html#jvms-5.5
 Result initialize_class(ClassFile *C, Thread &thread) {
     // quick check without lock
-    if (C->is_initialized) {
+    if (load_acquire(C->is_initialized)) {
         return ResultOk;
     }
 
     // 1. Synchronize on the initialization lock, LC, for C.
     //    This involves waiting until the current thread can acquire LC.
-    std::unique_lock LC{C->initialization_lock};
+    auto &lock = initialization_lock(C);
+    std::unique_lock LC{lock.mutex};
 
     // 3. If the Class object for C indicates that initialization is in progress for C by the current thread,
     //    then this must be a recursive request for initialization. Release LC and complete normally.
@@ -246,19 +463,20 @@ Result initialize_class(ClassFile *C, Thread &thread) {
     //    then release LC and block the current thread until informed that the in-progress initialization has completed,
     //    at which time repeat this procedure.
     //    Thread interrupt status is unaffected by execution of the initialization procedure.
-    C->initialization_condition_variable.wait(LC, [C]() {
+    lock.condition_variable.wait(LC, [C]() {
         return C->initializing_thread == nullptr;
     });
 
     // 4. If the Class object for C indicates that C has already been initialized, then no further action is required. Release LC and complete normally.
-    if (C->is_initialized) {
+    if (load_acquire(C->is_initialized)) {
         return ResultOk;
     }
 
     // 5. If the Class object for C is in an erroneous state, then initialization is not possible. Release LC and throw a NoClassDefFoundError.
     if (C->is_erroneous_state) {
         LC.unlock();
-        abort(); // TODO throw
+        throw_new(thread, Names::java_lang_NoClassDefFoundError, std::string(C->name()).c_str());
+        return Exception;
     }
 
     // 6. Otherwise, record the fact that initialization of the Class object for C is in progress by the current thread, and release LC.
@@ -266,6 +484,26 @@ Result initialize_class(ClassFile *C, Thread &thread) {
     //    in the order the fields appear in the ClassFile structure.
     C->initializing_thread = &thread;
     LC.unlock();
+
+    // Linking: C is verified by the thread that initializes it, https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-5.html#jvms-5.4.1
+    // C is not erroneous if that fails: "subsequent attempts to verify the class always fail with the same error", so
+    // like HotSpot, the next attempt verifies C again.
+    if (should_verify(C)) {
+        try {
+            verify_class(C);
+        } catch (VerifyError const &e) {
+            LC.lock();
+            C->initializing_thread = nullptr;
+            lock.condition_variable.notify_all();
+            LC.unlock();
+            throw_new(thread, Names::java_lang_VerifyError, e.what());
+            return Exception;
+        }
+    }
+#ifndef SCHOKOVM_PROFILE_OPCODE_PAIRS
+    rewrite_superinstructions(C);
+#endif
+
     initialize_static_fields(C);
 
     // 7. Next, if C is a class rather than an interface, then let SC be its superclass and let SI1, ..., SIn be all
@@ -282,11 +520,11 @@ Result initialize_class(ClassFile *C, Thread &thread) {
     //    object for C as erroneous, notify all waiting threads, release LC, and complete abruptly, throwing the same
     //    exception that resulted from initializing SC.
     if (!C->is_interface()) {
-        auto fail7 = [&LC, C]() {
+        auto fail7 = [&LC, &lock, C]() {
             LC.lock();
             C->is_erroneous_state = true;
             C->initializing_thread = nullptr;
-            C->initialization_condition_variable.notify_all();
+            lock.condition_variable.notify_all();
             LC.unlock();
             return Exception;
         };
@@ -320,9 +558,9 @@ Result initialize_class(ClassFile *C, Thread &thread) {
     //     notify all waiting threads, release LC, and complete this procedure normally.
     if (no_exception) {
         LC.lock();
-        C->is_initialized = true;
+        store_release(C->is_initialized, true);
         C->initializing_thread = nullptr;
-        C->initialization_condition_variable.notify_all();
+        lock.condition_variable.notify_all();
         return ResultOk;
     }
 
@@ -340,13 +578,111 @@ Result initialize_class(ClassFile *C, Thread &thread) {
     LC.lock();
     C->is_erroneous_state = true;
     C->initializing_thread = nullptr;
-    C->initialization_condition_variable.notify_all();
+    lock.condition_variable.notify_all();
     LC.unlock();
 
     return Exception;
 }
 
+// Instance fields are placed after the fields of the superclass and grouped by their size (8, 4, 2, 1 bytes),
+// so that every field is naturally aligned and no space is wasted between them. Small fields are used to fill
+// the gap that the superclass might leave at its end.
+static void lay_out_instance_fields(ClassFile *clazz) {
+    size_t offset = sizeof(Object);
+    if (clazz->super_class != nullptr) {
+        offset = clazz->super_class->instance_size;
+        clazz->reference_field_offsets = clazz->super_class->reference_field_offsets;
+    }
+
+    std::vector<field_info *> fields;
+    fields.reserve(clazz->declared_instance_field_count);
+    for (auto &field : clazz->fields) {
+        if (!field.is_static()) {
+            fields.push_back(&field);
+        }
+    }
+    std::stable_sort(fields.begin(), fields.end(), [](field_info const *a, field_info const *b) {
+        return a->size() > b->size();
+    });
+
+    auto align_up = [](size_t value, size_t alignment) {
+        return (value + alignment - 1) & ~(alignment - 1);
+    };
+    auto place = [clazz, &offset](field_info *field) {
+        field->offset = offset;
+        offset += field->size();
+        if (field->is_reference_type()) {
+            clazz->reference_field_offsets.push_back(field->offset);
+        }
+    };
+
+    if (!fields.empty()) {
+        size_t gap_end = align_up(offset, fields.front()->size());
+        for (bool placed = true; offset != gap_end && placed;) {
+            placed = false;
+            for (auto it = fields.begin(); it != fields.end(); ++it) {
+                size_t size = (*it)->size();
+                if (offset % size == 0 && offset + size <= gap_end) {
+                    place(*it);
+                    fields.erase(it);
+                    placed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (auto *field : fields) {
+        offset = align_up(offset, field->size());
+        place(field);
+    }
+
+    clazz->instance_size = offset;
+}
+
+// Subclasses of java.lang.ref.Reference need special treatment by the garbage collector
+static void set_up_reference_class(ClassFile *clazz) {
+    if (clazz->super_class != nullptr) {
+        clazz->reference_kind = clazz->super_class->reference_kind;
+    }
+
+    auto declared_field = [clazz](std::string_view name, std::string_view descriptor) -> field_info & {
+        for (auto &field : clazz->fields) {
+            if (field.name_index->value == name && field.descriptor_index->value == descriptor) {
+                return field;
+            }
+        }
+        throw std::runtime_error("field not found: " + std::string(clazz->name()) + "." + std::string(name));
+    };
+
+    auto &fields = Heap::get().reference_fields;
+    auto const &name = clazz->name();
+    if (name == Names::java_lang_ref_Reference) {
+        fields.referent = declared_field("referent", "Ljava/lang/Object;").offset;
+        fields.next = declared_field("next", "Ljava/lang/ref/Reference;").offset;
+        fields.discovered = declared_field("discovered", "Ljava/lang/ref/Reference;").offset;
+    } else if (name == Names::java_lang_ref_SoftReference) {
+        clazz->reference_kind = ReferenceKind::Soft;
+        fields.soft_timestamp = declared_field("timestamp", "J").offset;
+        fields.soft_clock = &clazz->static_field_values[declared_field("clock", "J").index];
+    } else if (name == Names::java_lang_ref_WeakReference) {
+        clazz->reference_kind = ReferenceKind::Weak;
+    } else if (name == Names::java_lang_ref_FinalReference) {
+        clazz->reference_kind = ReferenceKind::Final;
+    } else if (name == Names::java_lang_ref_PhantomReference) {
+        clazz->reference_kind = ReferenceKind::Phantom;
+    }
+}
+
+// Resolution happens once per class or constant, so one lock for all of it is enough. It is recursive because
+// resolving a class resolves its super classes.
+static std::recursive_mutex resolution_lock;
+
 Result resolve_class(ClassFile *clazz) {
+    if (load_acquire(clazz->resolved)) {
+        return ResultOk;
+    }
+    std::lock_guard lock{resolution_lock};
     if (clazz->resolved) {
         return ResultOk;
     }
@@ -356,42 +692,55 @@ Result resolve_class(ClassFile *clazz) {
             ++clazz->declared_instance_field_count;
     }
 
-    size_t parent_instance_field_count = 0;
     if (clazz->super_class == nullptr && clazz->super_class_ref != nullptr) {
         if (resolve_class(clazz->super_class_ref))
             return Exception;
 
         clazz->super_class = clazz->super_class_ref->clazz;
-        parent_instance_field_count = clazz->super_class->total_instance_field_count;
     }
 
-    // instance and static fields
-    clazz->total_instance_field_count = clazz->declared_instance_field_count + parent_instance_field_count;
-    for (size_t static_index = 0, instance_index = parent_instance_field_count; auto &field : clazz->fields) {
-        if (field.is_static()) {
-            // used to index into clazz->static_field_values
-            field.index = static_index++;
-        } else {
-            // used to index into instance fields
-            field.index = instance_index++;
+    {
+        // The static field values are allocated in the class loader's arena. The scope must not be held while other
+        // classes are loaded, the loading thread needs the arena too.
+        ClassLoaderData::Scope scope{*clazz->loader_data};
+
+        // static fields
+        for (size_t static_index = 0; auto &field : clazz->fields) {
+            if (field.is_static()) {
+                // used to index into clazz->static_field_values
+                field.index = static_index++;
+            }
+            field.category = (field.descriptor_index->value == "D" || field.descriptor_index->value == "J")
+                             ? ValueCategory::C2 : ValueCategory::C1;
+        }
+        clazz->static_field_values.resize(clazz->fields.size() - clazz->declared_instance_field_count);
+
+        // instance fields
+        lay_out_instance_fields(clazz);
+        set_up_reference_class(clazz);
+    }
+
+    if (clazz->name() == Names::java_lang_Class) {
+        // The Java fields of class objects are stored in ClassFile::java_instance_fields
+        auto end = static_cast<size_t>(reinterpret_cast<char *>(&clazz->magic) - reinterpret_cast<char *>(clazz));
+        if (clazz->instance_size > end) {
+            throw std::runtime_error("java/lang/Class has too many fields");
         }
-        field.category = (field.descriptor_index->value == "D" || field.descriptor_index->value == "J")
-                         ? ValueCategory::C2 : ValueCategory::C1;
     }
-    clazz->static_field_values.resize(clazz->fields.size() - clazz->declared_instance_field_count);
 
     for (auto &interface : clazz->interfaces) {
         if (resolve_class(interface))
             return Exception;
     }
 
-    clazz->resolved = true;
-    clazz->this_class->clazz = clazz;
+    store_release(clazz->this_class->clazz, clazz);
+    store_release(clazz->resolved, true);
     return ResultOk;
 }
 
 Result resolve_class(CONSTANT_Class_info *class_info) {
-    if (class_info->clazz == nullptr) {
+    // Threads that race here load and resolve the same class and store the same pointer
+    if (load_acquire(class_info->clazz) == nullptr) {
         auto &name = class_info->name->value;
 
         // see https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-5.html#jvms-5.3.5
@@ -401,22 +750,28 @@ Result resolve_class(CONSTANT_Class_info *class_info) {
 
         // TODO check other classloaders first
         ClassFile *clazz = BootstrapClassLoader::get().load(name);
+        if (clazz == nullptr && this_thread.current_exception != JAVA_NULL) {
+            return Exception;
+        }
         if (clazz == nullptr) {
             // TODO this prints "A not found" if A was found but a superclass/interface wasn't
-            throw std::runtime_error("class not found: '" + name + "'");
+            throw std::runtime_error("class not found: '" + std::string(name) + "'");
         }
 
         if (resolve_class(clazz) == Exception) {
             return Exception;
         }
 
-        class_info->clazz = clazz;
+        store_release(class_info->clazz, clazz);
     }
     return ResultOk;
 }
 
 Result resolve_field(ClassFile *clazz, CONSTANT_Fieldref_info *fieldref_info, Reference &exception) {
-    assert(!fieldref_info->resolved);
+    std::lock_guard lock{resolution_lock};
+    if (fieldref_info->resolved) {
+        return ResultOk;
+    }
 
     field_info *info = find_field(clazz, fieldref_info->name_and_type->name->value,
                                   fieldref_info->name_and_type->descriptor->value, exception);
@@ -424,12 +779,14 @@ Result resolve_field(ClassFile *clazz, CONSTANT_Fieldref_info *fieldref_info, Re
         return Exception;
     }
 
-    fieldref_info->resolved = true;
     fieldref_info->is_boolean = info->descriptor_index->value == "Z";
     fieldref_info->is_static = info->is_static();
     fieldref_info->value_clazz = info->clazz;
     fieldref_info->index = info->index;
+    fieldref_info->offset = info->offset;
+    fieldref_info->type = info->descriptor_index->value[0];
     fieldref_info->category = info->category;
+    store_release(fieldref_info->resolved, true);
 
     return ResultOk;
 }
@@ -472,19 +829,30 @@ field_info *find_field(ClassFile *clazz, std::string_view name, std::string_view
     return result;
 }
 
+size_t instance_field_offset(ClassFile *clazz, std::string_view name, std::string_view descriptor) {
+    assert(clazz->resolved);
+    auto *result = find_field_recursive(clazz, name, descriptor);
+    if (result == nullptr || result->is_static()) {
+        throw std::runtime_error("instance field not found: " + std::string(clazz->name()) + "." + std::string(name));
+    }
+    return result->offset;
+}
+
 
 void Constants::resolve_and_initialize(Thread &thread) {
     if (thread.current_exception != JAVA_NULL) {
         throw std::runtime_error("Failed to resolve and initialize");
     }
 
-    auto resolve_and_initialize = [&thread](ClassFile *clazz) {
+    auto resolve = [&thread](ClassFile *clazz) {
         if (resolve_class(clazz->this_class)) {
             throw std::runtime_error("Failed to resolve");
         }
         if (thread.current_exception != JAVA_NULL) {
             throw std::runtime_error("Failed to resolve2");
         }
+    };
+    auto initialize = [&thread](ClassFile *clazz) {
         if (initialize_class(clazz, thread)) {
             throw std::runtime_error("Failed to initialize");
         }
@@ -493,11 +861,29 @@ void Constants::resolve_and_initialize(Thread &thread) {
         }
     };
 
-    resolve_and_initialize(java_lang_Object);
-    resolve_and_initialize(java_lang_Class);
-    resolve_and_initialize(java_lang_String);
-    resolve_and_initialize(java_io_Serializable);
-    resolve_and_initialize(java_lang_Cloneable);
-    resolve_and_initialize(java_lang_Thread);
-    resolve_and_initialize(java_lang_ThreadGroup);
+    // Resolve everything first, the offsets are needed as soon as objects of these classes are created.
+    for (auto *clazz : {java_lang_Object, java_lang_Class, java_lang_String, java_io_Serializable,
+                        java_lang_Cloneable, java_lang_Thread, java_lang_ThreadGroup, java_lang_Throwable}) {
+        resolve(clazz);
+    }
+
+    java_lang_Class_componentType = instance_field_offset(java_lang_Class, "componentType", "Ljava/lang/Class;");
+    for (auto const &clazz : Heap::get().classes) {
+        if (clazz->is_array()) {
+            store_component_type(clazz.get(), java_lang_Class_componentType);
+        }
+    }
+    java_lang_String_value = instance_field_offset(java_lang_String, "value", "[B");
+    java_lang_String_coder = instance_field_offset(java_lang_String, "coder", "B");
+    java_lang_Thread_priority = instance_field_offset(java_lang_Thread, "priority", "I");
+    java_lang_Throwable_backtrace = instance_field_offset(java_lang_Throwable, "backtrace", "Ljava/lang/Object;");
+    java_lang_Throwable_depth = instance_field_offset(java_lang_Throwable, "depth", "I");
+
+    initialize(java_lang_Object);
+    initialize(java_lang_Class);
+    initialize(java_lang_String);
+    initialize(java_io_Serializable);
+    initialize(java_lang_Cloneable);
+    initialize(java_lang_Thread);
+    initialize(java_lang_ThreadGroup);
 }
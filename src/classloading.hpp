@@ -1,18 +1,20 @@
 #ifndef SCHOKOVM_CLASSLOADING_HPP
 #define SCHOKOVM_CLASSLOADING_HPP
 
+#include <condition_variable>
+#include <functional>
+#include <mutex>
 #include <optional>
+#include <thread>
 #include <unordered_map>
 
+#include "archive.hpp"
 #include "classfile.hpp"
+#include "classpath.hpp"
 #include "interpreter.hpp"
-#include "zip.hpp"
-
-struct ClassPathEntry {
-    // one of these will be empty
-    std::string directory;
-    ZipArchive zip;
-};
+#include "preloader.hpp"
+#include "util.hpp"
+#include "verifier.hpp"
 
 struct Primitive {
     enum Type {
@@ -53,11 +55,13 @@ namespace Names {
     ccc java_lang_Character = "java/lang/Character";
     ccc java_lang_Class = "java/lang/Class";
     ccc java_lang_ClassCastException = "java/lang/ClassCastException";
+    ccc java_lang_ClassCircularityError = "java/lang/ClassCircularityError";
     ccc java_lang_Cloneable = "java/lang/Cloneable";
     ccc java_lang_Double = "java/lang/Double";
     ccc java_lang_Float = "java/lang/Float";
     ccc java_lang_Integer = "java/lang/Integer";
     ccc java_lang_Long = "java/lang/Long";
+    ccc java_lang_NoClassDefFoundError = "java/lang/NoClassDefFoundError";
     ccc java_lang_NullPointerException = "java/lang/NullPointerException";
     ccc java_lang_Object = "java/lang/Object";
     ccc java_lang_Short = "java/lang/Short";
@@ -65,7 +69,13 @@ namespace Names {
     ccc java_lang_Thread = "java/lang/Thread";
     ccc java_lang_ThreadGroup = "java/lang/ThreadGroup";
     ccc java_lang_Throwable = "java/lang/Throwable";
+    ccc java_lang_VerifyError = "java/lang/VerifyError";
     ccc java_lang_Void = "java/lang/Void";
+    ccc java_lang_ref_FinalReference = "java/lang/ref/FinalReference";
+    ccc java_lang_ref_PhantomReference = "java/lang/ref/PhantomReference";
+    ccc java_lang_ref_Reference = "java/lang/ref/Reference";
+    ccc java_lang_ref_SoftReference = "java/lang/ref/SoftReference";
+    ccc java_lang_ref_WeakReference = "java/lang/ref/WeakReference";
 };
 
 struct Constants {
@@ -79,15 +89,23 @@ struct Constants {
     ClassFile *java_lang_Thread{};
     ClassFile *java_lang_Throwable{};
 
+    // Offsets of instance fields that are accessed by the VM
+    size_t java_lang_Class_componentType{};
+    size_t java_lang_String_value{};
+    size_t java_lang_String_coder{};
+    size_t java_lang_Thread_priority{};
+    size_t java_lang_Throwable_backtrace{};
+    size_t java_lang_Throwable_depth{};
+
     Primitive primitives[Primitive::TYPE_COUNT] = {
-            {Primitive::Byte,    "byte",    nullptr, Names::java_lang_Byte,      nullptr, 'B', "[B", nullptr, sizeof(s1),     offset_of_array_after_header<Object, s1>()},
-            {Primitive::Char,    "char",    nullptr, Names::java_lang_Character, nullptr, 'C', "[C", nullptr, sizeof(u2),     offset_of_array_after_header<Object, u2>()},
-            {Primitive::Double,  "double",  nullptr, Names::java_lang_Double,    nullptr, 'D', "[D", nullptr, sizeof(double), offset_of_array_after_header<Object, double>()},
-            {Primitive::Float,   "float",   nullptr, Names::java_lang_Float,     nullptr, 'F', "[F", nullptr, sizeof(float),  offset_of_array_after_header<Object, float>()},
-            {Primitive::Int,     "int",     nullptr, Names::java_lang_Integer,   nullptr, 'I', "[I", nullptr, sizeof(s4),     offset_of_array_after_header<Object, s4>()},
-            {Primitive::Long,    "long",    nullptr, Names::java_lang_Long,      nullptr, 'J', "[J", nullptr, sizeof(s8),     offset_of_array_after_header<Object, s8>()},
-            {Primitive::Short,   "short",   nullptr, Names::java_lang_Short,     nullptr, 'S', "[S", nullptr, sizeof(s4),     offset_of_array_after_header<Object, s4>()},
-            {Primitive::Boolean, "boolean", nullptr, Names::java_lang_Boolean,   nullptr, 'Z', "[Z", nullptr, sizeof(s1),     offset_of_array_after_header<Object, s1>()},
+            {Primitive::Byte,    "byte",    nullptr, Names::java_lang_Byte,      nullptr, 'B', "[B", nullptr, sizeof(s1),     offset_of_array_after_header<Array, s1>()},
+            {Primitive::Char,    "char",    nullptr, Names::java_lang_Character, nullptr, 'C', "[C", nullptr, sizeof(u2),     offset_of_array_after_header<Array, u2>()},
+            {Primitive::Double,  "double",  nullptr, Names::java_lang_Double,    nullptr, 'D', "[D", nullptr, sizeof(double), offset_of_array_after_header<Array, double>()},
+            {Primitive::Float,   "float",   nullptr, Names::java_lang_Float,     nullptr, 'F', "[F", nullptr, sizeof(float),  offset_of_array_after_header<Array, float>()},
+            {Primitive::Int,     "int",     nullptr, Names::java_lang_Integer,   nullptr, 'I', "[I", nullptr, sizeof(s4),     offset_of_array_after_header<Array, s4>()},
+            {Primitive::Long,    "long",    nullptr, Names::java_lang_Long,      nullptr, 'J', "[J", nullptr, sizeof(s8),     offset_of_array_after_header<Array, s8>()},
+            {Primitive::Short,   "short",   nullptr, Names::java_lang_Short,     nullptr, 'S', "[S", nullptr, sizeof(s4),     offset_of_array_after_header<Array, s4>()},
+            {Primitive::Boolean, "boolean", nullptr, Names::java_lang_Boolean,   nullptr, 'Z', "[Z", nullptr, sizeof(s1),     offset_of_array_after_header<Array, s1>()},
             {Primitive::Void,    "void",    nullptr, Names::java_lang_Void,      nullptr, 'V', "[V", nullptr, 0,              0},
     };
 
@@ -106,23 +124,81 @@ struct BootstrapClassLoader {
     static Primitive const &
     primitive(Primitive::Type id) { return the_bootstrap_class_loader.m_constants.primitives[id]; }
 
+    // If set, the package index of the boot class path is cached in this file (-XX:PackageIndexCache=<file>)
+    std::string package_index_cache;
+
+    // -Xshare and -XX:SharedArchiveFile=<file>
+    ShareMode share_mode = ShareMode::Off;
+    std::string shared_archive_file;
+
+    // -XX:PreloadThreads=<n>: read and parse the classes in the constant pools of loaded classes on n background
+    // threads
+    size_t preload_threads = 0;
+    // -XX:PreloadClassList=<file>: classes that are preloaded right away, e.g. written by -XX:DumpLoadedClassList
+    std::string preload_class_list;
+    // -XX:DumpLoadedClassList=<file>: the classes in the order they were loaded, written when the VM exits
+    std::string dump_loaded_class_list;
+
+    // -Xverify:none|remote|all
+    VerifyMode verify_mode = VerifyMode::Remote;
+
     void initialize_with_boot_classpath(std::string const &bootclasspath);
 
-    ClassFile *load(std::string const &name);
+    // Finds and reads a class file without parsing it. The bytes point into a mapping that lives as long as the
+    // loader, or into memory from `allocate`. Can be called from any thread.
+    std::optional<ClassFileBytes> read_class_file(std::string_view name,
+                                                  std::function<u1 *(size_t)> const &allocate) const;
+
+    // Reads and parses a class without adding it to the heap. Can be called from any thread.
+    ParsedClass parse_class(std::string_view name);
+
+    // Joins the preloading threads, e.g. before the process forks
+    void stop_preloading() { m_preloader = nullptr; }
 
-    ClassFile *load_or_throw(std::string const &name);
+    // Writes -XX:DumpLoadedClassList
+    void dump_loaded_class_list_file() const;
+
+    // Writes the classes that were loaded from jars and jimages to the shared archive (-Xshare:dump)
+    void dump_shared_archive();
+
+    // Returns nullptr if the class was not found. If the current thread is already loading it, a
+    // ClassCircularityError is thrown in the current thread and nullptr is returned as well.
+    ClassFile *load(std::string_view name);
+
+    ClassFile *load_or_throw(std::string_view name);
 
     void unnamed_module(Reference unnamed_module) { m_unnamed_module = unnamed_module; }
 
 private:
     std::vector<ClassPathEntry> m_class_path_entries;
-    std::vector<char> m_buffer;
-    std::unordered_map<std::string, ClassFile *> m_classes;
+    PackageIndex m_package_index;
+    std::unique_ptr<ClassArchive> m_archive;
+    // For -Xshare:dump and -XX:DumpLoadedClassList: the loaded classes, with the index of their class path entry
+    bool m_record_loaded_classes = false;
+    struct LoadedClass {
+        std::string name;
+        size_t entry_index;
+        bool decompressed;
+    };
+    std::vector<LoadedClass> m_loaded_classes;
+    // Guards m_classes, m_placeholders and m_loaded_classes
+    std::mutex m_mutex;
+    std::condition_variable m_class_loaded;
+    // Allows lookups with the names in the constant pool without copying them
+    std::unordered_map<std::string, ClassFile *, NameHash, std::equal_to<>> m_classes;
+    // The classes that are being loaded, and the threads that load them
+    std::unordered_map<std::string, std::thread::id, NameHash, std::equal_to<>> m_placeholders;
     Constants m_constants;
     Reference m_unnamed_module;
 
+    // Declared last, its threads use the other members
+    std::unique_ptr<ClassPreloader> m_preloader;
+
     static BootstrapClassLoader the_bootstrap_class_loader;
 
+    // Loads a class that is not in m_classes yet, the caller holds its placeholder
+    ClassFile *load_uncached(std::string_view name);
+
     ClassFile *make_builtin_class(std::string name, ClassFile *element_type);
 };
 
@@ -130,7 +206,7 @@ Result initialize_class(ClassFile *C, Thread &thread);
 
 inline Result initialize_class(ClassFile *C, Thread &thread, Frame &frame) {
     // quick check without lock
-    if (C->is_initialized) {
+    if (load_acquire(C->is_initialized)) {
         return ResultOk;
     }
     thread.stack.push_frame(frame);
@@ -154,5 +230,10 @@ field_info *find_field(ClassFile *clazz, std::string_view name, std::string_view
 
 Result resolve_field(ClassFile *clazz, CONSTANT_Fieldref_info *fieldref_info, Reference &exception);
 
+/**
+ * Returns the offset of an instance field in a resolved class. Throws if the field does not exist.
+ */
+size_t instance_field_offset(ClassFile *clazz, std::string_view name, std::string_view descriptor);
+
 
 #endif //SCHOKOVM_CLASSLOADING_HPP
@@ -0,0 +1,183 @@
+#include "classpath.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_set>
+
+#include <unistd.h>
+
+namespace {
+constexpr std::string_view cache_header = "SchokoVM package index 2";
+}
+
+std::string const &ClassPathEntry::path() const {
+    if (zip != nullptr) {
+        return zip->path;
+    }
+    if (jimage != nullptr) {
+        return jimage->path;
+    }
+    return directory;
+}
+
+FileStamp FileStamp::of(std::string path) {
+    std::error_code error;
+    auto time = std::filesystem::last_write_time(path, error);
+    if (error) {
+        // Missing entries are indexed as well, the cache becomes invalid when they are created
+        return {std::move(path), -1, 0};
+    }
+    u8 size = 0;
+    if (std::filesystem::is_regular_file(path, error)) {
+        size = std::filesystem::file_size(path, error);
+    }
+    return {std::move(path), static_cast<s8>(time.time_since_epoch().count()), size};
+}
+
+PackageIndex::IndexedEntry PackageIndex::index_entry(ClassPathEntry const &entry) {
+    IndexedEntry indexed{entry.path(), {}, {}};
+    // Directories are not indexed, they are always probed (see entries_for)
+    std::unordered_set<std::string> packages;
+    if (entry.zip != nullptr) {
+        indexed.stamps.push_back(FileStamp::of(entry.zip->path));
+        for (auto name : entry.zip->entry_names()) {
+            if (name.ends_with(".class")) {
+                auto package_end = name.rfind('/');
+                packages.emplace(package_end == std::string_view::npos ? "" : name.substr(0, package_end));
+            }
+        }
+    } else if (entry.jimage != nullptr) {
+        indexed.stamps.push_back(FileStamp::of(entry.jimage->path));
+        for (auto package : entry.jimage->packages()) {
+            std::string name{package};
+            std::replace(name.begin(), name.end(), '.', '/');
+            packages.insert(std::move(name));
+        }
+    }
+    indexed.packages.assign(std::make_move_iterator(packages.begin()), std::make_move_iterator(packages.end()));
+    return indexed;
+}
+
+std::optional<std::vector<PackageIndex::IndexedEntry>>
+PackageIndex::read_cache(std::string const &cache_path, std::vector<ClassPathEntry> const &entries) {
+    std::ifstream in{cache_path};
+    std::string line;
+    if (!in || !std::getline(in, line) || line != cache_header) {
+        return {};
+    }
+
+    // One item per line: "entry <path>", followed by its "stamp <time> <size> <path>" and "package <name>" lines
+    std::vector<IndexedEntry> indexed_entries;
+    while (std::getline(in, line)) {
+        if (line.starts_with("entry ")) {
+            indexed_entries.push_back({line.substr(6), {}, {}});
+        } else if (indexed_entries.empty()) {
+            return {};
+        } else if (line.starts_with("stamp ")) {
+            std::istringstream fields{line.substr(6)};
+            FileStamp stamp{"", 0, 0};
+            if (!(fields >> stamp.modification_time >> stamp.size) || fields.get() != ' ') {
+                return {};
+            }
+            std::getline(fields, stamp.path);
+            indexed_entries.back().stamps.push_back(std::move(stamp));
+        } else if (line.starts_with("package ")) {
+            indexed_entries.back().packages.push_back(line.substr(8));
+        } else {
+            return {};
+        }
+    }
+
+    if (indexed_entries.size() != entries.size()) {
+        return {};
+    }
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (indexed_entries[i].path != entries[i].path()) {
+            return {};
+        }
+        for (auto const &cached : indexed_entries[i].stamps) {
+            if (FileStamp::of(cached.path) != cached) {
+                return {};
+            }
+        }
+    }
+    return indexed_entries;
+}
+
+void PackageIndex::write_cache(std::string const &cache_path, std::vector<IndexedEntry> const &indexed_entries) {
+    // Written to a temporary file first, so a concurrently starting VM never reads a partial cache
+    auto temporary_path = cache_path + "." + std::to_string(getpid());
+    {
+        std::ofstream out{temporary_path, std::ios::out | std::ios::trunc};
+        out << cache_header << "\n";
+        for (auto const &entry : indexed_entries) {
+            out << "entry " << entry.path << "\n";
+            for (auto const &stamp : entry.stamps) {
+                out << "stamp " << stamp.modification_time << " " << stamp.size << " " << stamp.path << "\n";
+            }
+            for (auto const &package : entry.packages) {
+                out << "package " << package << "\n";
+            }
+        }
+        if (!out) {
+            std::cerr << "Warning: failed to write the package index cache " << cache_path << "\n";
+            std::filesystem::remove(temporary_path);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary_path, cache_path, error);
+    if (error) {
+        std::cerr << "Warning: failed to write the package index cache " << cache_path << "\n";
+        std::filesystem::remove(temporary_path, error);
+    }
+}
+
+void PackageIndex::build(std::vector<ClassPathEntry> const &entries, std::string const &cache_path) {
+    m_packages.clear();
+
+    std::optional<std::vector<IndexedEntry>> indexed_entries;
+    if (!cache_path.empty()) {
+        indexed_entries = read_cache(cache_path, entries);
+    }
+    if (!indexed_entries) {
+        indexed_entries.emplace();
+        for (auto const &entry : entries) {
+            indexed_entries->push_back(index_entry(entry));
+        }
+        if (!cache_path.empty()) {
+            write_cache(cache_path, *indexed_entries);
+        }
+    }
+
+    m_directories.clear();
+    for (size_t i = 0; i < indexed_entries->size(); ++i) {
+        if (entries[i].zip == nullptr && entries[i].jimage == nullptr) {
+            m_directories.push_back(i);
+        }
+        for (auto &package : (*indexed_entries)[i].packages) {
+            m_packages[std::move(package)].push_back(i);
+        }
+    }
+
+    // Every package may be in every directory, they are merged in so the entries stay in class path order
+    if (!m_directories.empty()) {
+        for (auto &[package, indices] : m_packages) {
+            std::vector<size_t> merged;
+            merged.reserve(indices.size() + m_directories.size());
+            std::merge(indices.begin(), indices.end(), m_directories.begin(), m_directories.end(),
+                       std::back_inserter(merged));
+            indices = std::move(merged);
+        }
+    }
+}
+
+std::span<size_t const> PackageIndex::entries_for(std::string_view package) const {
+    if (auto found = m_packages.find(package); found != m_packages.end()) {
+        return found->second;
+    }
+    return m_directories;
+}
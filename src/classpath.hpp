@@ -0,0 +1,74 @@
+#ifndef SCHOKOVM_CLASSPATH_HPP
+#define SCHOKOVM_CLASSPATH_HPP
+
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "jimage.hpp"
+#include "util.hpp"
+#include "zip.hpp"
+
+struct ClassPathEntry {
+    // only one of these is set
+    std::string directory;
+    std::unique_ptr<ZipArchive> zip;
+    std::unique_ptr<JImage> jimage;
+
+    [[nodiscard]] std::string const &path() const;
+};
+
+// A class file and the index of the class path entry it was found in
+struct ClassFileBytes {
+    size_t entry_index;
+    std::span<u1 const> bytes;
+    // The class file was decompressed, otherwise the bytes were read from a directory or point into a mapping
+    bool decompressed = false;
+};
+
+// Modification time and size of a file or directory, to find out if something that was derived from it is stale.
+// The time is -1 if the file does not exist.
+struct FileStamp {
+    std::string path;
+    s8 modification_time;
+    u8 size;
+
+    static FileStamp of(std::string path);
+
+    bool operator==(FileStamp const &) const = default;
+};
+
+// Maps package names (with slashes, the unnamed package is "") to the jars and jimages that contain classes of that
+// package, so a class is only looked up in those entries and in the directories of the class path.
+struct PackageIndex {
+    // Reads the index from `cache_path` if the cache is still valid for `entries`, otherwise the index is built
+    // from the entries and the cache is (re)written. An empty `cache_path` disables the cache.
+    void build(std::vector<ClassPathEntry> const &entries, std::string const &cache_path);
+
+    // Indices into the class path entries, in class path order. Directories are always included.
+    [[nodiscard]] std::span<size_t const> entries_for(std::string_view package) const;
+
+private:
+    struct IndexedEntry {
+        std::string path;
+        std::vector<FileStamp> stamps;
+        std::vector<std::string> packages;
+    };
+
+    std::unordered_map<std::string, std::vector<size_t>, NameHash, std::equal_to<>> m_packages;
+    // Directories are not indexed, so classes that are added to them after startup are still found
+    std::vector<size_t> m_directories;
+
+    static IndexedEntry index_entry(ClassPathEntry const &entry);
+
+    static std::optional<std::vector<IndexedEntry>> read_cache(std::string const &cache_path,
+                                                               std::vector<ClassPathEntry> const &entries);
+
+    static void write_cache(std::string const &cache_path, std::vector<IndexedEntry> const &indexed_entries);
+};
+
+#endif //SCHOKOVM_CLASSPATH_HPP
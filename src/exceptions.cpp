@@ -5,6 +5,7 @@
 #include "classfile.hpp"
 #include "classloading.hpp"
 #include "exceptions.hpp"
+#include "parser.hpp"
 
 void throw_new(Thread &thread, Frame &frame, const char *name, const char *message) {
     thread.stack.push_frame(frame);
@@ -52,7 +53,7 @@ void throw_new(Thread &thread, ClassFile *clazz, const char *message) {
 
 void fill_in_stack_trace(Stack &stack, Reference throwable) {
     assert(throwable != JAVA_NULL);
-    assert(throwable.object()->clazz->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
+    assert(throwable.object()->clazz()->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
 
     ssize_t ignored = 2; // fillInStackTrace (native method) + Throwable.fillInStackTrace (non native method)
     for (auto i = static_cast<ssize_t>(stack.frames.size()) - 1 - ignored; i >= 0; --i) {
@@ -62,7 +63,7 @@ void fill_in_stack_trace(Stack &stack, Reference throwable) {
         }
         ++ignored; // ignore Throwable/Exception initializers
 
-        if (frame.method->clazz == throwable.object()->clazz) {
+        if (frame.method->clazz == throwable.object()->clazz()) {
             break;
         }
     }
@@ -85,22 +86,26 @@ void fill_in_stack_trace(Stack &stack, Reference throwable) {
         array.data<Frame>()[count - 1 - i] = frame;
     }
 
-    Reference &backtrace = throwable.data<Value>()[0].reference;
-    s4 &depth = throwable.data<Value>()[4].s4;
+    auto const &constants = BootstrapClassLoader::constants();
+    StoredReference &backtrace = *throwable.element_at_offset<StoredReference>(constants.java_lang_Throwable_backtrace);
+    s4 &depth = *throwable.element_at_offset<s4>(constants.java_lang_Throwable_depth);
 
     depth = static_cast<s4>(count);
     backtrace = array;
 }
 
 static Reference init_stack_trace_element(Frame const &frame, Reference element) {
-    Reference &declaringClassObject = element.data<Value>()[0].reference; // Class
-    Reference &classLoaderName = element.data<Value>()[1].reference; // Class
-    Reference &moduleName = element.data<Value>()[2].reference; // String
-    Reference &moduleVersion = element.data<Value>()[3].reference; // String
-    Reference &declaringClass = element.data<Value>()[4].reference; // String
-    Reference &methodName = element.data<Value>()[5].reference; // String
-    Reference &fileName = element.data<Value>()[6].reference; // String
-    s4 &lineNumber = element.data<Value>()[7].s4; // int
+    auto offset = [clazz = element.object()->clazz()](char const *name, char const *descriptor) {
+        return instance_field_offset(clazz, name, descriptor);
+    };
+    StoredReference &declaringClassObject = *element.element_at_offset<StoredReference>(offset("declaringClassObject", "Ljava/lang/Class;"));
+    StoredReference &classLoaderName = *element.element_at_offset<StoredReference>(offset("classLoaderName", "Ljava/lang/String;"));
+    StoredReference &moduleName = *element.element_at_offset<StoredReference>(offset("moduleName", "Ljava/lang/String;"));
+    StoredReference &moduleVersion = *element.element_at_offset<StoredReference>(offset("moduleVersion", "Ljava/lang/String;"));
+    StoredReference &declaringClass = *element.element_at_offset<StoredReference>(offset("declaringClass", "Ljava/lang/String;"));
+    StoredReference &methodName = *element.element_at_offset<StoredReference>(offset("methodName", "Ljava/lang/String;"));
+    StoredReference &fileName = *element.element_at_offset<StoredReference>(offset("fileName", "Ljava/lang/String;"));
+    s4 &lineNumber = *element.element_at_offset<s4>(offset("lineNumber", "I"));
 
     ClassFile *clazz = frame.method->clazz;
     declaringClassObject = Reference{clazz};
@@ -111,21 +116,20 @@ static Reference init_stack_trace_element(Frame const &frame, Reference element)
     declaringClass = Heap::get().make_string(clazz->name());
     methodName = Heap::get().make_string(frame.method->name_index->value);
 
-    auto source_file = std::find_if(clazz->attributes.begin(), clazz->attributes.end(),
-                                    [](const attribute_info &a) {
-                                        return std::holds_alternative<SourceFile_attribute>(a.variant);
-                                    });
-    if (source_file != std::end(clazz->attributes)) {
-        auto value = std::get<SourceFile_attribute>(source_file->variant).sourcefile_index->value;
-        fileName = Heap::get().make_string(value);
+    if (auto *source_file = find_attribute<SourceFile_attribute>(clazz, clazz->attributes, "SourceFile")) {
+        fileName = Heap::get().make_string(source_file->sourcefile_index->value);
     }
 
     lineNumber = -1;
     if (frame.method->is_native()) {
         lineNumber = -2;
     } else {
-        for (const auto &attribute : frame.method->code_attribute->attributes) {
-            auto table = std::get_if<LineNumberTable_attribute>(&attribute.variant);
+        // There can be multiple LineNumberTable attributes
+        for (auto &attribute : frame.method->code_attribute->attributes) {
+            if (attribute.attribute_name_index->value != "LineNumberTable") {
+                continue;
+            }
+            auto *table = std::get_if<LineNumberTable_attribute>(&decode_attribute(clazz, attribute).variant);
             if (table != nullptr) {
                 for (auto entry = table->line_number_table.rbegin();
                      entry != table->line_number_table.rend(); ++entry) {
@@ -147,16 +151,16 @@ static Reference init_stack_trace_element(Frame const &frame, Reference element)
 void init_stack_trace_element_array(Reference elements, Reference throwable) {
     assert(elements != JAVA_NULL);
     assert(throwable != JAVA_NULL);
-    assert(throwable.object()->clazz->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
+    assert(throwable.object()->clazz()->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
 
-    Value &backtrace = throwable.data<Value>()[0];
-//    Value &stackTrace = throwable.data<Value>()[3];
-    Value &depth = throwable.data<Value>()[4];
+    auto const &constants = BootstrapClassLoader::constants();
+    Reference backtrace = *throwable.element_at_offset<StoredReference>(constants.java_lang_Throwable_backtrace);
+    s4 depth = *throwable.element_at_offset<s4>(constants.java_lang_Throwable_depth);
 
-    auto count = static_cast<size_t>(depth.s4);
+    auto count = static_cast<size_t>(depth);
     for (size_t i = 0; i < count; ++i) {
-        auto const &frame = backtrace.reference.data<Frame>()[i];
-        auto element = elements.data<Reference>()[i];
+        auto const &frame = backtrace.data<Frame>()[i];
+        Reference element = elements.data<StoredReference>()[i];
         init_stack_trace_element(frame, element);
     }
 }
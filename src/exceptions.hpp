@@ -8,7 +8,7 @@ struct Thread;
 
 inline void throw_it(Thread &thread, Reference it) {
     assert(it != JAVA_NULL);
-    assert(it.object()->clazz->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
+    assert(it.object()->clazz()->is_subclass_of(BootstrapClassLoader::constants().java_lang_Throwable));
     assert(thread.current_exception == JAVA_NULL);
     thread.current_exception = it;
 }
@@ -5,6 +5,11 @@
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+#  include <array>
+#  include <atomic>
+#  include <functional>
+#endif
 
 #include "exceptions.hpp"
 #include "opcodes.hpp"
@@ -25,8 +30,38 @@ enum class ArrayPrimitiveTypes {
     T_LONG = 11,
 };
 
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+// How often each opcode was executed right after another one on the same thread, the most frequent pairs are printed
+// when the VM exits
+static struct OpcodePairProfile {
+    std::array<std::atomic<u8>, 256 * 256> counts{};
+
+    void count(u1 opcode) {
+        static thread_local u1 previous = static_cast<u1>(OpCodes::nop);
+        counts[previous * 256u + opcode].fetch_add(1, std::memory_order_relaxed);
+        previous = opcode;
+    }
+
+    ~OpcodePairProfile() {
+        std::vector<std::pair<u8, size_t>> pairs;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (auto count = counts[i].load(std::memory_order_relaxed); count != 0) {
+                pairs.emplace_back(count, i);
+            }
+        }
+        std::sort(pairs.begin(), pairs.end(), std::greater<>());
+        std::cerr << "count first second (opcodes)\n";
+        for (size_t i = 0; i < pairs.size() && i < 50; ++i) {
+            std::cerr << pairs[i].first << " " << (pairs[i].second >> 8) << " " << (pairs[i].second & 0xff) << "\n";
+        }
+    }
+} opcode_pair_profile;
+#endif
+
 static void execute_instruction(Thread &thread, Frame &frame, bool &should_exit);
 
+static void execute_int_instructions(Frame &frame);
+
 static void execute_comparison(Frame &frame, bool condition);
 
 static void goto_(Frame &frame);
@@ -43,6 +78,19 @@ void array_load(Thread &thread, Frame &frame);
 
 void fill_multi_array(Reference &reference, ClassFile *element_type, const std::span<s4> &counts);
 
+static inline Value load_field(Reference object, ResolvedConstant const &field);
+
+static inline void store_field(Reference object, ResolvedConstant const &field, Value value);
+
+[[nodiscard]] static Result resolve_loadable_constant(ConstantPool &constant_pool, u2 index);
+
+[[nodiscard]] static inline Result resolve_class_constant(ConstantPool &constant_pool, u2 index, ClassFile *&out);
+
+[[nodiscard]] static Result resolve_field_constant(Thread &thread, Frame &frame, u2 index, bool is_static,
+                                                   ResolvedConstant &out);
+
+static inline void cache_method(ResolvedConstant &entry, method_info *method);
+
 [[nodiscard]] static bool method_resolution(ClassInterface_Methodref &method);
 
 static void native_call(method_info *method, Thread &thread, Frame &frame, bool &should_exit);
@@ -58,7 +106,7 @@ Value interpret(Thread &thread, method_info *method) {
     [[maybe_unused]] auto memory_used = thread.stack.memory_used;
     Frame frame{thread.stack, method, thread.stack.memory_used, true};
 
-    if (!method->clazz->is_initialized) {
+    if (!load_acquire(method->clazz->is_initialized)) {
         if (resolve_class(method->clazz->this_class)) {
             assert(thread.current_exception != JAVA_NULL);
             return Value();
@@ -86,16 +134,15 @@ Value interpret(Thread &thread, method_info *method) {
 }
 
 static inline void execute_instruction(Thread &thread, Frame &frame, bool &should_exit) {
-    std::vector<u1> &code = *frame.code;
+    MetadataVector<u1> &code = *frame.code;
     auto opcode = code[frame.pc];
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+    opcode_pair_profile.count(opcode);
+#endif
     // TODO implement remaining opcodes. The ones that are currently commented/missing out have no test coverage whatsoever
     switch (static_cast<OpCodes>(opcode)) {
-        /* ======================= Constants ======================= */
-        case OpCodes::nop:
-            break;
-        case OpCodes::aconst_null:
-            frame.push<Reference>(JAVA_NULL);
-            break;
+        /* ======================= int ======================= */
+        // Constants, loads, stores, arithmetic and branches of ints, including the superinstructions of them
         case OpCodes::iconst_m1:
         case OpCodes::iconst_0:
         case OpCodes::iconst_1:
@@ -103,7 +150,63 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         case OpCodes::iconst_3:
         case OpCodes::iconst_4:
         case OpCodes::iconst_5:
-            frame.push<s4>(opcode - static_cast<u1>(OpCodes::iconst_0));
+        case OpCodes::bipush:
+        case OpCodes::sipush:
+        case OpCodes::iload:
+        case OpCodes::iload_0:
+        case OpCodes::iload_1:
+        case OpCodes::iload_2:
+        case OpCodes::iload_3:
+        case OpCodes::istore:
+        case OpCodes::istore_0:
+        case OpCodes::istore_1:
+        case OpCodes::istore_2:
+        case OpCodes::istore_3:
+        case OpCodes::iadd:
+        case OpCodes::isub:
+        case OpCodes::imul:
+        case OpCodes::ineg:
+        case OpCodes::ishl:
+        case OpCodes::ishr:
+        case OpCodes::iushr:
+        case OpCodes::iand:
+        case OpCodes::ior:
+        case OpCodes::ixor:
+        case OpCodes::iinc:
+        case OpCodes::i2b:
+        case OpCodes::i2c:
+        case OpCodes::i2s:
+        case OpCodes::ifeq:
+        case OpCodes::ifne:
+        case OpCodes::iflt:
+        case OpCodes::ifge:
+        case OpCodes::ifgt:
+        case OpCodes::ifle:
+        case OpCodes::if_icmpeq:
+        case OpCodes::if_icmpne:
+        case OpCodes::if_icmplt:
+        case OpCodes::if_icmpge:
+        case OpCodes::if_icmpgt:
+        case OpCodes::if_icmple:
+        case OpCodes::goto_:
+        case OpCodes::iinc_goto:
+        case OpCodes::iload_iload_iadd:
+        case OpCodes::iload_0_iload_iadd:
+        case OpCodes::iload_1_iload_iadd:
+        case OpCodes::iload_2_iload_iadd:
+        case OpCodes::iload_3_iload_iadd:
+        case OpCodes::iload_iconst_if_icmp:
+        case OpCodes::iload_0_iconst_if_icmp:
+        case OpCodes::iload_1_iconst_if_icmp:
+        case OpCodes::iload_2_iconst_if_icmp:
+        case OpCodes::iload_3_iconst_if_icmp:
+            return execute_int_instructions(frame);
+
+            /* ======================= Constants ======================= */
+        case OpCodes::nop:
+            break;
+        case OpCodes::aconst_null:
+            frame.push<Reference>(JAVA_NULL);
             break;
 
         case OpCodes::lconst_0:
@@ -119,72 +222,33 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         case OpCodes::dconst_1:
             frame.push<double>(static_cast<double>(opcode - static_cast<u1>(OpCodes::dconst_0)));
             break;
-        case OpCodes::bipush: {
-            frame.push<s4>(static_cast<s4>(static_cast<s2>(future::bit_cast<s1>(frame.consume_u1()))));
-            break;
-        }
-        case OpCodes::sipush: {
-            u2 value = frame.consume_u2();
-            frame.push<s4>(future::bit_cast<s2>(value));
-            break;
-        }
-        case OpCodes::ldc: {
-            auto index = frame.consume_u1();
-            auto &entry = frame.constant_pool->table[index];
-            if (auto i = std::get_if<CONSTANT_Integer_info>(&entry.variant)) {
-                frame.push<s4>(i->value);
-            } else if (auto f = std::get_if<CONSTANT_Float_info>(&entry.variant)) {
-                frame.push<float>(f->value);
-            } else if (auto c = std::get_if<CONSTANT_Class_info>(&entry.variant)) {
-                if (resolve_class(c)) {
-                    return;
-                }
-                frame.push<Reference>(Reference{c->clazz});
-            } else if (auto s = std::get_if<CONSTANT_String_info>(&entry.variant)) {
-                frame.push<Reference>(Heap::get().load_string(s->string));
-            } else {
-                // TODO: "a symbolic reference to a method type, a method handle, or a dynamically-computed constant." (?)
-                throw std::runtime_error("ldc refers to invalid/unimplemented type");
-            }
-            break;
-        }
-        case OpCodes::ldc_w: {
-            size_t index = frame.consume_u2();
-            auto &entry = frame.constant_pool->table[index];
-            // TODO common function to turn constan pool reference into value
-            if (auto i = std::get_if<CONSTANT_Integer_info>(&entry.variant)) {
-                frame.push<s4>(i->value);
-            } else if (auto f = std::get_if<CONSTANT_Float_info>(&entry.variant)) {
-                frame.push<float>(f->value);
-            } else if (auto c = std::get_if<CONSTANT_Class_info>(&entry.variant)) {
-                if (resolve_class(c)) {
+        case OpCodes::ldc:
+        case OpCodes::ldc_w:
+        case OpCodes::ldc2_w: {
+            bool is_wide = opcode != static_cast<u1>(OpCodes::ldc);
+            u2 index = is_wide ? frame.read_u2() : frame.read_u1();
+            auto &entry = frame.constant_pool->resolved[index];
+
+            auto kind = load_acquire(entry.kind);
+            if (kind == ResolvedConstant::Unresolved) {
+                if (resolve_loadable_constant(*frame.constant_pool, index)) {
                     return;
                 }
-                frame.push<Reference>(Reference{c->clazz});
-            } else if (auto s = std::get_if<CONSTANT_String_info>(&entry.variant)) {
-                frame.push<Reference>(Heap::get().load_string(s->string));
-            } else {
-                throw std::runtime_error("ldc_w refers to invalid/unimplemented type");
+                kind = entry.kind;
             }
-            break;
-        }
-        case OpCodes::ldc2_w: {
-            size_t index = frame.consume_u2();
-            auto &entry = frame.constant_pool->table[index];
-            if (auto l = std::get_if<CONSTANT_Long_info>(&entry.variant)) {
-                frame.push<s8>(l->value);
-            } else if (auto d = std::get_if<CONSTANT_Double_info>(&entry.variant)) {
-                frame.push<double>(d->value);
+            frame.pc += is_wide ? 2 : 1;
+
+            if (kind == ResolvedConstant::Class) {
+                frame.push<Reference>(Reference{entry.clazz});
+            } else if (opcode == static_cast<u1>(OpCodes::ldc2_w)) {
+                frame.push2(entry.value);
             } else {
-                throw std::runtime_error("ldc2_w refers to invalid/unimplemented type");
+                frame.push(entry.value);
             }
             break;
         }
 
             /* ======================= Loads ======================= */
-        case OpCodes::iload:
-            frame.push<s4>(frame.locals[frame.consume_u1()].s4);
-            break;
         case OpCodes::lload:
             frame.push<s8>(frame.locals[frame.consume_u1()].s8);
             break;
@@ -198,12 +262,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             frame.push<Reference>(frame.locals[frame.consume_u1()].reference);
             break;
 
-        case OpCodes::iload_0:
-        case OpCodes::iload_1:
-        case OpCodes::iload_2:
-        case OpCodes::iload_3:
-            frame.push<s4>(frame.locals[opcode - static_cast<u1>(OpCodes::iload_0)].s4);
-            break;
         case OpCodes::lload_0:
         case OpCodes::lload_1:
         case OpCodes::lload_2:
@@ -241,7 +299,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             array_load<double>(thread, frame);
             break;
         case OpCodes::aaload:
-            array_load<Reference>(thread, frame);
+            array_load<StoredReference>(thread, frame);
             break;
         case OpCodes::baload:
             array_load<s1>(thread, frame);
@@ -254,9 +312,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             break;
 
             /* ======================= Stores ======================= */
-        case OpCodes::istore:
-            frame.locals[frame.consume_u1()] = Value(frame.pop<s4>());
-            break;
         case OpCodes::lstore:
             frame.locals[frame.consume_u1()] = Value(frame.pop<s8>());
             break;
@@ -269,12 +324,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         case OpCodes::astore:
             frame.locals[frame.consume_u1()] = Value(frame.pop<Reference>());
             break;
-        case OpCodes::istore_0:
-        case OpCodes::istore_1:
-        case OpCodes::istore_2:
-        case OpCodes::istore_3:
-            frame.locals[opcode - static_cast<u1>(OpCodes::istore_0)] = Value(frame.pop<s4>());
-            break;
         case OpCodes::lstore_0:
         case OpCodes::lstore_1:
         case OpCodes::lstore_2:
@@ -312,7 +361,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             array_store<double>(thread, frame);
             break;
         case OpCodes::aastore:
-            array_store<Reference>(thread, frame);
+            array_store<StoredReference>(thread, frame);
             break;
         case OpCodes::bastore:
             array_store<s1>(thread, frame);
@@ -397,13 +446,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
 
             /* ======================= Math =======================*/
-        case OpCodes::iadd: {
-            auto b = frame.pop<s4>();
-            auto a = frame.pop<s4>();
-            auto result = add_overflow(a, b);
-            frame.push<s4>(result);
-            break;
-        }
         case OpCodes::ladd: {
             auto b = frame.pop<s8>();
             auto a = frame.pop<s8>();
@@ -423,13 +465,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             frame.push<double>(a + b);
             break;
         }
-        case OpCodes::isub: {
-            auto b = frame.pop<s4>();
-            auto a = frame.pop<s4>();
-            auto result = sub_overflow(a, b);
-            frame.push<s4>(result);
-            break;
-        }
         case OpCodes::lsub: {
             s8 b = frame.pop<s8>();
             s8 a = frame.pop<s8>();
@@ -448,12 +483,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             frame.push<double>(a - b);
             break;
         }
-        case OpCodes::imul: {
-            auto a = frame.pop<s4>();
-            auto b = frame.pop<s4>();
-            frame.push<s4>(mul_overflow(a, b));
-            break;
-        }
         case OpCodes::lmul: {
             auto a = frame.pop<s8>();
             auto b = frame.pop<s8>();
@@ -537,11 +566,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             frame.push<double>(result);
             break;
         }
-        case OpCodes::ineg: {
-            auto a = frame.pop<s4>();
-            frame.push<s4>(sub_overflow(static_cast<s4>(0), a));
-            break;
-        }
         case OpCodes::lneg: {
             auto a = frame.pop<s8>();
             frame.push<s8>(sub_overflow(static_cast<s8>(0), a));
@@ -557,39 +581,18 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             frame.push<double>(-a);
             break;
         }
-        case OpCodes::ishl: {
-            auto shift = frame.pop<s4>() & 0x1F;
-            auto value = frame.pop<s4>();
-            frame.push<s4>(value << shift);
-            break;
-        }
         case OpCodes::lshl: {
             auto shift = frame.pop<s4>() & 0x3F;
             auto value = frame.pop<s8>();
             frame.push<s8>(value << shift);
             break;
         }
-        case OpCodes::ishr: {
-            auto shift = frame.pop<s4>() & 0x1F;
-            auto value = frame.pop<s4>();
-            frame.push<s4>(value >> shift);
-            break;
-        }
         case OpCodes::lshr: {
             auto shift = frame.pop<s4>() & 0x3F;
             auto value = frame.pop<s8>();
             frame.push<s8>(value >> shift);
             break;
         }
-        case OpCodes::iushr: {
-            auto shift = frame.pop<s4>() & 0x1F;
-            auto value = frame.pop<s4>();
-            // C++20 always performs arithmetic shifts, so the top bits need to be cleared out afterwards
-            frame.push<s4>((value >> shift) &
-                           (future::bit_cast<s4>(std::numeric_limits<u4>::max() >> static_cast<u4>(shift)))
-            );
-            break;
-        }
         case OpCodes::lushr: {
             auto shift = frame.pop<s4>() & 0x3F;
             auto value = frame.pop<s8>();
@@ -599,31 +602,15 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             );
             break;
         }
-        case OpCodes::iand:
-            frame.push<s4>(frame.pop<s4>() & frame.pop<s4>());
-            break;
         case OpCodes::land:
             frame.push<s8>(frame.pop<s8>() & frame.pop<s8>());
             break;
-        case OpCodes::ior:
-            frame.push<s4>(frame.pop<s4>() | frame.pop<s4>());
-            break;
         case OpCodes::lor:
             frame.push<s8>(frame.pop<s8>() | frame.pop<s8>());
             break;
-        case OpCodes::ixor:
-            frame.push<s4>(frame.pop<s4>() ^ frame.pop<s4>());
-            break;
         case OpCodes::lxor:
             frame.push<s8>(frame.pop<s8>() ^ frame.pop<s8>());
             break;
-        case OpCodes::iinc: {
-            auto local = frame.consume_u1();
-            auto value = static_cast<s4>(static_cast<s2>(future::bit_cast<s1>(frame.consume_u1())));
-            auto result = add_overflow(frame.locals[local].s4, value);
-            frame.locals[local] = Value(result);
-            break;
-        }
 
             /* ======================= Conversions ======================= */
         case OpCodes::i2l:
@@ -663,15 +650,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         case OpCodes::d2f:
             frame.push<float>(static_cast<float>(frame.pop<double>()));
             break;
-        case OpCodes::i2b:
-            frame.push<s4>(static_cast<s4>(static_cast<s1>(frame.pop<s4>())));
-            break;
-        case OpCodes::i2c:
-            frame.push<s4>(static_cast<s4>(static_cast<u2>(frame.pop<s4>())));
-            break;
-        case OpCodes::i2s:
-            frame.push<s4>(static_cast<s4>(static_cast<s2>(frame.pop<s4>())));
-            break;
 
             /* ======================= Comparisons ======================= */
         case OpCodes::lcmp: {
@@ -720,42 +698,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             }
             break;
         }
-        case OpCodes::ifeq:
-            execute_comparison(frame, frame.pop<s4>() == 0);
-            return;
-        case OpCodes::ifne:
-            execute_comparison(frame, frame.pop<s4>() != 0);
-            return;
-        case OpCodes::iflt:
-            execute_comparison(frame, frame.pop<s4>() < 0);
-            return;
-        case OpCodes::ifge:
-            execute_comparison(frame, frame.pop<s4>() >= 0);
-            return;
-        case OpCodes::ifgt:
-            execute_comparison(frame, frame.pop<s4>() > 0);
-            return;
-        case OpCodes::ifle:
-            execute_comparison(frame, frame.pop<s4>() <= 0);
-            return;
-        case OpCodes::if_icmpeq:
-            execute_comparison(frame, frame.pop<s4>() == frame.pop<s4>());
-            return;
-        case OpCodes::if_icmpne:
-            execute_comparison(frame, frame.pop<s4>() != frame.pop<s4>());
-            return;
-        case OpCodes::if_icmplt:
-            execute_comparison(frame, frame.pop<s4>() > frame.pop<s4>());
-            return;
-        case OpCodes::if_icmpge:
-            execute_comparison(frame, frame.pop<s4>() <= frame.pop<s4>());
-            return;
-        case OpCodes::if_icmpgt:
-            execute_comparison(frame, frame.pop<s4>() < frame.pop<s4>());
-            return;
-        case OpCodes::if_icmple:
-            execute_comparison(frame, frame.pop<s4>() >= frame.pop<s4>());
-            return;
         case OpCodes::if_acmpeq:
             execute_comparison(frame, frame.pop<Reference>() == frame.pop<Reference>());
             return;
@@ -764,9 +706,6 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             return;
 
             /* ======================= Control =======================*/
-        case OpCodes::goto_:
-            goto_(frame);
-            return;
         case OpCodes::jsr:
         case OpCodes::ret:
             throw std::runtime_error("jsr and ret are unsupported");
@@ -849,38 +788,34 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
 
 
             /* ======================= References ======================= */
+        case OpCodes::aload_0_getfield:
+            frame.push<Reference>(frame.locals[0].reference);
+            frame.pc += 1;
+            opcode = static_cast<u1>(OpCodes::getfield);
+            [[fallthrough]];
         case OpCodes::getstatic:
         case OpCodes::putstatic:
         case OpCodes::getfield:
         case OpCodes::putfield: {
             u2 index = frame.read_u2();
-            auto field = frame.constant_pool->get<CONSTANT_Fieldref_info>(index);
-
-            if (!field.resolved) {
-                if (resolve_class(field.class_)) {
-                    return;
-                }
-
-                if (resolve_field(field.class_->clazz, &field, thread.current_exception)) {
-                    return;
-                }
-                if (thread.current_exception != JAVA_NULL)
-                    throw std::runtime_error(
-                            "field not found: " + field.class_->name->value + "." + field.name_and_type->name->value +
-                            " " + field.name_and_type->descriptor->value);
-                assert(field.resolved);
+            bool is_static = opcode == static_cast<u1>(OpCodes::getstatic) ||
+                             opcode == static_cast<u1>(OpCodes::putstatic);
+            auto &entry = frame.constant_pool->resolved[index];
+
+            ResolvedConstant field;
+            if (load_acquire(entry.kind) == (is_static ? ResolvedConstant::StaticField
+                                                       : ResolvedConstant::InstanceField)) {
+                field = entry;
+            } else if (resolve_field_constant(thread, frame, index, is_static, field)) {
+                return;
             }
             frame.pc += 2;
+            bool is_category2 = field.type == 'J' || field.type == 'D';
 
             switch (static_cast<OpCodes>(opcode)) {
                 case OpCodes::getstatic: {
-                    if (!field.is_static)
-                        throw std::runtime_error("field is not static");
-                    if (initialize_class(field.value_clazz, thread, frame)) {
-                        return;
-                    }
-                    auto value = field.value_clazz->static_field_values[field.index];
-                    if (field.category == ValueCategory::C1) {
+                    auto value = *field.static_value;
+                    if (!is_category2) {
                         frame.push(value);
                     } else {
                         frame.push2(value);
@@ -888,31 +823,24 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
                     break;
                 }
                 case OpCodes::putstatic: {
-                    if (!field.is_static)
-                        throw std::runtime_error("field is not static");
-                    if (initialize_class(field.value_clazz, thread, frame)) {
-                        return;
-                    }
                     Value value;
-                    if (field.category == ValueCategory::C1) {
+                    if (!is_category2) {
                         value = frame.pop();
-                        if (field.is_boolean)
+                        if (field.type == 'Z')
                             value.s4 = value.s4 & 1;
                     } else {
                         value = frame.pop2();
                     }
-                    field.value_clazz->static_field_values[field.index] = value;
+                    *field.static_value = value;
                     break;
                 }
                 case OpCodes::getfield: {
-                    if (field.is_static)
-                        throw std::runtime_error("field is static");
                     auto objectref = frame.pop<Reference>();
                     if (objectref == JAVA_NULL) {
                         return throw_new(thread, frame, Names::java_lang_NullPointerException);
                     }
-                    auto value = objectref.data<Value>()[field.index];
-                    if (field.category == ValueCategory::C1) {
+                    auto value = load_field(objectref, field);
+                    if (!is_category2) {
                         frame.push(value);
                     } else {
                         frame.push2(value);
@@ -920,12 +848,10 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
                     break;
                 }
                 case OpCodes::putfield: {
-                    if (field.is_static)
-                        throw std::runtime_error("field is static");
                     Value value;
-                    if (field.category == ValueCategory::C1) {
+                    if (!is_category2) {
                         value = frame.pop();
-                        if (field.is_boolean)
+                        if (field.type == 'Z')
                             value.s4 = value.s4 & 1;
                     } else {
                         value = frame.pop2();
@@ -934,7 +860,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
                     if (objectref == JAVA_NULL) {
                         return throw_new(thread, frame, Names::java_lang_NullPointerException);
                     }
-                    objectref.data<Value>()[field.index] = value;
+                    store_field(objectref, field, value);
                     break;
                 }
                 default:
@@ -945,19 +871,24 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
         case OpCodes::invokevirtual: {
             u2 method_index = frame.read_u2();
-            auto &declared_method_ref = frame.constant_pool->get<CONSTANT_Methodref_info>(method_index).method;
-
-            method_info *declared_method = declared_method_ref.method;
+            auto &entry = frame.constant_pool->resolved[method_index];
 
-            if (declared_method == nullptr) {
-                if (resolve_class(declared_method_ref.class_)) {
-                    return;
-                }
+            method_info *declared_method;
+            if (load_acquire(entry.kind) == ResolvedConstant::Method) {
+                declared_method = entry.method;
+            } else {
+                auto &declared_method_ref = frame.constant_pool->get<CONSTANT_Methodref_info>(method_index).method;
+                if (declared_method_ref.method == nullptr) {
+                    if (resolve_class(declared_method_ref.class_)) {
+                        return;
+                    }
 
-                if (method_resolution(declared_method_ref)) {
-                    return;
+                    if (method_resolution(declared_method_ref)) {
+                        return;
+                    }
                 }
                 declared_method = declared_method_ref.method;
+                cache_method(entry, declared_method);
             }
 
             auto object = frame.peek_at(declared_method->stack_slots_for_parameters - 1).reference;
@@ -966,7 +897,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             }
 
             method_info *method;
-            if (method_selection(object.object()->clazz, declared_method, method)) {
+            if (method_selection(object.object()->clazz(), declared_method, method)) {
                 return;
             }
 
@@ -978,26 +909,48 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             }
             return;
         }
+        case OpCodes::new_dup_invokespecial: {
+            ClassFile *clazz;
+            if (resolve_class_constant(*frame.constant_pool, frame.read_u2(), clazz)) {
+                return;
+            }
+            if (initialize_class(clazz, thread, frame)) {
+                return;
+            }
+
+            auto reference = Heap::get().new_instance(clazz);
+            frame.push<Reference>(reference);
+            frame.push<Reference>(reference);
+            frame.pc += 4;
+            [[fallthrough]];
+        }
         case OpCodes::invokespecial: {
             u2 method_index = frame.read_u2();
-            auto &ref = frame.constant_pool->table[method_index].variant;
-            ClassInterface_Methodref *method_ref;
-            if (auto m = std::get_if<CONSTANT_Methodref_info>(&ref)) {
-                method_ref = &m->method;
-            } else {
-                method_ref = &std::get_if<CONSTANT_InterfaceMethodref_info>(&ref)->method;
-            }
+            auto &entry = frame.constant_pool->resolved[method_index];
 
-            method_info *method = method_ref->method;
-            if (method == nullptr) {
-                if (resolve_class(method_ref->class_)) {
-                    return;
+            method_info *method;
+            if (load_acquire(entry.kind) == ResolvedConstant::Method) {
+                method = entry.method;
+            } else {
+                auto &ref = frame.constant_pool->table[method_index].variant;
+                ClassInterface_Methodref *method_ref;
+                if (auto m = std::get_if<CONSTANT_Methodref_info>(&ref)) {
+                    method_ref = &m->method;
+                } else {
+                    method_ref = &std::get_if<CONSTANT_InterfaceMethodref_info>(&ref)->method;
                 }
 
-                if (method_resolution(*method_ref)) {
-                    return;
+                if (method_ref->method == nullptr) {
+                    if (resolve_class(method_ref->class_)) {
+                        return;
+                    }
+
+                    if (method_resolution(*method_ref)) {
+                        return;
+                    }
                 }
                 method = method_ref->method;
+                cache_method(entry, method);
             }
 
             frame.invoke_length = 3;
@@ -1010,45 +963,53 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
         case OpCodes::invokestatic: {
             u2 method_index = frame.read_u2();
-            auto &ref = frame.constant_pool->table[method_index].variant;
-            ClassInterface_Methodref *method_ref;
-            if (auto m = std::get_if<CONSTANT_Methodref_info>(&ref)) {
-                method_ref = &m->method;
-            } else {
-                method_ref = &std::get_if<CONSTANT_InterfaceMethodref_info>(&ref)->method;
-            }
-
-            // TODO this is hardcoded for now
-            if (method_ref->class_->name->value == "java/lang/System" &&
-                method_ref->name_and_type->name->value == "exit" &&
-                method_ref->name_and_type->descriptor->value == "(I)V") {
-                exit(EXIT_FAILURE);
-                return;
-            } else if (method_ref->class_->name->value == "java/lang/System" &&
-                       method_ref->name_and_type->name->value == "loadLibrary" &&
-                       method_ref->name_and_type->descriptor->value == "(Ljava/lang/String;)V") {
-                // Ignore for now
-                frame.pc += 2;
-                break;
-            }
+            auto &entry = frame.constant_pool->resolved[method_index];
 
-            method_info *method = method_ref->method;
-            ClassFile *clazz = method_ref->class_->clazz;
-
-            if (method == nullptr) {
-                if (resolve_class(method_ref->class_)) {
-                    return;
+            method_info *method;
+            if (load_acquire(entry.kind) == ResolvedConstant::Method) {
+                method = entry.method;
+            } else {
+                auto &ref = frame.constant_pool->table[method_index].variant;
+                ClassInterface_Methodref *method_ref;
+                if (auto m = std::get_if<CONSTANT_Methodref_info>(&ref)) {
+                    method_ref = &m->method;
+                } else {
+                    method_ref = &std::get_if<CONSTANT_InterfaceMethodref_info>(&ref)->method;
                 }
 
-                clazz = method_ref->class_->clazz;
-                if (initialize_class(clazz, thread, frame)) {
+                // TODO this is hardcoded for now. These are never cached, so the comparisons only run for unresolved
+                //  entries.
+                if (method_ref->class_->name->value == "java/lang/System" &&
+                    method_ref->name_and_type->name->value == "exit" &&
+                    method_ref->name_and_type->descriptor->value == "(I)V") {
+                    exit(EXIT_FAILURE);
                     return;
+                } else if (method_ref->class_->name->value == "java/lang/System" &&
+                           method_ref->name_and_type->name->value == "loadLibrary" &&
+                           method_ref->name_and_type->descriptor->value == "(Ljava/lang/String;)V") {
+                    // Ignore for now
+                    frame.pc += 2;
+                    break;
                 }
 
-                if (method_resolution(*method_ref)) {
-                    return;
+                if (method_ref->method == nullptr) {
+                    if (resolve_class(method_ref->class_)) {
+                        return;
+                    }
+
+                    if (initialize_class(method_ref->class_->clazz, thread, frame)) {
+                        return;
+                    }
+
+                    if (method_resolution(*method_ref)) {
+                        return;
+                    }
                 }
                 method = method_ref->method;
+                // While the class is being initialized, other threads still have to wait for it in initialize_class
+                if (load_acquire(method_ref->class_->clazz->is_initialized)) {
+                    cache_method(entry, method);
+                }
             }
 
             frame.invoke_length = 3;
@@ -1061,27 +1022,32 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
         case OpCodes::invokeinterface: {
             u2 method_index = frame.read_u2();
-            auto &declared_method_ref = frame.constant_pool->get<CONSTANT_InterfaceMethodref_info>(
-                    method_index).method;
+            auto &entry = frame.constant_pool->resolved[method_index];
 
-            method_info *declared_method = declared_method_ref.method;
-
-            if (declared_method == nullptr) {
-                if (resolve_class(declared_method_ref.class_)) {
-                    return;
-                }
+            method_info *declared_method;
+            if (load_acquire(entry.kind) == ResolvedConstant::Method) {
+                declared_method = entry.method;
+            } else {
+                auto &declared_method_ref = frame.constant_pool->get<CONSTANT_InterfaceMethodref_info>(
+                        method_index).method;
+                if (declared_method_ref.method == nullptr) {
+                    if (resolve_class(declared_method_ref.class_)) {
+                        return;
+                    }
 
-                // TODO we will need some special handling for methods on Object here
-                if (method_resolution(declared_method_ref)) {
-                    return;
+                    // TODO we will need some special handling for methods on Object here
+                    if (method_resolution(declared_method_ref)) {
+                        return;
+                    }
                 }
                 declared_method = declared_method_ref.method;
+                cache_method(entry, declared_method);
             }
 
             auto object = frame.peek_at(declared_method->stack_slots_for_parameters - 1).reference;
 
             method_info *method;
-            if (method_selection(object.object()->clazz, declared_method, method)) {
+            if (method_selection(object.object()->clazz(), declared_method, method)) {
                 return;
             }
 
@@ -1096,14 +1062,12 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
         case OpCodes::new_: {
             u2 index = frame.read_u2();
-            auto &class_info = frame.constant_pool->get<CONSTANT_Class_info>(index);
-
-            if (resolve_class(&class_info)) {
+            ClassFile *clazz;
+            if (resolve_class_constant(*frame.constant_pool, index, clazz)) {
                 return;
             }
 
             frame.pc += 2;
-            auto clazz = class_info.clazz;
             if (initialize_class(clazz, thread, frame)) {
                 return;
             }
@@ -1111,7 +1075,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             auto reference = Heap::get().new_instance(clazz);
             frame.push<Reference>(reference);
 
-            // TODO: the next two instructions are probably dup+invokespecial. We could optimize for that pattern.
+            // new; dup; invokespecial is usually rewritten to new_dup_invokespecial
             break;
         }
         case OpCodes::newarray: {
@@ -1175,8 +1139,8 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         }
         case OpCodes::anewarray: {
             u2 index = frame.read_u2();
-            auto &class_info = frame.constant_pool->get<CONSTANT_Class_info>(index);
-            if (resolve_class(&class_info)) {
+            ClassFile *element;
+            if (resolve_class_constant(*frame.constant_pool, index, element)) {
                 return;
             }
             frame.pc += 2;
@@ -1186,10 +1150,9 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
                 throw std::runtime_error("TODO NegativeArraySizeException");
             }
 
-            ClassFile *element = class_info.clazz;
             ClassFile *array_class = BootstrapClassLoader::get().load(element->as_array_element());
 
-            auto reference = Heap::get().new_array<Reference>(array_class, count);
+            auto reference = Heap::get().new_array<StoredReference>(array_class, count);
             frame.push<Reference>(reference);
             break;
         }
@@ -1198,7 +1161,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
             if (arrayref == JAVA_NULL) {
                 return throw_new(thread, frame, Names::java_lang_NullPointerException);
             }
-            frame.push<s4>(arrayref.object()->length);
+            frame.push<s4>(arrayref.array()->length);
             break;
         }
 
@@ -1212,17 +1175,17 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
 
         case OpCodes::checkcast: {
             u2 index = frame.read_u2();
-            auto &class_info = frame.constant_pool->get<CONSTANT_Class_info>(index);
 
             auto objectref = frame.pop<Reference>();
             frame.push<Reference>(objectref);
 
             if (objectref != JAVA_NULL) {
-                if (resolve_class(&class_info)) {
+                ClassFile *clazz;
+                if (resolve_class_constant(*frame.constant_pool, index, clazz)) {
                     return;
                 }
 
-                if (!objectref.object()->clazz->is_instance_of(class_info.clazz)) {
+                if (!objectref.object()->clazz()->is_instance_of(clazz)) {
                     return throw_new(thread, frame, Names::java_lang_ClassCastException);
                 }
             }
@@ -1232,19 +1195,19 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
 
         case OpCodes::instanceof: {
             u2 index = frame.read_u2();
-            auto &class_info = frame.constant_pool->get<CONSTANT_Class_info>(index);
 
             auto objectref = frame.pop<Reference>();
             if (objectref == JAVA_NULL) {
                 frame.push<s4>(0);
             } else {
                 frame.push<Reference>(objectref);
-                if (resolve_class(&class_info)) {
+                ClassFile *clazz;
+                if (resolve_class_constant(*frame.constant_pool, index, clazz)) {
                     return;
                 }
                 frame.pop<Reference>();
 
-                frame.push<bool>(objectref.object()->clazz->is_instance_of(class_info.clazz));
+                frame.push<bool>(objectref.object()->clazz()->is_instance_of(clazz));
             }
             frame.pc += 2;
             break;
@@ -1333,7 +1296,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
                 }
             }
 
-            auto reference = Heap::get().new_array<Reference>(class_info.clazz, counts.back());
+            auto reference = Heap::get().new_array<StoredReference>(class_info.clazz, counts.back());
             fill_multi_array(reference, class_info.clazz->array_element_type,
                              std::span(counts).subspan(0, counts.size() - 1));
             frame.push<Reference>(reference);
@@ -1355,6 +1318,7 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
         case OpCodes::jsr_w:
             throw std::runtime_error("jsr and ret are unsupported");
 
+
         default:
             throw std::runtime_error(
                     "Unimplemented/unknown opcode " + std::to_string(opcode) + " at " + std::to_string(frame.pc)
@@ -1364,6 +1328,387 @@ static inline void execute_instruction(Thread &thread, Frame &frame, bool &shoul
     frame.pc++;
 }
 
+// Executes instructions on ints from frame.pc on, until an instruction that does something else. These instructions
+// can't throw and only use the operand stack, the local variables and the pc of the frame, so those stay in local
+// variables until the end. The top operand is cached in `top` if it is an int that was computed here, the
+// instructions have one handler for each state:
+// - empty: all operands are in memory
+// - cached: the top operand is in `top`, the others are in memory
+// So an instruction that pushes in the empty state or pops the operand that was pushed last doesn't access the memory
+// of the operand stack.
+static void execute_int_instructions(Frame &frame) {
+    u1 const *code = frame.code->data();
+    Value *locals = frame.locals.data();
+    // After the operands in memory
+    Value *sp = frame.operands.data() + frame.operands_top;
+    size_t pc = frame.pc;
+    s4 top;
+
+    auto s1_operand = [code, &pc]() {
+        return static_cast<s4>(future::bit_cast<s1>(code[pc + 1]));
+    };
+    auto s2_operand = [code, &pc]() {
+        return static_cast<s4>(future::bit_cast<s2>(static_cast<u2>((code[pc + 1] << 8) | code[pc + 2])));
+    };
+    // The instruction at pc is a branch
+    auto branch = [&pc, &s2_operand](bool condition) {
+        pc = condition ? static_cast<size_t>(static_cast<ssize_t>(pc) + s2_operand()) : pc + 3;
+    };
+    auto iinc = [code, locals, &pc]() {
+        auto &local = locals[code[pc + 1]];
+        local = Value(add_overflow(local.s4, static_cast<s4>(future::bit_cast<s1>(code[pc + 2]))));
+    };
+    // The unmodified iload or iload_<n> at pc
+    auto int_load = [code, locals, &pc]() {
+        if (code[pc] == static_cast<u1>(OpCodes::iload)) {
+            pc += 2;
+            return locals[code[pc - 1]].s4;
+        }
+        pc += 1;
+        return locals[code[pc - 1] - static_cast<u1>(OpCodes::iload_0)].s4;
+    };
+    // The load that was replaced by `opcode`, one of the variants of `superinstruction`
+    auto first_int_load = [code, locals, &pc](u1 opcode, OpCodes superinstruction) {
+        auto variant = opcode - static_cast<u1>(superinstruction);
+        if (variant == 0) {
+            pc += 2;
+            return locals[code[pc - 1]].s4;
+        }
+        pc += 1;
+        return locals[variant - 1].s4;
+    };
+    auto iload_iconst_if_icmp = [&](u1 opcode) {
+        s4 a = first_int_load(opcode, OpCodes::iload_iconst_if_icmp);
+        s4 b;
+        if (code[pc] == static_cast<u1>(OpCodes::bipush)) {
+            b = s1_operand();
+            pc += 2;
+        } else {
+            b = code[pc] - static_cast<u1>(OpCodes::iconst_0);
+            pc += 1;
+        }
+        switch (static_cast<OpCodes>(code[pc])) {
+            case OpCodes::if_icmpeq:
+                return branch(a == b);
+            case OpCodes::if_icmpne:
+                return branch(a != b);
+            case OpCodes::if_icmplt:
+                return branch(a < b);
+            case OpCodes::if_icmpge:
+                return branch(a >= b);
+            case OpCodes::if_icmpgt:
+                return branch(a > b);
+            case OpCodes::if_icmple:
+                return branch(a <= b);
+            default:
+                assert(false);
+        }
+    };
+
+    // execute_instruction already dispatched on the first instruction
+    u1 opcode = code[pc];
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+    // An instruction is counted once it was executed here, so the one that ends the loop is only counted by
+    // execute_instruction. The first one was counted by it as well.
+    bool count_previous = false;
+#endif
+    goto dispatch_empty;
+
+empty:
+    for (;;) {
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+        if (count_previous) {
+            opcode_pair_profile.count(opcode);
+        }
+        count_previous = true;
+#endif
+        opcode = code[pc];
+    dispatch_empty:
+        switch (static_cast<OpCodes>(opcode)) {
+            case OpCodes::iconst_m1:
+            case OpCodes::iconst_0:
+            case OpCodes::iconst_1:
+            case OpCodes::iconst_2:
+            case OpCodes::iconst_3:
+            case OpCodes::iconst_4:
+            case OpCodes::iconst_5:
+                top = opcode - static_cast<u1>(OpCodes::iconst_0);
+                pc += 1;
+                goto cached;
+            case OpCodes::bipush:
+                top = s1_operand();
+                pc += 2;
+                goto cached;
+            case OpCodes::sipush:
+                top = s2_operand();
+                pc += 3;
+                goto cached;
+            case OpCodes::iload:
+            case OpCodes::iload_0:
+            case OpCodes::iload_1:
+            case OpCodes::iload_2:
+            case OpCodes::iload_3:
+                top = int_load();
+                goto cached;
+            case OpCodes::iload_iload_iadd:
+            case OpCodes::iload_0_iload_iadd:
+            case OpCodes::iload_1_iload_iadd:
+            case OpCodes::iload_2_iload_iadd:
+            case OpCodes::iload_3_iload_iadd: {
+                s4 a = first_int_load(opcode, OpCodes::iload_iload_iadd);
+                top = add_overflow(a, int_load());
+                pc += 1; // iadd
+                goto cached;
+            }
+
+            case OpCodes::iinc:
+                iinc();
+                pc += 3;
+                break;
+            case OpCodes::iinc_goto:
+                iinc();
+                pc += 3;
+                branch(true);
+                break;
+            case OpCodes::goto_:
+                branch(true);
+                break;
+            case OpCodes::iload_iconst_if_icmp:
+            case OpCodes::iload_0_iconst_if_icmp:
+            case OpCodes::iload_1_iconst_if_icmp:
+            case OpCodes::iload_2_iconst_if_icmp:
+            case OpCodes::iload_3_iconst_if_icmp:
+                iload_iconst_if_icmp(opcode);
+                break;
+
+                // These pop an int, which is now loaded from memory
+            case OpCodes::istore:
+            case OpCodes::istore_0:
+            case OpCodes::istore_1:
+            case OpCodes::istore_2:
+            case OpCodes::istore_3:
+            case OpCodes::iadd:
+            case OpCodes::isub:
+            case OpCodes::imul:
+            case OpCodes::ineg:
+            case OpCodes::ishl:
+            case OpCodes::ishr:
+            case OpCodes::iushr:
+            case OpCodes::iand:
+            case OpCodes::ior:
+            case OpCodes::ixor:
+            case OpCodes::i2b:
+            case OpCodes::i2c:
+            case OpCodes::i2s:
+            case OpCodes::ifeq:
+            case OpCodes::ifne:
+            case OpCodes::iflt:
+            case OpCodes::ifge:
+            case OpCodes::ifgt:
+            case OpCodes::ifle:
+            case OpCodes::if_icmpeq:
+            case OpCodes::if_icmpne:
+            case OpCodes::if_icmplt:
+            case OpCodes::if_icmpge:
+            case OpCodes::if_icmpgt:
+            case OpCodes::if_icmple:
+                top = (--sp)->s4;
+                goto dispatch_cached;
+
+            default:
+                goto done;
+        }
+    }
+
+cached:
+    for (;;) {
+#ifdef SCHOKOVM_PROFILE_OPCODE_PAIRS
+        if (count_previous) {
+            opcode_pair_profile.count(opcode);
+        }
+        count_previous = true;
+#endif
+        opcode = code[pc];
+    dispatch_cached:
+        switch (static_cast<OpCodes>(opcode)) {
+            case OpCodes::iconst_m1:
+            case OpCodes::iconst_0:
+            case OpCodes::iconst_1:
+            case OpCodes::iconst_2:
+            case OpCodes::iconst_3:
+            case OpCodes::iconst_4:
+            case OpCodes::iconst_5:
+                *sp++ = Value(top);
+                top = opcode - static_cast<u1>(OpCodes::iconst_0);
+                pc += 1;
+                break;
+            case OpCodes::bipush:
+                *sp++ = Value(top);
+                top = s1_operand();
+                pc += 2;
+                break;
+            case OpCodes::sipush:
+                *sp++ = Value(top);
+                top = s2_operand();
+                pc += 3;
+                break;
+            case OpCodes::iload:
+            case OpCodes::iload_0:
+            case OpCodes::iload_1:
+            case OpCodes::iload_2:
+            case OpCodes::iload_3:
+                *sp++ = Value(top);
+                top = int_load();
+                break;
+            case OpCodes::iload_iload_iadd:
+            case OpCodes::iload_0_iload_iadd:
+            case OpCodes::iload_1_iload_iadd:
+            case OpCodes::iload_2_iload_iadd:
+            case OpCodes::iload_3_iload_iadd: {
+                *sp++ = Value(top);
+                s4 a = first_int_load(opcode, OpCodes::iload_iload_iadd);
+                top = add_overflow(a, int_load());
+                pc += 1; // iadd
+                break;
+            }
+
+            case OpCodes::iinc:
+                iinc();
+                pc += 3;
+                break;
+            case OpCodes::iinc_goto:
+                iinc();
+                pc += 3;
+                branch(true);
+                break;
+            case OpCodes::goto_:
+                branch(true);
+                break;
+            case OpCodes::iload_iconst_if_icmp:
+            case OpCodes::iload_0_iconst_if_icmp:
+            case OpCodes::iload_1_iconst_if_icmp:
+            case OpCodes::iload_2_iconst_if_icmp:
+            case OpCodes::iload_3_iconst_if_icmp:
+                iload_iconst_if_icmp(opcode);
+                break;
+
+            case OpCodes::istore:
+                locals[code[pc + 1]] = Value(top);
+                pc += 2;
+                goto empty;
+            case OpCodes::istore_0:
+            case OpCodes::istore_1:
+            case OpCodes::istore_2:
+            case OpCodes::istore_3:
+                locals[opcode - static_cast<u1>(OpCodes::istore_0)] = Value(top);
+                pc += 1;
+                goto empty;
+
+            case OpCodes::iadd:
+                top = add_overflow((--sp)->s4, top);
+                pc += 1;
+                break;
+            case OpCodes::isub:
+                top = sub_overflow((--sp)->s4, top);
+                pc += 1;
+                break;
+            case OpCodes::imul:
+                top = mul_overflow((--sp)->s4, top);
+                pc += 1;
+                break;
+            case OpCodes::ineg:
+                top = sub_overflow(static_cast<s4>(0), top);
+                pc += 1;
+                break;
+            case OpCodes::ishl:
+                top = (--sp)->s4 << (top & 0x1F);
+                pc += 1;
+                break;
+            case OpCodes::ishr:
+                top = (--sp)->s4 >> (top & 0x1F);
+                pc += 1;
+                break;
+            case OpCodes::iushr: {
+                auto shift = top & 0x1F;
+                // C++20 always performs arithmetic shifts, so the top bits need to be cleared out afterwards
+                top = ((--sp)->s4 >> shift) &
+                      (future::bit_cast<s4>(std::numeric_limits<u4>::max() >> static_cast<u4>(shift)));
+                pc += 1;
+                break;
+            }
+            case OpCodes::iand:
+                top = (--sp)->s4 & top;
+                pc += 1;
+                break;
+            case OpCodes::ior:
+                top = (--sp)->s4 | top;
+                pc += 1;
+                break;
+            case OpCodes::ixor:
+                top = (--sp)->s4 ^ top;
+                pc += 1;
+                break;
+            case OpCodes::i2b:
+                top = static_cast<s4>(static_cast<s1>(top));
+                pc += 1;
+                break;
+            case OpCodes::i2c:
+                top = static_cast<s4>(static_cast<u2>(top));
+                pc += 1;
+                break;
+            case OpCodes::i2s:
+                top = static_cast<s4>(static_cast<s2>(top));
+                pc += 1;
+                break;
+
+            case OpCodes::ifeq:
+                branch(top == 0);
+                goto empty;
+            case OpCodes::ifne:
+                branch(top != 0);
+                goto empty;
+            case OpCodes::iflt:
+                branch(top < 0);
+                goto empty;
+            case OpCodes::ifge:
+                branch(top >= 0);
+                goto empty;
+            case OpCodes::ifgt:
+                branch(top > 0);
+                goto empty;
+            case OpCodes::ifle:
+                branch(top <= 0);
+                goto empty;
+            case OpCodes::if_icmpeq:
+                branch((--sp)->s4 == top);
+                goto empty;
+            case OpCodes::if_icmpne:
+                branch((--sp)->s4 != top);
+                goto empty;
+            case OpCodes::if_icmplt:
+                branch((--sp)->s4 < top);
+                goto empty;
+            case OpCodes::if_icmpge:
+                branch((--sp)->s4 >= top);
+                goto empty;
+            case OpCodes::if_icmpgt:
+                branch((--sp)->s4 > top);
+                goto empty;
+            case OpCodes::if_icmple:
+                branch((--sp)->s4 <= top);
+                goto empty;
+
+            default:
+                *sp++ = Value(top);
+                goto done;
+        }
+    }
+
+done:
+    frame.pc = pc;
+    frame.operands_top = static_cast<size_t>(sp - frame.operands.data());
+}
+
 static void execute_comparison(Frame &frame, bool condition) {
     if (condition) {
         return goto_(frame);
@@ -1398,7 +1743,7 @@ static void handle_throw(Thread &thread, Frame &frame, Reference exception, bool
                                                      // but without running the class initializer.
                                                      auto &clazz_name = frame.constant_pool->get<CONSTANT_Class_info>(
                                                              e.catch_type).name->value;
-                                                     for (ClassFile *c = obj->clazz;; c = c->super_class) {
+                                                     for (ClassFile *c = obj->clazz();; c = c->super_class) {
                                                          if (c->name() == clazz_name) { return true; }
                                                          if (c->super_class == nullptr) { break; }
                                                      }
@@ -1488,7 +1833,7 @@ void array_store(Thread &thread, Frame &frame) {
         return throw_new(thread, frame, Names::java_lang_NullPointerException);
     }
 
-    if (index < 0 || index >= arrayref.object()->length) {
+    if (index < 0 || index >= arrayref.array()->length) {
         throw std::runtime_error("TODO ArrayIndexOutOfBoundsException");
     }
 
@@ -1504,29 +1849,226 @@ void array_load(Thread &thread, Frame &frame) {
         return throw_new(thread, frame, Names::java_lang_NullPointerException);
     }
 
-    if (index < 0 || index >= arrayref.object()->length) {
+    if (index < 0 || index >= arrayref.array()->length) {
         throw std::runtime_error("TODO ArrayIndexOutOfBoundsException");
     }
 
     frame.push<Element>(arrayref.data<Element>()[index]);
 }
 
+static inline Value load_field(Reference object, ResolvedConstant const &field) {
+    switch (field.type) {
+        case 'B':
+        case 'Z':
+            return Value{static_cast<s4>(*object.element_at_offset<s1>(field.offset))};
+        case 'C':
+            return Value{static_cast<s4>(*object.element_at_offset<u2>(field.offset))};
+        case 'S':
+            return Value{static_cast<s4>(*object.element_at_offset<s2>(field.offset))};
+        case 'I':
+            return Value{*object.element_at_offset<s4>(field.offset)};
+        case 'F':
+            return Value{*object.element_at_offset<float>(field.offset)};
+        case 'J':
+            return Value{*object.element_at_offset<s8>(field.offset)};
+        case 'D':
+            return Value{*object.element_at_offset<double>(field.offset)};
+        default:
+            return Value{static_cast<Reference>(*object.element_at_offset<StoredReference>(field.offset))};
+    }
+}
+
+static inline void store_field(Reference object, ResolvedConstant const &field, Value value) {
+    switch (field.type) {
+        case 'B':
+        case 'Z':
+            *object.element_at_offset<s1>(field.offset) = static_cast<s1>(value.s4);
+            break;
+        case 'C':
+            *object.element_at_offset<u2>(field.offset) = static_cast<u2>(value.s4);
+            break;
+        case 'S':
+            *object.element_at_offset<s2>(field.offset) = static_cast<s2>(value.s4);
+            break;
+        case 'I':
+            *object.element_at_offset<s4>(field.offset) = value.s4;
+            break;
+        case 'F':
+            *object.element_at_offset<float>(field.offset) = value.float_;
+            break;
+        case 'J':
+            *object.element_at_offset<s8>(field.offset) = value.s8;
+            break;
+        case 'D':
+            *object.element_at_offset<double>(field.offset) = value.double_;
+            break;
+        default:
+            *object.element_at_offset<StoredReference>(field.offset) = value.reference;
+            break;
+    }
+}
+
+static Result resolve_loadable_constant(ConstantPool &constant_pool, u2 index) {
+    auto &entry = constant_pool.table[index];
+    auto &resolved = constant_pool.resolved[index];
+    if (auto i = std::get_if<CONSTANT_Integer_info>(&entry.variant)) {
+        resolved.value = Value{i->value};
+    } else if (auto f = std::get_if<CONSTANT_Float_info>(&entry.variant)) {
+        resolved.value = Value{f->value};
+    } else if (auto l = std::get_if<CONSTANT_Long_info>(&entry.variant)) {
+        resolved.value = Value{l->value};
+    } else if (auto d = std::get_if<CONSTANT_Double_info>(&entry.variant)) {
+        resolved.value = Value{d->value};
+    } else if (std::holds_alternative<CONSTANT_Class_info>(entry.variant)) {
+        ClassFile *clazz;
+        return resolve_class_constant(constant_pool, index, clazz);
+    } else if (auto s = std::get_if<CONSTANT_String_info>(&entry.variant)) {
+        // The string stays reachable through s->java_string
+        resolved.value = Value{Heap::get().load_string(*s)};
+    } else {
+        // TODO: "a symbolic reference to a method type, a method handle, or a dynamically-computed constant." (?)
+        throw std::runtime_error("ldc refers to invalid/unimplemented type");
+    }
+    store_release(resolved.kind, ResolvedConstant::Constant);
+    return ResultOk;
+}
+
+static inline Result resolve_class_constant(ConstantPool &constant_pool, u2 index, ClassFile *&out) {
+    auto &resolved = constant_pool.resolved[index];
+    if (load_acquire(resolved.kind) == ResolvedConstant::Class) {
+        out = resolved.clazz;
+        return ResultOk;
+    }
+
+    auto &class_info = constant_pool.get<CONSTANT_Class_info>(index);
+    if (resolve_class(&class_info)) {
+        return Exception;
+    }
+    out = class_info.clazz;
+    resolved.clazz = out;
+    store_release(resolved.kind, ResolvedConstant::Class);
+    return ResultOk;
+}
+
+// Resolves the field of getstatic, putstatic, getfield or putfield into `out`. Static fields are initialized first and
+// only cached once their class is initialized, so other threads still wait for the initialization.
+static Result resolve_field_constant(Thread &thread, Frame &frame, u2 index, bool is_static, ResolvedConstant &out) {
+    auto &field = frame.constant_pool->get<CONSTANT_Fieldref_info>(index);
+
+    if (!load_acquire(field.resolved)) {
+        if (resolve_class(field.class_)) {
+            return Exception;
+        }
+
+        if (resolve_field(field.class_->clazz, &field, thread.current_exception)) {
+            return Exception;
+        }
+        if (thread.current_exception != JAVA_NULL)
+            throw std::runtime_error(
+                    "field not found: " + std::string(field.class_->name->value) + "." +
+                    std::string(field.name_and_type->name->value) + " " +
+                    std::string(field.name_and_type->descriptor->value));
+        assert(field.resolved);
+    }
+
+    if (field.is_static != is_static)
+        throw std::runtime_error(is_static ? "field is not static" : "field is static");
+
+    auto &resolved = frame.constant_pool->resolved[index];
+    out.type = field.type;
+    if (is_static) {
+        if (initialize_class(field.value_clazz, thread, frame)) {
+            return Exception;
+        }
+        out.kind = ResolvedConstant::StaticField;
+        out.static_value = &field.value_clazz->static_field_values[field.index];
+        if (!load_acquire(field.value_clazz->is_initialized)) {
+            return ResultOk;
+        }
+        resolved.static_value = out.static_value;
+    } else {
+        out.kind = ResolvedConstant::InstanceField;
+        out.offset = static_cast<u4>(field.offset);
+        resolved.offset = out.offset;
+    }
+    resolved.type = out.type;
+    store_release(resolved.kind, out.kind);
+    return ResultOk;
+}
+
+static inline void cache_method(ResolvedConstant &entry, method_info *method) {
+    entry.method = method;
+    store_release(entry.kind, ResolvedConstant::Method);
+}
+
+static bool is_int_load(OpCodes opcode) {
+    return opcode == OpCodes::iload || (opcode >= OpCodes::iload_0 && opcode <= OpCodes::iload_3);
+}
+
+void rewrite_superinstructions(ClassFile *clazz) {
+    for (auto &method : clazz->methods) {
+        if (method.code_attribute == nullptr) {
+            continue;
+        }
+        auto &code = method.code_attribute->code;
+        // nop after the end of the code
+        auto at = [&code](size_t bci) {
+            return bci < code.size() ? static_cast<OpCodes>(code[bci]) : OpCodes::nop;
+        };
+
+        // None of the sequences starts with an instruction that can be the second one of a sequence, so the
+        // superinstructions can read those from the code
+        for (size_t bci = 0; bci < code.size();) {
+            auto length = instruction_length(code, bci);
+            if (length == 0) {
+                // Only possible in code that was not verified
+                break;
+            }
+            auto opcode = at(bci);
+            auto next = bci + length;
+
+            if (opcode == OpCodes::aload_0 && at(next) == OpCodes::getfield) {
+                code[bci] = static_cast<u1>(OpCodes::aload_0_getfield);
+            } else if (is_int_load(opcode)) {
+                // 0 for iload, 1-4 for iload_<n>
+                u1 variant = opcode == OpCodes::iload ? 0 : static_cast<u1>(
+                        static_cast<u1>(opcode) - static_cast<u1>(OpCodes::iload_0) + 1);
+                auto second = at(next);
+                auto third = is_int_load(second) || second == OpCodes::bipush ||
+                             (second >= OpCodes::iconst_m1 && second <= OpCodes::iconst_5)
+                             ? at(next + instruction_length(code, next)) : OpCodes::nop;
+                if (is_int_load(second) && third == OpCodes::iadd) {
+                    code[bci] = static_cast<u1>(static_cast<u1>(OpCodes::iload_iload_iadd) + variant);
+                } else if (!is_int_load(second) && third >= OpCodes::if_icmpeq && third <= OpCodes::if_icmple) {
+                    code[bci] = static_cast<u1>(static_cast<u1>(OpCodes::iload_iconst_if_icmp) + variant);
+                }
+            } else if (opcode == OpCodes::new_ && at(next) == OpCodes::dup && at(next + 1) == OpCodes::invokespecial) {
+                code[bci] = static_cast<u1>(OpCodes::new_dup_invokespecial);
+            } else if (opcode == OpCodes::iinc && at(next) == OpCodes::goto_) {
+                code[bci] = static_cast<u1>(OpCodes::iinc_goto);
+            }
+
+            bci = next;
+        }
+    }
+}
+
 void fill_multi_array(Reference &reference, ClassFile *element_type, const std::span<s4> &counts) {
     s4 count = counts.back();
     // If any count value is zero, no subsequent dimensions are allocated
     if (count == 0) return;
 
-    for (s4 i = reference.object()->length - 1; i >= 0; i--) {
-        auto child = Heap::get().new_array<Reference>(element_type, count);
+    for (s4 i = reference.array()->length - 1; i >= 0; i--) {
+        auto child = Heap::get().new_array<StoredReference>(element_type, count);
         if (counts.size() > 1) {
             fill_multi_array(child, element_type->array_element_type, counts.subspan(0, counts.size() - 1));
         }
-        reference.data<Reference>()[i] = child;
+        reference.data<StoredReference>()[i] = child;
     }
 }
 
 static void
-resolve_method_interfaces(ClassFile *clazz, const std::string &name, const std::string &descriptor,
+resolve_method_interfaces(ClassFile *clazz, std::string_view name, std::string_view descriptor,
                           method_info *&out_method_max_specific, method_info *&out_method_fallback) {
     if (clazz->is_interface()) {
         for (auto &m : clazz->methods) {
@@ -1558,7 +2100,7 @@ resolve_method_interfaces(ClassFile *clazz, const std::string &name, const std::
     }
 }
 
-method_info *method_resolution(ClassFile *clazz, std::string const &name, std::string const &descriptor) {
+method_info *method_resolution(ClassFile *clazz, std::string_view name, std::string_view descriptor) {
     // https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-5.html#jvms-5.4.3.3
 
     // 2.
@@ -1584,7 +2126,8 @@ method_info *method_resolution(ClassFile *clazz, std::string const &name, std::s
 
     // TODO throw the appropriate JVM exception instead
     throw std::runtime_error(
-            "Couldn't find method (static): " + name + descriptor + " in class " + clazz->name());
+            "Couldn't find method (static): " + std::string(name) + std::string(descriptor) + " in class " +
+            std::string(clazz->name()));
 
 }
 
@@ -1610,8 +2153,8 @@ method_selection(ClassFile *dynamic_class, method_info *declared_method, method_
         return false;
     }
 
-    const auto &name = declared_method->name_index->value;
-    const auto &descriptor = declared_method->descriptor_index->value;
+    auto name = declared_method->name_index->value;
+    auto descriptor = declared_method->descriptor_index->value;
     // 2. (1 + 2)
     for (ClassFile *clazz = dynamic_class; clazz != nullptr; clazz = clazz->super_class) {
         for (auto &m : clazz->methods) {
@@ -1647,20 +2190,20 @@ method_selection(ClassFile *dynamic_class, method_info *declared_method, method_
 
     // TODO throw the appropriate JVM exception instead
     // TODO shouldn't this be impossible as long as declared isn't abstract?
-    throw std::runtime_error("Couldn't find method (virtual): " + name + descriptor);
+    throw std::runtime_error("Couldn't find method (virtual): " + std::string(name) + std::string(descriptor));
 }
 
 void native_call(method_info *method, Thread &thread, Frame &frame, bool &should_exit) {
     // during native calls we push the current frame
     thread.stack.push_frame(frame);
 
-    if (!method->native_function) {
+    if (method->native_function == nullptr) {
         auto *function_pointer = get_native_function_pointer(method);
         if (function_pointer == nullptr) {
             // TODO throw an exception and return
             abort();
         }
-        method->native_function = NativeFunction(method, function_pointer);
+        method->native_function = method->clazz->loader_data->add_native_function(method, function_pointer);
     }
     NativeFunction &native = *method->native_function;
 
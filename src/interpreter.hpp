@@ -2,6 +2,7 @@
 #define SCHOKOVM_INTERPRETER_HPP
 
 #include <memory>
+#include <random>
 #include <span>
 #include <unordered_map>
 #include <vector>
@@ -25,7 +26,7 @@ enum [[nodiscard]] Result {
 /** https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-2.html#jvms-2.6 */
 struct Frame {
     method_info *method;
-    std::vector<u1> *code;
+    MetadataVector<u1> *code;
     ConstantPool *constant_pool; // method->clazz->constant_pool
 
     // stack_memory indices (we cannot store pointers because the memory could move)
@@ -161,6 +162,22 @@ inline Reference Frame::pop<Reference>() {
     return pop().reference;
 }
 
+#ifdef SCHOKOVM_COMPRESSED_REFERENCES
+
+// references that are loaded from/stored into arrays
+
+template<>
+inline void Frame::push<NarrowReference>(NarrowReference value) {
+    push<Reference>(value);
+}
+
+template<>
+inline NarrowReference Frame::pop<NarrowReference>() {
+    return pop<Reference>();
+}
+
+#endif
+
 template<>
 inline void Frame::push<s8>(s8 value) {
     push2(Value(value));
@@ -265,13 +282,33 @@ struct Thread {
     JNINativeInterface_ jni_native_interface;
 
     Reference thread_object = JAVA_NULL;
+
+    // State of Marsaglia's xor-shift generator for identity hash codes, the same constants are used by HotSpot
+    u4 hash_state[4]{static_cast<u4>(std::random_device{}()), 842502087, 0x8767, 273326509};
+
+    // The forks of --server would all continue with the same sequence
+    void reseed_identity_hash() {
+        hash_state[0] = static_cast<u4>(std::random_device{}());
+    }
+
+    u4 next_identity_hash() {
+        u4 t = hash_state[0];
+        t ^= t << 11;
+        hash_state[0] = hash_state[1];
+        hash_state[1] = hash_state[2];
+        hash_state[2] = hash_state[3];
+        u4 v = hash_state[3];
+        v = (v ^ (v >> 19)) ^ (t ^ (t >> 8));
+        hash_state[3] = v;
+        return v;
+    }
 };
 
 inline thread_local Thread this_thread;
 
 struct BootstrapClassLoader;
 
-method_info *method_resolution(ClassFile *clazz, std::string const &name, std::string const &descriptor);
+method_info *method_resolution(ClassFile *clazz, std::string_view name, std::string_view descriptor);
 
 [[nodiscard]] bool
 method_selection(ClassFile *dynamic_class, method_info *declared_method, method_info *&out_method);
@@ -279,4 +316,8 @@ method_selection(ClassFile *dynamic_class, method_info *declared_method, method_
 
 Value interpret(Thread &thread, method_info *method);
 
+// Replaces the opcodes of the first instructions of frequent sequences in the methods of `clazz` with superinstructions
+// (see OpCodes), before any of the methods runs
+void rewrite_superinstructions(ClassFile *clazz);
+
 #endif //SCHOKOVM_INTERPRETER_HPP
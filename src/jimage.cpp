@@ -0,0 +1,304 @@
+#include "jimage.hpp"
+
+#include <array>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+JImageException::JImageException(std::string message) : message(std::move(message)) {}
+
+const char *JImageException::what() const noexcept {
+    return message.c_str();
+}
+
+namespace {
+constexpr u4 image_magic = 0xCAFEDADA;
+constexpr u4 image_major_version = 1;
+constexpr u4 resource_header_magic = 0xCAFEFAFA;
+
+// The header consists of 7 u4: magic, version (major << 16 | minor), flags, resource count, table length,
+// locations size, strings size
+constexpr size_t header_size = 7 * sizeof(u4);
+
+// A compressed resource starts with this header (packed), the compressed data follows
+struct ResourceHeader {
+    u4 magic;
+    u8 size;
+    u8 uncompressed_size;
+    u4 decompressor_name_offset;
+    u4 decompressor_config_offset;
+    u1 is_terminal;
+};
+constexpr size_t resource_header_size = 29;
+
+enum Attribute : u1 {
+    ATTRIBUTE_END = 0,
+    ATTRIBUTE_MODULE = 1,
+    ATTRIBUTE_PARENT = 2,
+    ATTRIBUTE_BASE = 3,
+    ATTRIBUTE_EXTENSION = 4,
+    ATTRIBUTE_OFFSET = 5,
+    ATTRIBUTE_COMPRESSED = 6,
+    ATTRIBUTE_UNCOMPRESSED = 7,
+    ATTRIBUTE_COUNT = 8,
+};
+
+// The values in the header and in the tables are in the byte order of the image
+template<typename T>
+T read_native(u1 const *data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+constexpr u4 hash_multiplier = 0x01000193;
+
+s4 hash_code(std::string_view name, u4 seed = hash_multiplier) {
+    for (char c : name) {
+        seed = (seed * hash_multiplier) ^ static_cast<u1>(c);
+    }
+    return static_cast<s4>(seed & 0x7FFFFFFF);
+}
+
+// Each attribute is a byte with the kind (upper 5 bits) and the length - 1 (lower 3 bits), followed by the value
+// in big-endian
+std::array<u8, ATTRIBUTE_COUNT> decompress_attributes(u1 const *data, u1 const *end) {
+    std::array<u8, ATTRIBUTE_COUNT> attributes{};
+    while (data < end && *data != ATTRIBUTE_END) {
+        u1 kind = *data >> 3;
+        u1 length = static_cast<u1>((*data & 0x7) + 1);
+        if (kind >= ATTRIBUTE_COUNT || data + 1 + length > end) {
+            throw JImageException("Invalid location attribute");
+        }
+        u8 value = 0;
+        for (size_t i = 1; i <= length; ++i) {
+            value = (value << 8) | data[i];
+        }
+        attributes[kind] = value;
+        data += 1 + length;
+    }
+    return attributes;
+}
+}
+
+JImage::JImage(std::string path) : path(std::move(path)) {
+    int fd = open(this->path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw JImageException("Failed to open " + this->path);
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(header_size)) {
+        close(fd);
+        throw JImageException("Not a jimage file: " + this->path);
+    }
+    m_size = static_cast<size_t>(status.st_size);
+    void *memory = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw JImageException("Failed to map " + this->path);
+    }
+    m_data = static_cast<u1 const *>(memory);
+
+    if (read_native<u4>(m_data) != image_magic) {
+        throw JImageException("Not a jimage file (or the wrong byte order): " + this->path);
+    }
+    if (read_native<u4>(m_data + 4) >> 16 != image_major_version) {
+        throw JImageException("Unsupported jimage version: " + this->path);
+    }
+    m_table_length = read_native<u4>(m_data + 16);
+    m_locations_size = read_native<u4>(m_data + 20);
+    m_strings_size = read_native<u4>(m_data + 24);
+
+    m_index_size = header_size + m_table_length * sizeof(s4) + m_table_length * sizeof(u4) + m_locations_size +
+                   m_strings_size;
+    if (m_index_size > m_size) {
+        throw JImageException("Truncated jimage file: " + this->path);
+    }
+    m_redirect_table = reinterpret_cast<s4 const *>(m_data + header_size);
+    m_offsets_table = reinterpret_cast<u4 const *>(m_redirect_table + m_table_length);
+    m_locations = reinterpret_cast<u1 const *>(m_offsets_table + m_table_length);
+    m_strings = reinterpret_cast<char const *>(m_locations + m_locations_size);
+}
+
+JImage::~JImage() {
+    if (m_data != nullptr) {
+        munmap(const_cast<u1 *>(m_data), m_size);
+    }
+}
+
+std::string_view JImage::string_at(u8 offset) const {
+    if (offset >= m_strings_size) {
+        throw JImageException("Invalid string offset in " + path);
+    }
+    return {m_strings + offset, strnlen(m_strings + offset, m_strings_size - offset)};
+}
+
+std::optional<JImageLocation> JImage::find_location(std::string_view name) const {
+    if (m_table_length == 0) {
+        return {};
+    }
+
+    // Perfect hashing: The redirect table either points directly to the slot (negative) or contains the seed for a
+    // second hash (positive)
+    auto index = static_cast<u4>(hash_code(name)) % m_table_length;
+    s4 redirect = read_native<s4>(reinterpret_cast<u1 const *>(m_redirect_table + index));
+    if (redirect > 0) {
+        index = static_cast<u4>(hash_code(name, static_cast<u4>(redirect))) % m_table_length;
+    } else if (redirect < 0) {
+        index = static_cast<u4>(-1 - redirect);
+        if (index >= m_table_length) {
+            throw JImageException("Invalid redirect table in " + path);
+        }
+    } else {
+        return {};
+    }
+
+    u4 offset = read_native<u4>(reinterpret_cast<u1 const *>(m_offsets_table + index));
+    if (offset >= m_locations_size) {
+        throw JImageException("Invalid location offset in " + path);
+    }
+    auto attributes = decompress_attributes(m_locations + offset, m_locations + m_locations_size);
+
+    // The hash can collide with other names, so the name has to be verified:
+    // /module/parent/base.extension, where every part but the base is optional
+    auto consume = [&name](std::string_view part) {
+        if (!name.starts_with(part)) {
+            return false;
+        }
+        name.remove_prefix(part.size());
+        return true;
+    };
+    if (auto module = string_at(attributes[ATTRIBUTE_MODULE]); !module.empty()) {
+        if (!consume("/") || !consume(module) || !consume("/")) {
+            return {};
+        }
+    }
+    if (auto parent = string_at(attributes[ATTRIBUTE_PARENT]); !parent.empty()) {
+        if (!consume(parent) || !consume("/")) {
+            return {};
+        }
+    }
+    if (!consume(string_at(attributes[ATTRIBUTE_BASE]))) {
+        return {};
+    }
+    if (auto extension = string_at(attributes[ATTRIBUTE_EXTENSION]); !extension.empty()) {
+        if (!consume(".") || !consume(extension)) {
+            return {};
+        }
+    }
+    if (!name.empty()) {
+        return {};
+    }
+
+    return JImageLocation{attributes[ATTRIBUTE_OFFSET], attributes[ATTRIBUTE_COMPRESSED],
+                          attributes[ATTRIBUTE_UNCOMPRESSED]};
+}
+
+std::optional<std::string_view> JImage::package_to_module(std::string_view package) const {
+    // The resource /packages/<package with dots> contains pairs of u4 (is empty, module name offset)
+    std::string name = "/packages/";
+    name.reserve(name.size() + package.size());
+    for (char c : package) {
+        name += c == '/' ? '.' : c;
+    }
+
+    auto location = find_location(name);
+    if (!location) {
+        return {};
+    }
+    std::vector<u1> content(location->uncompressed_size);
+    read(*location, content.data());
+    for (size_t i = 0; i + 2 * sizeof(u4) <= content.size(); i += 2 * sizeof(u4)) {
+        if (read_native<u4>(&content[i]) == 0) {
+            return string_at(read_native<u4>(&content[i + sizeof(u4)]));
+        }
+    }
+    return {};
+}
+
+std::vector<std::string_view> JImage::packages() const {
+    // Every package has a resource /packages/<package>, there is no other way to enumerate them than walking
+    // all locations
+    std::vector<std::string_view> packages;
+    for (size_t i = 0; i < m_table_length; ++i) {
+        u4 offset = read_native<u4>(reinterpret_cast<u1 const *>(m_offsets_table + i));
+        if (offset >= m_locations_size) {
+            throw JImageException("Invalid location offset in " + path);
+        }
+        auto attributes = decompress_attributes(m_locations + offset, m_locations + m_locations_size);
+        if (string_at(attributes[ATTRIBUTE_MODULE]) == "packages") {
+            packages.push_back(string_at(attributes[ATTRIBUTE_BASE]));
+        }
+    }
+    return packages;
+}
+
+std::span<u1 const> JImage::resource_bytes(u8 offset, u8 size) const {
+    if (offset + size > m_size - m_index_size) {
+        throw JImageException("Resource exceeds the end of " + path);
+    }
+    return {m_data + m_index_size + offset, size};
+}
+
+std::span<u1 const> JImage::uncompressed_contents(JImageLocation const &location) const {
+    return resource_bytes(location.offset, location.uncompressed_size);
+}
+
+void JImage::read(JImageLocation const &location, u1 *destination) const {
+    if (!location.is_compressed()) {
+        auto contents = uncompressed_contents(location);
+        std::memcpy(destination, contents.data(), contents.size());
+        return;
+    }
+
+    // Compressors can be stacked, every level has its own header
+    std::vector<u1> buffer;
+    std::span<u1 const> compressed = resource_bytes(location.offset, location.compressed_size);
+    while (compressed.size() >= resource_header_size && read_native<u4>(compressed.data()) == resource_header_magic) {
+        ResourceHeader header{
+                read_native<u4>(compressed.data()),
+                read_native<u8>(compressed.data() + 4),
+                read_native<u8>(compressed.data() + 12),
+                read_native<u4>(compressed.data() + 20),
+                read_native<u4>(compressed.data() + 24),
+                compressed[28],
+        };
+        if (header.size > compressed.size() - resource_header_size) {
+            throw JImageException("Invalid compressed resource in " + path);
+        }
+
+        auto decompressor = string_at(header.decompressor_name_offset);
+        if (decompressor != "zip") {
+            // TODO compact-cp (--compress=1)
+            throw JImageException("Unsupported jimage decompressor: " + std::string(decompressor));
+        }
+
+        std::vector<u1> uncompressed(header.uncompressed_size);
+        z_stream stream{};
+        if (inflateInit(&stream) != Z_OK) {
+            throw JImageException("inflateInit failed");
+        }
+        stream.next_in = const_cast<u1 *>(compressed.data() + resource_header_size);
+        stream.avail_in = static_cast<uInt>(header.size);
+        stream.next_out = uncompressed.data();
+        stream.avail_out = static_cast<uInt>(uncompressed.size());
+        int result = inflate(&stream, Z_FINISH);
+        auto length = stream.total_out;
+        inflateEnd(&stream);
+        if (result != Z_STREAM_END || length != header.uncompressed_size) {
+            throw JImageException("inflate failed (" + std::to_string(result) + ") in " + path);
+        }
+
+        buffer = std::move(uncompressed);
+        compressed = buffer;
+    }
+
+    if (compressed.size() != location.uncompressed_size) {
+        throw JImageException("Unexpected size of decompressed resource in " + path);
+    }
+    std::memcpy(destination, compressed.data(), compressed.size());
+}
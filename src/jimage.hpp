@@ -0,0 +1,77 @@
+#ifndef SCHOKOVM_JIMAGE_HPP
+#define SCHOKOVM_JIMAGE_HPP
+
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "types.hpp"
+
+struct JImageException : std::exception {
+    std::string message;
+
+    explicit JImageException(std::string message);
+
+    [[nodiscard]] const char *what() const noexcept override;
+};
+
+struct JImageLocation {
+    // Offset from the end of the index
+    u8 offset;
+    // 0 if the resource is stored uncompressed
+    u8 compressed_size;
+    u8 uncompressed_size;
+
+    [[nodiscard]] bool is_compressed() const { return compressed_size != 0; }
+};
+
+// Reader for the jimage format of the JDK's lib/modules file, see src/java.base/share/native/libjimage in OpenJDK.
+// The file is mapped into memory, resources are found through the perfect hash table of the index.
+// Only images in the byte order of the host are supported.
+struct JImage {
+    explicit JImage(std::string path);
+
+    JImage(JImage const &) = delete;
+
+    JImage &operator=(JImage const &) = delete;
+
+    ~JImage();
+
+    std::string path;
+
+    // `name` is the full path of the resource, e.g. /java.base/java/lang/Object.class
+    [[nodiscard]] std::optional<JImageLocation> find_location(std::string_view name) const;
+
+    // Returns the module that contains the package, e.g. java.base for java/lang
+    [[nodiscard]] std::optional<std::string_view> package_to_module(std::string_view package) const;
+
+    // All packages in the image, with dots as separators (e.g. java.lang)
+    [[nodiscard]] std::vector<std::string_view> packages() const;
+
+    // The contents of an uncompressed resource, they point into the mapping of the image
+    [[nodiscard]] std::span<u1 const> uncompressed_contents(JImageLocation const &location) const;
+
+    // `destination` has to be large enough for JImageLocation::uncompressed_size bytes
+    void read(JImageLocation const &location, u1 *destination) const;
+
+private:
+    u1 const *m_data = nullptr;
+    size_t m_size = 0;
+
+    u4 m_table_length = 0;
+    s4 const *m_redirect_table = nullptr;
+    u4 const *m_offsets_table = nullptr;
+    u1 const *m_locations = nullptr;
+    size_t m_locations_size = 0;
+    char const *m_strings = nullptr;
+    size_t m_strings_size = 0;
+    size_t m_index_size = 0;
+
+    [[nodiscard]] std::string_view string_at(u8 offset) const;
+
+    [[nodiscard]] std::span<u1 const> resource_bytes(u8 offset, u8 size) const;
+};
+
+#endif //SCHOKOVM_JIMAGE_HPP
@@ -47,6 +47,11 @@ JNI_CreateJavaVM(JavaVM **pvm, void **penv, void *args) {
     static const std::string BOOTCLASSPATH_OPTION = "-Xbootclasspath:";
     static const std::string CLASSPATH_option{"-Djava.class.path="};
     static const std::string JAVAHOME_OPTION{"-Xjavahome:"};
+    static const std::string PACKAGE_INDEX_CACHE_OPTION{"-XX:PackageIndexCache="};
+    static const std::string SHARED_ARCHIVE_FILE_OPTION{"-XX:SharedArchiveFile="};
+    static const std::string PRELOAD_THREADS_OPTION{"-XX:PreloadThreads="};
+    static const std::string PRELOAD_CLASS_LIST_OPTION{"-XX:PreloadClassList="};
+    static const std::string DUMP_LOADED_CLASS_LIST_OPTION{"-XX:DumpLoadedClassList="};
 
     std::string bootclasspath{};
     std::string classpath{};
@@ -59,9 +64,47 @@ JNI_CreateJavaVM(JavaVM **pvm, void **penv, void *args) {
             classpath = option.substr(CLASSPATH_option.size());
         } else if (option.starts_with(JAVAHOME_OPTION)) {
             java_home = option.substr(JAVAHOME_OPTION.size());
+        } else if (option == "-XX:+UseStringDeduplication") {
+            Heap::get().string_deduplication = true;
+        } else if (option == "-XX:-UseStringDeduplication") {
+            Heap::get().string_deduplication = false;
+        } else if (option == "-XX:+PrintMetaspaceStatisticsAtExit") {
+            Heap::get().print_metaspace_statistics_at_exit = true;
+        } else if (option == "-XX:-PrintMetaspaceStatisticsAtExit") {
+            Heap::get().print_metaspace_statistics_at_exit = false;
+        } else if (option == "-Xshare:off") {
+            BootstrapClassLoader::get().share_mode = ShareMode::Off;
+        } else if (option == "-Xshare:auto") {
+            BootstrapClassLoader::get().share_mode = ShareMode::Auto;
+        } else if (option == "-Xshare:on") {
+            BootstrapClassLoader::get().share_mode = ShareMode::On;
+        } else if (option == "-Xshare:dump") {
+            BootstrapClassLoader::get().share_mode = ShareMode::Dump;
+        } else if (option == "-Xverify:none") {
+            BootstrapClassLoader::get().verify_mode = VerifyMode::None;
+        } else if (option == "-Xverify:remote") {
+            BootstrapClassLoader::get().verify_mode = VerifyMode::Remote;
+        } else if (option == "-Xverify:all") {
+            BootstrapClassLoader::get().verify_mode = VerifyMode::All;
+        } else if (option.starts_with(SHARED_ARCHIVE_FILE_OPTION)) {
+            BootstrapClassLoader::get().shared_archive_file = option.substr(SHARED_ARCHIVE_FILE_OPTION.size());
+        } else if (option.starts_with(PRELOAD_THREADS_OPTION)) {
+            BootstrapClassLoader::get().preload_threads = std::stoul(option.substr(PRELOAD_THREADS_OPTION.size()));
+        } else if (option.starts_with(PRELOAD_CLASS_LIST_OPTION)) {
+            BootstrapClassLoader::get().preload_class_list = option.substr(PRELOAD_CLASS_LIST_OPTION.size());
+        } else if (option.starts_with(DUMP_LOADED_CLASS_LIST_OPTION)) {
+            BootstrapClassLoader::get().dump_loaded_class_list = option.substr(DUMP_LOADED_CLASS_LIST_OPTION.size());
+        } else if (option.starts_with(PACKAGE_INDEX_CACHE_OPTION)) {
+            BootstrapClassLoader::get().package_index_cache = option.substr(PACKAGE_INDEX_CACHE_OPTION.size());
         }
     }
 
+    if (BootstrapClassLoader::get().share_mode != ShareMode::Off &&
+        BootstrapClassLoader::get().shared_archive_file.empty()) {
+        std::cerr << "Error: -Xshare requires -XX:SharedArchiveFile=<file>\n";
+        return JNI_EINVAL;
+    }
+
     std::string libverify_path = java_home + "/lib/libverify" + LIB_EXTENSION;
     dlopen(libverify_path.c_str(),
            RTLD_LAZY | RTLD_GLOBAL);
@@ -126,9 +169,8 @@ JNI_CreateJavaVM(JavaVM **pvm, void **penv, void *args) {
         auto thread_ref = Reference{thread_obj};
         // Important to set this before calling the constructor, because the Thread calls currentThread()
         thread->thread_object = Reference{thread_obj};
-        [[maybe_unused]] auto thread_priority_field = reinterpret_cast<ClassFile *>(class_Thread)->fields[1];
-        assert(thread_priority_field.name_index->value == "priority" && thread_priority_field.index == 1);
-        thread_ref.data<Value>()[1] /* thread.priority */ = Value{5 /* Thread.NORM_PRIORITY */ };
+        *thread_ref.element_at_offset<s4>(BootstrapClassLoader::constants().java_lang_Thread_priority) =
+                5 /* Thread.NORM_PRIORITY */;
 
         jmethodID thread_init = thread->jni_env->GetMethodID(class_Thread, "<init>",
                                                              "(Ljava/lang/ThreadGroup;Ljava/lang/String;)V");
@@ -182,6 +224,16 @@ JNI_GetCreatedJavaVMs(JavaVM **vmBuf, jsize bufLen, jsize *nVMs) {
 jint JNICALL
 DestroyJavaVM(JavaVM *vm) {
     LOG("DestroyJavaVM");
+    if (Heap::get().print_metaspace_statistics_at_exit) {
+        Heap::get().print_metaspace_statistics(std::cerr);
+    }
+    BootstrapClassLoader::get().stop_preloading();
+    if (BootstrapClassLoader::get().share_mode == ShareMode::Dump) {
+        BootstrapClassLoader::get().dump_shared_archive();
+    }
+    if (!BootstrapClassLoader::get().dump_loaded_class_list.empty()) {
+        BootstrapClassLoader::get().dump_loaded_class_list_file();
+    }
     delete vm;
     return JNI_OK;
 }
@@ -391,7 +443,7 @@ jclass GetObjectClass
         (JNIEnv *env, jobject obj) {
     LOG("GetObjectClass");
     auto ref = Reference{obj};
-    ClassFile *clazz = ref.object()->clazz;
+    ClassFile *clazz = ref.object()->clazz();
     return reinterpret_cast<jclass>(clazz);
 }
 
@@ -422,6 +474,55 @@ jmethodID GetMethodID
  *    CallStaticReturntypeMethod
  */
 
+static Value argument_value(char type, jvalue argument) {
+    switch (type) {
+        case 'Z':
+            return Value{static_cast<s4>(argument.z)};
+        case 'B':
+            return Value{static_cast<s4>(argument.b)};
+        case 'C':
+            return Value{static_cast<s4>(argument.c)};
+        case 'S':
+            return Value{static_cast<s4>(argument.s)};
+        case 'I':
+            return Value{argument.i};
+        case 'J':
+            return Value{static_cast<s8>(argument.j)};
+        case 'F':
+            return Value{argument.f};
+        case 'D':
+            return Value{argument.d};
+        default:
+            return Value{Reference{argument.l}};
+    }
+}
+
+// Variadic arguments smaller than int are promoted to int, float is promoted to double. `VaList` is whatever a va_list
+// parameter decays to.
+template<typename VaList>
+static Value argument_value(char type, VaList &args) {
+    switch (type) {
+        case 'Z':
+            return Value{static_cast<s4>(static_cast<jboolean>(va_arg(args, jint)))};
+        case 'B':
+            return Value{static_cast<s4>(static_cast<jbyte>(va_arg(args, jint)))};
+        case 'C':
+            return Value{static_cast<s4>(static_cast<jchar>(va_arg(args, jint)))};
+        case 'S':
+            return Value{static_cast<s4>(static_cast<jshort>(va_arg(args, jint)))};
+        case 'I':
+            return Value{static_cast<s4>(va_arg(args, jint))};
+        case 'J':
+            return Value{static_cast<s8>(va_arg(args, jlong))};
+        case 'F':
+            return Value{static_cast<float>(va_arg(args, jdouble))};
+        case 'D':
+            return Value{va_arg(args, jdouble)};
+        default:
+            return Value{Reference{va_arg(args, jobject)}};
+    }
+}
+
 #define CALL_HELPER(Name, ArgType, NextArg)                                                                            \
 static jint Name(JNIEnv *env, jclass java_class, bool is_virtual,                                                      \
                  jobject java_object, jmethodID methodID, ArgType args, Value &result) {                               \
@@ -438,24 +539,20 @@ static jint Name(JNIEnv *env, jclass java_class, bool is_virtual,
                                                                                                                        \
     if (is_virtual) {                                                                                                  \
         auto *declared_method = method;                                                                                \
-        if (method_selection(object->clazz, declared_method, method)) {                                                \
+        if (method_selection(object->clazz(), declared_method, method)) {                                              \
             return JNI_ERR;                                                                                            \
         }                                                                                                              \
     } else {                                                                                                           \
         assert(clazz == method->clazz);                                                                                \
     }                                                                                                                  \
                                                                                                                        \
-    size_t offset = saved_operand_stack_top;                                                                           \
     assert(method->is_static() == (object == nullptr));                                                                \
     if (!method->is_static()) {                                                                                        \
-        thread->stack.memory[offset] = Value(Reference{object});                                                       \
-        ++offset;                                                                                                      \
+        thread->stack.memory[saved_operand_stack_top] = Value(Reference{object});                                      \
     }                                                                                                                  \
                                                                                                                        \
-    MethodDescriptorParts parts{method->descriptor_index->value.c_str()};                                              \
-    for (; !parts->is_return; ++parts) {                                                                               \
-        thread->stack.memory[offset] = NextArg;                                                                        \
-        offset += parts->category;                                                                                     \
+    for (auto const &parameter : method->signature.parameters) {                                                       \
+        thread->stack.memory[saved_operand_stack_top + parameter.slot] = NextArg;                                      \
     }                                                                                                                  \
                                                                                                                        \
     result = interpret(*thread, method);                                                                               \
@@ -464,9 +561,9 @@ static jint Name(JNIEnv *env, jclass java_class, bool is_virtual,
 }                                                                                                                      \
 
 
-CALL_HELPER(call, const jvalue *, Value((s8) args->j); ++args)
+CALL_HELPER(call, const jvalue *, argument_value(parameter.type, *args++))
 
-CALL_HELPER(call_v, va_list, (Value((s8) va_arg(args, jvalue).j)))
+CALL_HELPER(call_v, va_list, argument_value(parameter.type, args))
 
 #undef CALL_HELPER
 
@@ -582,17 +679,19 @@ jfieldID GetStaticFieldID(JNIEnv *env, jclass clazz, const char *name, const cha
  * SetStaticTypeField
  */
 
-#define FIELD(JavaType, Name, Variant, CppType)                                                                        \
+#define INSTANCE_FIELD(JavaType, Name)                                                                                 \
 JavaType Get##Name##Field(JNIEnv *, jobject obj, jfieldID fieldID) {                                                   \
     LOG("Get" #Name "Field");                                                                                          \
-    size_t index = ((field_info *) fieldID)->index;                                                                    \
-    return (JavaType) Reference{obj}.data<Value>()[index].Variant;                                                     \
+    size_t offset = ((field_info *) fieldID)->offset;                                                                  \
+    return *Reference{obj}.element_at_offset<JavaType>(offset);                                                        \
 }                                                                                                                      \
 void Set##Name##Field(JNIEnv *, jobject obj, jfieldID fieldID, JavaType val) {                                         \
     LOG("Set" #Name "Field");                                                                                          \
-    size_t index = ((field_info *) fieldID)->index;                                                                    \
-    Reference{obj}.data<Value>()[index].Variant = (CppType) val;                                                       \
+    size_t offset = ((field_info *) fieldID)->offset;                                                                  \
+    *Reference{obj}.element_at_offset<JavaType>(offset) = val;                                                         \
 }                                                                                                                      \
+
+#define STATIC_FIELD(JavaType, Name, Variant, CppType)                                                                 \
 JavaType GetStatic##Name##Field(JNIEnv *, jclass clazz, jfieldID fieldID) {                                            \
     LOG("GetStatic" #Name "Field");                                                                                    \
     size_t index = ((field_info *) fieldID)->index;                                                                    \
@@ -604,8 +703,24 @@ void SetStatic##Name##Field(JNIEnv *, jclass clazz, jfieldID fieldID, JavaType v
     ((ClassFile *) clazz)->static_field_values[index].Variant = (CppType) val;                                         \
 }                                                                                                                      \
 
+#define FIELD(JavaType, Name, Variant, CppType)                                                                        \
+INSTANCE_FIELD(JavaType, Name)                                                                                         \
+STATIC_FIELD(JavaType, Name, Variant, CppType)
+
+// references in objects might be compressed
+jobject GetObjectField(JNIEnv *, jobject obj, jfieldID fieldID) {
+    LOG("GetObjectField");
+    size_t offset = ((field_info *) fieldID)->offset;
+    return (jobject) static_cast<Reference>(*Reference{obj}.element_at_offset<StoredReference>(offset)).memory;
+}
 
-FIELD(jobject, Object, reference.memory, void *)
+void SetObjectField(JNIEnv *, jobject obj, jfieldID fieldID, jobject val) {
+    LOG("SetObjectField");
+    size_t offset = ((field_info *) fieldID)->offset;
+    *Reference{obj}.element_at_offset<StoredReference>(offset) = Reference{val};
+}
+
+STATIC_FIELD(jobject, Object, reference.memory, void *)
 
 FIELD(jboolean, Boolean, s4, u1);
 
@@ -623,6 +738,8 @@ FIELD(jfloat, Float, float_, float);
 
 FIELD(jdouble, Double, double_, double);
 #undef FIELD
+#undef STATIC_FIELD
+#undef INSTANCE_FIELD
 
 jmethodID GetStaticMethodID(JNIEnv *env, jclass clazz, const char *name, const char *sig) {
     LOG("GetStaticMethodID");
@@ -709,30 +826,32 @@ jsize GetArrayLength
         (JNIEnv *env, jarray array) {
     LOG("GetArrayLength");
     auto ref = Reference{array};
-    return ref.object()->length;
+    return ref.array()->length;
 }
 
 jobjectArray NewObjectArray
         (JNIEnv *env, jsize len, jclass clazz, jobject init) {
     LOG("NewObjectArray");
     ClassFile *array_class = BootstrapClassLoader::get().load(((ClassFile *) clazz)->as_array_element());
-    auto array = Heap::get().new_array<Reference>(array_class, len);
+    auto array = Heap::get().new_array<StoredReference>(array_class, len);
     for (s4 i = 0; i < len; ++i) {
-        array.data<Reference>()[i] = Reference{init};
+        array.data<StoredReference>()[i] = Reference{init};
     }
     return reinterpret_cast<jobjectArray>(array.memory);
 }
 
 jobject GetObjectArrayElement
         (JNIEnv *env, jobjectArray array, jsize index) {
-    UNIMPLEMENTED("GetObjectArrayElement");
+    LOG("GetObjectArrayElement");
+    auto ref = Reference{array};
+    return (jobject) static_cast<Reference>(ref.data<StoredReference>()[index]).memory;
 }
 
 void SetObjectArrayElement
         (JNIEnv *env, jobjectArray array, jsize index, jobject val) {
     LOG("SetObjectArrayElement");
     auto ref = Reference{array};
-    ref.data<Reference>()[index] = Reference{val};
+    ref.data<StoredReference>()[index] = Reference{val};
 }
 
 jbooleanArray NewBooleanArray
@@ -966,7 +1085,7 @@ jint RegisterNatives
             return JNI_ERR;
         }
 
-        method_iter->native_function = NativeFunction{&*method_iter, ptr};
+        method_iter->native_function = java_class->loader_data->add_native_function(&*method_iter, ptr);
     }
     return JNI_OK;
 }
@@ -36,13 +36,13 @@ JVM_AreNestMates(JNIEnv *env, jclass current, jclass member) {
 JNIEXPORT void JNICALL
 JVM_InitializeFromArchive(JNIEnv *env, jclass cls) {
     LOG("JVM_InitializeFromArchive")
-    // TODO is this optional? can this just be a noop?
+    // The shared archive only contains class files, not heap objects, so the classes initialize themselves
 }
 
 JNIEXPORT jstring JNICALL
 JVM_InitClassName(JNIEnv *env, jclass cls) {
     auto *java_class = (ClassFile *) cls;
-    auto name = java_class->name();
+    std::string name{java_class->name()};
     std::replace(name.begin(), name.end(), '/', '.');
     auto ref = Heap::get().make_string(name);
     return (jstring) ref.memory;
@@ -77,10 +77,18 @@ JVM_IHashCode(JNIEnv *env, jobject obj) {
     auto ref = Reference{obj};
     if (ref == JAVA_NULL) {
         return 0;
-    } else {
-        // TODO does this have to be more elaborate?
-        return static_cast<jint>(reinterpret_cast<unsigned long>(ref.memory));
     }
+
+    // The hash is installed lazily in the object header. It doesn't depend on the address, so a collector
+    // that moves objects only has to copy the header.
+    auto *thread = static_cast<Thread *>(env->functions->reserved0);
+    return static_cast<jint>(ref.object()->hash_or_install([thread]() {
+        u4 hash;
+        do {
+            hash = thread->next_identity_hash() & (~0u >> Object::HASH_SHIFT);
+        } while (hash == 0);
+        return hash;
+    }));
 }
 
 JNIEXPORT void JNICALL
@@ -104,9 +112,9 @@ JVM_Clone(JNIEnv *env, jobject obj) {
     LOG("JVM_Clone");
     auto original = Reference{obj};
 
-    if (!original.object()->clazz->is_subclass_of(BootstrapClassLoader::constants().java_lang_Cloneable)) {
+    if (!original.object()->clazz()->is_subclass_of(BootstrapClassLoader::constants().java_lang_Cloneable)) {
         auto thread = reinterpret_cast<Thread *>(env->functions->reserved0);
-        throw_new(*thread, "java/lang/CloneNotSupportedException", original.object()->clazz->name().c_str());
+        throw_new(*thread, "java/lang/CloneNotSupportedException", std::string(original.object()->clazz()->name()).c_str());
         return nullptr;
     }
 
@@ -119,7 +127,9 @@ JVM_Clone(JNIEnv *env, jobject obj) {
  */
 JNIEXPORT jstring JNICALL
 JVM_InternString(JNIEnv *env, jstring str) {
-    UNIMPLEMENTED("JVM_InternString");
+    LOG("JVM_InternString");
+    auto ref = Heap::get().string_table.intern(Reference{str});
+    return (jstring) ref.memory;
 }
 
 /*
@@ -158,8 +168,8 @@ JVM_ArrayCopy(JNIEnv *env, jclass ignored, jobject src, jint src_pos,
         throw std::runtime_error("TODO NullPointerException");
     }
 
-    auto src_class = src_ref.object()->clazz;
-    auto dst_class = dst_ref.object()->clazz;
+    auto src_class = src_ref.object()->clazz();
+    auto dst_class = dst_ref.object()->clazz();
     auto src_is_primitive = src_class->name()[1] != 'L';
     auto dst_is_primitive = dst_class->name()[1] != 'L';
     if (!src_class->is_array() || !dst_class->is_array() || (src_is_primitive != dst_is_primitive) ||
@@ -170,8 +180,8 @@ JVM_ArrayCopy(JNIEnv *env, jclass ignored, jobject src, jint src_pos,
     }
 
 
-    auto src_length = src_ref.object()->length;
-    auto dst_length = dst_ref.object()->length;
+    auto src_length = src_ref.array()->length;
+    auto dst_length = dst_ref.array()->length;
 
     if (src_pos < 0 || dst_pos < 0 || length < 0 ||
         (src_pos + length > src_length) || (dst_pos + length > dst_length)) {
@@ -202,23 +212,27 @@ JVM_ArrayCopy(JNIEnv *env, jclass ignored, jobject src, jint src_pos,
             auto dst_element_type = dst_class->array_element_type;
             size_t compatible_prefix_length = length_u;
             for (size_t i = 0; i < length_u; i++) {
-                const auto &from = src_ref.data<Value>()[static_cast<size_t>(src_pos) + i];
-                const auto &from_clazz = from.reference.object()->clazz;
+                Reference from = src_ref.data<StoredReference>()[static_cast<size_t>(src_pos) + i];
+                if (from == JAVA_NULL) {
+                    continue;
+                }
+                const auto &from_clazz = from.object()->clazz();
                 if (!(from_clazz == dst_element_type || from_clazz->is_subclass_of(dst_element_type))) {
                     // not assignable
                     compatible_prefix_length = i;
                     break;
                 }
             }
-            memmove(dst_ref.data<Value>() + dst_pos, src_ref.data<Value>() + src_pos,
-                    compatible_prefix_length * sizeof(Value));
+            memmove(dst_ref.data<StoredReference>() + dst_pos, src_ref.data<StoredReference>() + src_pos,
+                    compatible_prefix_length * sizeof(StoredReference));
             if (compatible_prefix_length != length_u) {
                 // TODO ArrayStoreException
                 throw std::runtime_error("TODO ArrayStoreException");
             }
         } else {
             // all objects in the (src) array are compatible with themselves (dst)
-            memmove(dst_ref.data<Value>() + dst_pos, src_ref.data<Value>() + src_pos, length_u * sizeof(Value));
+            memmove(dst_ref.data<StoredReference>() + dst_pos, src_ref.data<StoredReference>() + src_pos,
+                    length_u * sizeof(StoredReference));
         }
     }
 }
@@ -230,7 +244,7 @@ JVM_InitProperties(JNIEnv *env, jobject properties) {
 
     auto ref = Reference{properties};
 
-    jmethodID method = env->GetMethodID(reinterpret_cast<jclass>(ref.object()->clazz), "put",
+    jmethodID method = env->GetMethodID(reinterpret_cast<jclass>(ref.object()->clazz()), "put",
                                         "(Ljava/lang/Object;Ljava/lang/Object;)Ljava/lang/Object;");
     assert(method);
 
@@ -261,13 +275,35 @@ JVM_Halt(jint code) {
     UNIMPLEMENTED("JVM_Halt");
 }
 
+// Set by JVM_StartThread, see Reference.<clinit>
+static bool reference_handler_started = false;
+
 JNIEXPORT void JNICALL
 JVM_GC(void) {
     LOG("JVM_GC");
     std::vector<Thread *> threads{&this_thread};
     [[maybe_unused]] size_t deleted = Heap::get().garbage_collection(threads);
 //    std::cerr << "GC delteted " << deleted << " objects\n";
-    assert(Heap::get().garbage_collection(threads) == 0);
+    // NOTE: A second collection is not necessarily a no-op anymore, it can clear soft references that were kept alive.
+
+    auto &heap = Heap::get();
+    {
+        std::lock_guard lock(heap.reference_pending_list_lock);
+        if (heap.reference_pending_list == JAVA_NULL) {
+            return;
+        }
+    }
+    heap.reference_pending_list_condition_variable.notify_all();
+
+    // TODO Threads are not implemented, so the pending references are processed on this thread
+    //  instead of the Reference Handler thread
+    if (reference_handler_started) {
+        auto *reference = BootstrapClassLoader::get().load(Names::java_lang_ref_Reference);
+        auto *env = this_thread.jni_env;
+        jmethodID method = env->GetStaticMethodID((jclass) reference, "processPendingReferences", "()V");
+        assert(method);
+        env->CallStaticVoidMethod((jclass) reference, method);
+    }
 }
 
 /* Returns the number of real-time milliseconds that have elapsed since the
@@ -391,6 +427,12 @@ JVM_MoreStackWalk(JNIEnv *env, jobject stackStream, jlong mode, jlong anchor,
  */
 JNIEXPORT void JNICALL
 JVM_StartThread(JNIEnv *env, jobject thread) {
+    LOG("JVM_StartThread");
+    // The Reference Handler only waits for the pending list, JVM_GC does its work instead
+    if (reinterpret_cast<Object *>(thread)->clazz()->name() == "java/lang/ref/Reference$ReferenceHandler") {
+        reference_handler_started = true;
+        return;
+    }
     UNIMPLEMENTED("JVM_StartThread");
 }
 
@@ -504,17 +546,30 @@ JVM_GetSystemPackages(JNIEnv *env) {
  */
 JNIEXPORT jobject JNICALL
 JVM_GetAndClearReferencePendingList(JNIEnv *env) {
-    UNIMPLEMENTED("JVM_GetAndClearReferencePendingList");
+    LOG("JVM_GetAndClearReferencePendingList");
+    auto &heap = Heap::get();
+    std::lock_guard lock(heap.reference_pending_list_lock);
+    auto result = heap.reference_pending_list;
+    heap.reference_pending_list = JAVA_NULL;
+    return reinterpret_cast<jobject>(result.memory);
 }
 
 JNIEXPORT jboolean JNICALL
 JVM_HasReferencePendingList(JNIEnv *env) {
-    UNIMPLEMENTED("JVM_HasReferencePendingList");
+    LOG("JVM_HasReferencePendingList");
+    auto &heap = Heap::get();
+    std::lock_guard lock(heap.reference_pending_list_lock);
+    return heap.reference_pending_list != JAVA_NULL;
 }
 
 JNIEXPORT void JNICALL
 JVM_WaitForReferencePendingList(JNIEnv *env) {
-    UNIMPLEMENTED("JVM_WaitForReferencePendingList");
+    LOG("JVM_WaitForReferencePendingList");
+    auto &heap = Heap::get();
+    std::unique_lock lock(heap.reference_pending_list_lock);
+    heap.reference_pending_list_condition_variable.wait(lock, [&heap] {
+        return heap.reference_pending_list != JAVA_NULL;
+    });
 }
 
 /*
@@ -580,7 +635,8 @@ JVM_NewArray(JNIEnv *env, jclass eltClass, jint length) {
         array_class = BootstrapClassLoader::get().load(element_class->as_array_element());
     }
 
-    auto reference = Heap::get().new_array<Reference>(array_class, length);
+    size_t size = array_class->offset_of_array_after_header + array_class->element_size * static_cast<size_t>(length);
+    auto reference = Heap::get().allocate_array(array_class, size, length);
     return reinterpret_cast<jobject>(reference.memory);
 }
 
@@ -4,44 +4,17 @@
 #include <locale>
 #include <codecvt>
 
+#include <unistd.h>
+
 #include "args.hpp"
 #include "classloading.hpp"
 #include "jni.h"
 #include "jvm.h"
 #include "interpreter.hpp"
+#include "server.hpp"
 
-int main(int argc, char *argv[]) {
-    std::optional<Arguments> arguments = parse_args(argc, argv);
-    if (!arguments) {
-        return 23;
-    }
-
-    JavaVMInitArgs args;
-    args.version = JNI_VERSION_10;
-    if (JNI_GetDefaultJavaVMInitArgs(&args) != JNI_OK) {
-        throw std::runtime_error("faield to get default options");
-    }
-
-    // TODO
-    assert(args.options == nullptr);
-    JavaVMOption hack[10];
-    args.options = hack;
-    std::string bootclasspath{"-Xbootclasspath:../jdk/exploded-modules/java.base"};
-    hack[0].optionString = bootclasspath.data();
-    std::string classpath = "-Djava.class.path=" + arguments->classpath;
-    hack[1].optionString = classpath.data();
-    std::string javahome = "-Xjavahome:" + arguments->java_home;
-    hack[2].optionString = javahome.data();
-    args.nOptions = 3;
-
-    JavaVM *pvm = nullptr;
-    JNIEnv *penv = nullptr;
-    jint status = JNI_CreateJavaVM(&pvm, (void **) &penv, &args);
-    if (status != JNI_OK) {
-        return status;
-    }
-
-    jclass main_class = JVM_FindClassFromBootLoader(penv, arguments->mainclass.c_str());
+int run_main(JavaVM *pvm, JNIEnv *penv, std::string const &mainclass, std::vector<std::string> const &remaining) {
+    jclass main_class = JVM_FindClassFromBootLoader(penv, mainclass.c_str());
     if (main_class == nullptr) {
         pvm->DestroyJavaVM();
         throw std::runtime_error("mainclass was not found");
@@ -52,15 +25,15 @@ int main(int argc, char *argv[]) {
         pvm->DestroyJavaVM();
         throw std::runtime_error("Couldn't find main method");
     }
-    auto args_array = penv->NewObjectArray(static_cast<jsize>(arguments->remaining.size()),
+    auto args_array = penv->NewObjectArray(static_cast<jsize>(remaining.size()),
                                            reinterpret_cast<jclass>(BootstrapClassLoader::constants().java_lang_String),
                                            nullptr);
     if (penv->ExceptionCheck()) {
         pvm->DestroyJavaVM();
         throw std::runtime_error("Couldn't find create args array");
     }
-    for (size_t i = 0; i < arguments->remaining.size(); i++) {
-        const auto &str = arguments->remaining[i];
+    for (size_t i = 0; i < remaining.size(); i++) {
+        const auto &str = remaining[i];
         auto str_utf16 = std::wstring_convert<std::codecvt_utf8_utf16<char16_t>, char16_t>{}.from_bytes(str);
         auto str_obj = penv->NewString(reinterpret_cast<const jchar *>(str_utf16.c_str()),
                                        static_cast<jsize>(str_utf16.length()));
@@ -95,3 +68,87 @@ int main(int argc, char *argv[]) {
     pvm->DestroyJavaVM();
     return exit;
 }
+
+// The JDK of the server was booted in the server's working directory
+static void set_user_dir(JNIEnv *penv, std::string const &working_directory) {
+    auto *directory = penv->NewStringUTF(working_directory.c_str());
+    auto *system = penv->FindClass("java/lang/System");
+    auto *set_property = penv->GetStaticMethodID(system, "setProperty",
+                                                 "(Ljava/lang/String;Ljava/lang/String;)Ljava/lang/String;");
+    penv->CallStaticObjectMethod(system, set_property, penv->NewStringUTF("user.dir"), directory);
+
+    // java.io.UnixFileSystem resolves relative paths against its own copy of user.dir. If java.io.File is not
+    // initialized yet, it reads the property above.
+    auto *file = penv->FindClass("java/io/File");
+    auto *file_system = penv->GetStaticObjectField(file, penv->GetStaticFieldID(file, "fs", "Ljava/io/FileSystem;"));
+    if (file_system != nullptr) {
+        auto *user_dir = penv->GetFieldID(penv->GetObjectClass(file_system), "userDir", "Ljava/lang/String;");
+        penv->SetObjectField(file_system, user_dir, directory);
+    }
+    if (penv->ExceptionCheck()) {
+        throw std::runtime_error("Couldn't set user.dir");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    std::optional<Arguments> arguments = parse_args(argc, argv);
+    if (!arguments) {
+        return 23;
+    }
+
+    if (!arguments->connect_socket.empty()) {
+        ServerRequest request{std::filesystem::current_path().string(), absolute_classpath(arguments->classpath),
+                              arguments->mainclass, arguments->remaining, {}};
+        for (char **variable = environ; *variable != nullptr; ++variable) {
+            request.environment.emplace_back(*variable);
+        }
+        return run_on_server(arguments->connect_socket, request);
+    }
+    if (!arguments->server_socket.empty()) {
+        // The forks run in the working directory of the client
+        arguments->java_home = std::filesystem::absolute(arguments->java_home).string();
+        arguments->classpath = absolute_classpath(arguments->classpath);
+    }
+
+    JavaVMInitArgs args;
+    args.version = JNI_VERSION_10;
+    if (JNI_GetDefaultJavaVMInitArgs(&args) != JNI_OK) {
+        throw std::runtime_error("faield to get default options");
+    }
+
+    // TODO
+    assert(args.options == nullptr);
+    std::vector<JavaVMOption> hack(3);
+    std::string bootclasspath = "-Xbootclasspath:" + arguments->java_home + "/lib/modules";
+    hack[0].optionString = bootclasspath.data();
+    std::string classpath = "-Djava.class.path=" + arguments->classpath;
+    hack[1].optionString = classpath.data();
+    std::string javahome = "-Xjavahome:" + arguments->java_home;
+    hack[2].optionString = javahome.data();
+    for (auto &option : arguments->vm_options) {
+        hack.push_back(JavaVMOption{option.data(), nullptr});
+    }
+    args.options = hack.data();
+    args.nOptions = static_cast<jint>(hack.size());
+
+    JavaVM *pvm = nullptr;
+    JNIEnv *penv = nullptr;
+    jint status = JNI_CreateJavaVM(&pvm, (void **) &penv, &args);
+    if (status != JNI_OK) {
+        return status;
+    }
+
+    if (!arguments->server_socket.empty()) {
+        // Only the forking thread would survive in the children
+        BootstrapClassLoader::get().stop_preloading();
+        // System.getenv() reads the environment of the fork, java.lang.ProcessEnvironment is not initialized by booting
+        serve(arguments->server_socket, arguments->classpath, [pvm, penv](ServerRequest const &request) {
+            set_user_dir(penv, request.working_directory);
+            static_cast<Thread *>(penv->functions->reserved0)->reseed_identity_hash();
+            return run_main(pvm, penv, request.mainclass, request.arguments);
+        });
+    }
+
+    return run_main(pvm, penv, arguments->mainclass, arguments->remaining);
+}
+
@@ -1,126 +1,424 @@
 #include "memory.hpp"
 
+#include <array>
+#include <chrono>
 #include <codecvt>
 #include <iostream>
 #include <locale>
 #include <queue>
 #include <unordered_set>
 
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "classfile.hpp"
 #include "classloading.hpp"
 #include "string.hpp"
 #include "interpreter.hpp"
+#include "utf8.hpp"
 
 Heap Heap::the_heap;
 
+HeapRegion::~HeapRegion() {
+    if (base != nullptr) {
+        munmap(base, reserved_size);
+    }
+}
+
+void HeapRegion::reserve() {
+    // The pages are only backed by physical memory once they are touched
+    void *memory = mmap(nullptr, reserved_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                        -1, 0);
+    if (memory == MAP_FAILED) {
+        throw std::runtime_error("Failed to reserve the heap");
+    }
+    base = static_cast<char *>(memory);
+    top = base + alignment;
+    end = base + reserved_size;
+}
+
+void *HeapRegion::allocate(size_t size) {
+    if (base == nullptr) {
+        reserve();
+    }
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (auto free_list = free_lists.find(size); free_list != free_lists.end() && !free_list->second.empty()) {
+        void *result = free_list->second.back();
+        free_list->second.pop_back();
+        return result;
+    }
+
+    if (size > static_cast<size_t>(end - top)) {
+        // TODO OutOfMemoryError
+        throw std::runtime_error("TODO OutOfMemoryError");
+    }
+    void *result = top;
+    top += size;
+    return result;
+}
+
+void HeapRegion::free(void *pointer, size_t size) {
+    assert(contains(pointer));
+    size = (size + alignment - 1) & ~(alignment - 1);
+    free_lists[size].push_back(pointer);
+}
+
+void Heap::ClassDeleter::operator()(ClassFile *clazz) {
+    clazz->~ClassFile();
+    Heap::get().region.free(clazz, sizeof(ClassFile));
+}
+
 Reference Heap::clone(Reference const &original) {
-    auto clazz = original.object()->clazz;
-    auto copy = allocate_array(original.object()->clazz,
+    auto clazz = original.object()->clazz();
+    if (!clazz->is_array()) {
+        auto copy = allocate_object(clazz, clazz->instance_size);
+        memcpy(reinterpret_cast<char *>(copy.memory) + sizeof(Object),
+               reinterpret_cast<char *>(original.memory) + sizeof(Object),
+               clazz->instance_size - sizeof(Object));
+        return copy;
+    }
+
+    auto length = original.array()->length;
+    auto copy = allocate_array(clazz,
                                clazz->offset_of_array_after_header +
-                               clazz->element_size * static_cast<size_t>(original.object()->length),
-                               original.object()->length);
+                               clazz->element_size * static_cast<size_t>(length),
+                               length);
 
     memcpy(reinterpret_cast<char *>(copy.memory) + clazz->offset_of_array_after_header,
            reinterpret_cast<char *>(original.memory) + clazz->offset_of_array_after_header,
-           clazz->element_size * static_cast<size_t>(original.object()->length));
+           clazz->element_size * static_cast<size_t>(length));
     return copy;
 }
 
 Reference Heap::new_instance(ClassFile *clazz) {
-    return allocate_array<Value>(clazz, (s4) clazz->total_instance_field_count);
+    assert(clazz->resolved);
+    return allocate_object(clazz, clazz->instance_size);
 }
 
-Reference Heap::allocate_array(ClassFile *clazz, size_t total_size, s4 length) {
-    assert(length >= 0);
-    std::unique_ptr<void, OperatorDeleter> pointer(operator new(total_size));
+Reference Heap::allocate_object(ClassFile *clazz, size_t total_size) {
+    void *memory = region.allocate(total_size);
 
     // TODO is this good enough to initialize all primitive java fields?
     // from cppreference calloc: Initialization to all bits zero does not guarantee that a floating-point or a pointer would be initialized to 0.0 and the null pointer value, respectively (although that is true on all common platforms)
-    memset(pointer.get(), 0, total_size);
+    memset(memory, 0, total_size);
 
-    Reference reference{pointer.get()};
-    auto *object = reference.object();
-    object->clazz = clazz;
-    object->length = length;
+    Reference reference{memory};
+    reference.object()->class_index = clazz->class_table_index;
 
-    allocations.push_back(std::move(pointer));
+    allocations.push_back({reference.object(), total_size});
+    used_bytes += total_size;
 
     return reference;
 }
 
+Reference Heap::allocate_array(ClassFile *clazz, size_t total_size, s4 length) {
+    assert(length >= 0);
+    assert(total_size >= sizeof(Array));
+    auto reference = allocate_object(clazz, total_size);
+    reference.array()->length = length;
+    return reference;
+}
+
+
+Reference Heap::make_string(Reference value, s1 coder) {
+    auto const &constants = BootstrapClassLoader::constants();
+    auto reference = new_instance(constants.java_lang_String);
+    *reference.element_at_offset<StoredReference>(constants.java_lang_String_value) = value;
+    JavaString{reference}.coder() = coder;
+    return reference;
+}
 
 Reference Heap::make_string(std::u16string_view const &string_utf16) {
+    auto *byte_array = BootstrapClassLoader::primitive(Primitive::Byte).array;
+
+    auto const *chars = reinterpret_cast<u2 const *>(string_utf16.data());
+    if (utf8::latin1_prefix(chars, string_utf16.size()) == string_utf16.size()) {
+        auto value = new_array<u1>(byte_array, static_cast<s4>(string_utf16.size()));
+        utf8::narrow(chars, string_utf16.size(), value.data<u1>());
+        return make_string(value, JavaString::Latin);
+    }
+
     size_t string_utf16_length = string_utf16.size() * sizeof(char16_t);
+    auto value = new_array<u1>(byte_array, static_cast<s4>(string_utf16_length));
+    std::memcpy(value.data<u1>(), string_utf16.data(), string_utf16_length);
+    return make_string(value, JavaString::Utf16);
+}
 
-    auto charArray = new_array<u1>(BootstrapClassLoader::primitive(Primitive::Byte).array,
-                                   static_cast<s4>(string_utf16_length));
-    std::memcpy(charArray.data<u1>(), string_utf16.data(), string_utf16_length);
+namespace {
+// Calls `consumer` with every UTF-16 char of the string
+template<typename Consumer>
+void decode_modified_utf8(std::string_view modified_utf8, Consumer consumer) {
+    for (size_t i = 0; i < modified_utf8.length(); ++i) {
+        u1 x = static_cast<u1>(modified_utf8[i]);
+
+        if ((x & 0b10000000) == 0) { // copy 1 byte over
+            assert(x != 0);
+            consumer(static_cast<u2>(x));
+        } else if ((x & 0b11100000) == 0b11000000) { // copy 2 byte over
+            u1 y = static_cast<u1>(modified_utf8[++i]);
+            consumer(static_cast<u2>(((x & 0x1f) << 6) + (y & 0x3f)));
+        } else if ((x & 0b11110000) == 0b11100000) { // copy 3 byte over
+            u1 y = static_cast<u1>(modified_utf8[++i]);
+            u1 z = static_cast<u1>(modified_utf8[++i]);
+            consumer(static_cast<u2>(((x & 0xf) << 12) + ((y & 0x3f) << 6) + (z & 0x3f)));
+        } else {
+            throw std::runtime_error("Invalid byte in modified utf8 string: " + std::to_string((int) x));
+        }
+    }
+}
+}
 
-    auto *string_clazz = BootstrapClassLoader::constants().java_lang_String;
-    [[maybe_unused]] auto const &value_field = string_clazz->fields[0];
-    assert(value_field.name_index->value == "value" && value_field.descriptor_index->value == "[B");
-    [[maybe_unused]] auto const &coder_field = string_clazz->fields[1];
-    assert(coder_field.name_index->value == "coder" && coder_field.descriptor_index->value == "B");
+// The chars are decoded directly into the value array of the string, which is compressed (JavaString::Latin)
+// if possible.
+Reference Heap::make_string(std::string_view modified_utf8) {
+    auto *byte_array = BootstrapClassLoader::primitive(Primitive::Byte).array;
+
+    // ASCII is the same in modified UTF-8 and Latin-1, only the rest has to be decoded
+    auto const *bytes = reinterpret_cast<u1 const *>(modified_utf8.data());
+    size_t ascii = utf8::ascii_prefix(bytes, modified_utf8.size());
+    auto rest = modified_utf8.substr(ascii);
+
+    size_t length = ascii;
+    bool latin = true;
+    decode_modified_utf8(rest, [&length, &latin](u2 c) {
+        ++length;
+        latin &= c <= 0xFF;
+    });
 
-    auto reference = new_instance(string_clazz);
-    reference.data<Value>()[0] = Value{charArray};
-    JavaString{reference}.coder() = JavaString::Utf16;
+    if (latin) {
+        auto value = new_array<u1>(byte_array, static_cast<s4>(length));
+        std::memcpy(value.data<u1>(), bytes, ascii);
+        decode_modified_utf8(rest, [data = value.data<u1>() + ascii](u2 c) mutable {
+            *data++ = static_cast<u1>(c);
+        });
+        return make_string(value, JavaString::Latin);
+    }
 
-    return reference;
+    auto value = new_array<u1>(byte_array, static_cast<s4>(length * sizeof(u2)));
+    utf8::widen(bytes, ascii, reinterpret_cast<u2 *>(value.data<u1>()));
+    decode_modified_utf8(rest, [data = value.data<u1>() + ascii * sizeof(u2)](u2 c) mutable {
+        std::memcpy(data, &c, sizeof(c));
+        data += sizeof(c);
+    });
+    return make_string(value, JavaString::Utf16);
 }
 
-Reference Heap::make_string(std::string const &modified_utf8) {
-    std::u16string string_utf16;
-    string_utf16.reserve(modified_utf8.size());
-    {
-        for (size_t i = 0; i < modified_utf8.length(); ++i) {
-            u1 x = static_cast<u1>(modified_utf8[i]);
-
-            if ((x & 0b10000000) == 0) { // copy 1 byte over
-                assert(x != 0);
-                string_utf16.push_back(x);
-            } else if ((x & 0b11100000) == 0b11000000) { // copy 2 byte over
-                u1 y = static_cast<u1>(modified_utf8[++i]);
-                string_utf16.push_back(static_cast<u2>(((x & 0x1f) << 6) + (y & 0x3f)));
-            } else if ((x & 0b11110000) == 0b11100000) { // copy 3 byte over
-                u1 y = static_cast<u1>(modified_utf8[++i]);
-                u1 z = static_cast<u1>(modified_utf8[++i]);
-                string_utf16.push_back(static_cast<u2>(((x & 0xf) << 12) + ((y & 0x3f) << 6) + (z & 0x3f)));
-            } else {
-                throw std::runtime_error("Invalid byte in modified utf8 string: " + std::to_string((int) x));
-            }
+Reference Heap::load_string(CONSTANT_String_info &info) {
+    // NOTE: Racing threads store the same string
+    if (info.java_string == JAVA_NULL) {
+        info.java_string = string_table.intern(make_string(info.string->value));
+    }
+    return info.java_string;
+}
+
+StringKey::StringKey(s1 coder, std::basic_string_view<u1> bytes) : coder(coder), bytes(bytes), hash(0) {
+    // FNV-1a over the chars, so that the hash does not depend on the coder
+    auto add = [this](u2 c) {
+        hash = (hash ^ c) * 0x100000001b3;
+    };
+    hash = 0xcbf29ce484222325;
+    if (coder == JavaString::Latin) {
+        for (u1 c : bytes) {
+            add(c);
+        }
+    } else {
+        for (size_t i = 0; i + 1 < bytes.size(); i += 2) {
+            u2 c;
+            std::memcpy(&c, &bytes[i], sizeof(c));
+            add(c);
         }
     }
+}
 
-    auto reference = make_string(string_utf16);
-    interned_strings[modified_utf8] = reference;
-    return reference;
+StringKey::StringKey(JavaString string)
+        : StringKey(string.coder(), {string.value().data<u1>(), static_cast<size_t>(string.array_length())}) {}
+
+bool StringKey::operator==(StringKey const &other) const {
+    if (hash != other.hash) {
+        return false;
+    }
+    if (coder == other.coder) {
+        return bytes == other.bytes;
+    }
+
+    auto const &latin = coder == JavaString::Latin ? *this : other;
+    auto const &utf16 = coder == JavaString::Latin ? other : *this;
+    if (utf16.bytes.size() != latin.bytes.size() * 2) {
+        return false;
+    }
+    for (size_t i = 0; i < latin.bytes.size(); ++i) {
+        u2 c;
+        std::memcpy(&c, &utf16.bytes[i * 2], sizeof(c));
+        if (c != latin.bytes[i]) {
+            return false;
+        }
+    }
+    return true;
 }
 
-Reference Heap::load_string(CONSTANT_Utf8_info *data) {
-    const std::string &modified_utf8 = data->value;
-    if (interned_strings.contains(modified_utf8)) {
-        return interned_strings.at(modified_utf8);
+Reference StringTable::intern(Reference string) {
+    StringKey key(JavaString{string});
+    auto &stripe = stripes[key.hash % stripe_count];
+    std::lock_guard lock(stripe.lock);
+    return stripe.strings.emplace(key, string).first->second;
+}
+
+bool StringTable::contains(Reference string) {
+    StringKey key(JavaString{string});
+    auto &stripe = stripes[key.hash % stripe_count];
+    std::lock_guard lock(stripe.lock);
+    auto entry = stripe.strings.find(key);
+    return entry != stripe.strings.end() && entry->second == string;
+}
+
+void StringTable::remove_unmarked(bool unmarked) {
+    for (auto &stripe : stripes) {
+        std::lock_guard lock(stripe.lock);
+        std::erase_if(stripe.strings, [unmarked](auto const &entry) {
+            return entry.second.object()->gc_bit() == unmarked;
+        });
     }
+}
 
-    auto reference = make_string(modified_utf8);
-    interned_strings[modified_utf8] = reference;
+ClassLoaderData::~ClassLoaderData() = default;
 
-    return reference;
+void *ClassLoaderData::ChunkResource::do_allocate(size_t bytes, size_t alignment) {
+    reserved_bytes += bytes;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void ClassLoaderData::ChunkResource::do_deallocate(void *pointer, size_t bytes, size_t alignment) {
+    reserved_bytes -= bytes;
+    std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+}
+
+NativeFunction *ClassLoaderData::add_native_function(method_info *method, void *function_pointer) {
+    std::lock_guard lock(native_functions_lock);
+    return native_functions.emplace_back(std::make_unique<NativeFunction>(method, function_pointer)).get();
+}
+
+std::string_view ClassLoaderData::store_string(std::string_view string) {
+    auto *data = reinterpret_cast<char *>(allocate_bytes(string.size()));
+    std::memcpy(data, string.data(), string.size());
+    return {data, string.size()};
+}
+
+u1 *ClassLoaderData::allocate_bytes(size_t size) {
+    std::lock_guard lock(arena_lock);
+    return static_cast<u1 *>(arena.allocate(size, 1));
+}
+
+void *ClassLoaderData::ParseBuffer::ArenaChunks::do_allocate(size_t bytes, size_t alignment) {
+    std::lock_guard lock(loader_data.arena_lock);
+    return loader_data.arena.allocate(bytes, alignment);
+}
+
+void *ClassLoaderData::ParseBuffer::do_allocate(size_t bytes, size_t alignment) {
+    std::lock_guard guard(lock);
+    return buffer.allocate(bytes, alignment);
+}
+
+ClassLoaderData::ParseScope::ParseScope(ClassLoaderData &loader_data) : loader_data(loader_data),
+                                                                        previous(current_metadata_resource) {
+    {
+        std::lock_guard lock(loader_data.arena_lock);
+        if (loader_data.m_free_parse_buffers.empty()) {
+            buffer = loader_data.m_parse_buffers.emplace_back(std::make_unique<ParseBuffer>(loader_data)).get();
+        } else {
+            buffer = loader_data.m_free_parse_buffers.back();
+            loader_data.m_free_parse_buffers.pop_back();
+        }
+    }
+    current_metadata_resource = buffer;
+}
+
+ClassLoaderData::ParseScope::~ParseScope() {
+    current_metadata_resource = previous;
+    std::lock_guard lock(loader_data.arena_lock);
+    loader_data.m_free_parse_buffers.push_back(buffer);
+}
+
+ClassLoaderData &Heap::class_loader_data(Reference loader) {
+    std::lock_guard lock(metadata_lock);
+    for (auto const &loader_data : class_loaders) {
+        if (loader_data->loader == loader) {
+            return *loader_data;
+        }
+    }
+    return *class_loaders.emplace_back(std::make_unique<ClassLoaderData>(loader));
+}
+
+ClassFile *Heap::allocate_class(ClassLoaderData &loader_data) {
+    // NOTE: The arena is always locked before the metadata
+    ClassLoaderData::Scope scope{loader_data};
+    return add_class(loader_data, ClassFile());
 }
 
-ClassFile *Heap::allocate_class() {
-    classes.push_back(std::make_unique<ClassFile>());
-    auto *result = classes[classes.size() - 1].get();
+ClassFile *Heap::add_class(ClassLoaderData &loader_data, ClassFile &&parsed) {
+    std::lock_guard lock(metadata_lock);
+    if (class_table.capacity() < max_classes) {
+        // The first class is loaded before there are other threads
+        class_table.reserve(max_classes);
+    }
+    if (class_table.size() == max_classes) {
+        throw std::runtime_error("TODO the class table is full");
+    }
+    auto *result = new(region.allocate(sizeof(ClassFile))) ClassFile(std::move(parsed));
+    result->loader_data = &loader_data;
+    for (auto &field : result->fields) {
+        field.clazz = result;
+    }
+    for (auto &method : result->methods) {
+        method.clazz = result;
+    }
+    classes.push_back(std::unique_ptr<ClassFile, ClassDeleter>(result));
+    result->class_table_index = static_cast<u4>(class_table.size());
+    class_table.push_back(result);
     // NOTE: Classes that are loaded before the constant is initalized need to be patched later
-    result->header.clazz = BootstrapClassLoader::constants().java_lang_Class;
+    if (auto *java_lang_Class = BootstrapClassLoader::constants().java_lang_Class; java_lang_Class != nullptr) {
+        result->header.class_index = java_lang_Class->class_table_index;
+    }
     return result;
 }
 
+void Heap::print_metaspace_statistics(std::ostream &out) {
+    size_t total_classes = 0;
+    size_t total_bytes = 0;
+    for (auto const &loader_data : class_loaders) {
+        size_t class_count = 0;
+        size_t method_count = 0;
+        for (auto const &clazz : classes) {
+            if (clazz->loader_data == loader_data.get()) {
+                ++class_count;
+                method_count += clazz->methods.size();
+            }
+        }
+        size_t native_bytes = loader_data->native_functions.size() * sizeof(NativeFunction);
+        size_t bytes = class_count * sizeof(ClassFile) + loader_data->chunks.reserved_bytes + native_bytes;
+
+        out << "Metaspace of "
+            << (loader_data->loader == JAVA_NULL ? std::string("the bootstrap class loader")
+                                                 : Reference{loader_data->loader}.object()->clazz()->name())
+            << ": " << class_count << " classes, " << method_count << " methods, "
+            << class_count * sizeof(ClassFile) << " bytes in ClassFile objects (" << sizeof(ClassFile) << " each), "
+            << loader_data->chunks.reserved_bytes << " bytes in the arena, "
+            << native_bytes << " bytes of native bindings\n";
+
+        total_classes += class_count;
+        total_bytes += bytes;
+    }
+    out << "Metaspace: " << total_classes << " classes, " << total_bytes << " bytes";
+    if (total_classes != 0) {
+        out << ", " << total_bytes / total_classes << " bytes per class";
+    }
+    out << " (method_info: " << sizeof(method_info) << ", field_info: " << sizeof(field_info)
+        << ", attribute_info: " << sizeof(attribute_info) << ", cp_info: " << sizeof(cp_info) << " bytes)\n";
+}
+
 bool Heap::all_objects_are_unmarked() {
     for (const auto &item : allocations) {
-        Reference reference{item.get()};
-        if (reference.object()->gc_bit() != gc_bit_unmarked) {
+        if (item.object->gc_bit() != gc_bit_unmarked) {
             return false;
         }
     }
@@ -133,12 +431,51 @@ bool Heap::all_objects_are_unmarked() {
 }
 
 namespace {
-void mark_recursively(std::queue<Object *> &queue, bool gc_bit_marked, Reference to_mark,
-                      std::unordered_set<Object *> const &all_object_pointers) {
-    auto enqueue = [&queue, gc_bit_marked, &all_object_pointers](Reference reference) {
+// Like HotSpot's LRUMaxHeapPolicy: A softly reachable referent is kept alive if it was accessed within the last
+// second per free megabyte of the maximum heap size (-XX:SoftRefLRUPolicyMSPerMB).
+constexpr s8 soft_reference_ms_per_free_mb = 1000;
+
+// Like the default of HotSpot: a quarter of the physical memory
+size_t max_heap_size() {
+    auto pages = sysconf(_SC_PHYS_PAGES);
+    auto page_size = sysconf(_SC_PAGE_SIZE);
+    if (pages <= 0 || page_size <= 0) {
+        return HeapRegion::reserved_size;
+    }
+    return std::min(static_cast<size_t>(pages) * static_cast<size_t>(page_size) / 4, HeapRegion::reserved_size);
+}
+
+struct Marker {
+    bool gc_bit_marked;
+    std::unordered_set<Object *> const &all_object_pointers;
+    Heap::ReferenceFields const &reference_fields;
+
+    // If false, the referents of java.lang.ref.Reference objects are marked like every other field
+    bool discover_references = true;
+    // java.lang.ref.Reference objects whose referent was not marked through them, indexed by ReferenceKind
+    std::array<std::vector<Object *>, 5> discovered{};
+
+    std::queue<Object *> queue{};
+
+    [[nodiscard]] bool is_marked(Reference reference) const {
+        return reference.object()->gc_bit() == gc_bit_marked;
+    }
+
+    [[nodiscard]] StoredReference &field(Object *object, size_t offset) const {
+        return *Reference{object}.element_at_offset<StoredReference>(offset);
+    }
+
+    // References that are pending or already enqueued (next != null) are no longer active
+    [[nodiscard]] bool is_discoverable(Object *object) const {
+        Reference referent = field(object, reference_fields.referent);
+        Reference next = field(object, reference_fields.next);
+        Reference discovered = field(object, reference_fields.discovered);
+        return referent != JAVA_NULL && !is_marked(referent) && next == JAVA_NULL && discovered == JAVA_NULL;
+    }
+
+    void enqueue(Reference reference) {
         if (reference != JAVA_NULL) {
             Object *object = reference.object();
-            (void) all_object_pointers;
             assert(all_object_pointers.contains(object));
             // ensure that every object is added at most once
             if (object->gc_bit() != gc_bit_marked) {
@@ -146,131 +483,301 @@ void mark_recursively(std::queue<Object *> &queue, bool gc_bit_marked, Reference
                 queue.push(object);
             }
         }
-    };
+    }
 
-    enqueue(to_mark);
+    void mark_recursively(Reference to_mark) {
+        enqueue(to_mark);
 
-    while (!queue.empty()) {
-        Object *object = queue.front();
-        queue.pop();
+        while (!queue.empty()) {
+            Object *object = queue.front();
+            queue.pop();
 
-        ClassFile *clazz = object->clazz;
-        enqueue(Reference{clazz});
+            ClassFile *clazz = object->clazz();
+            enqueue(Reference{clazz});
 
-        // Mark fields of instances and array elements.
-        // Keep in mind that classes are also instances that have fields.
-        if (!clazz->is_array()) {
-            // TODO we might have to initializes more classes
-            assert(clazz->resolved);
+            // Mark fields of instances and array elements.
+            // Keep in mind that classes are also instances that have fields.
+            if (!clazz->is_array()) {
+                // TODO we might have to initializes more classes
+                assert(clazz->resolved);
 
-            // we only need to check superclasses because interfaces don't have instance fields
-            for (ClassFile *current = clazz; current != nullptr; current = current->super_class) {
-                for (const auto &field : current->fields) {
-                    if (!field.is_static() && field.is_reference_type()) {
-                        enqueue(Reference{object}.data<Value>()[field.index].reference);
+                bool discover = discover_references && clazz->reference_kind != ReferenceKind::None &&
+                                is_discoverable(object);
+                if (discover) {
+                    discovered[static_cast<size_t>(clazz->reference_kind)].push_back(object);
+                }
+
+                // this includes the fields of superclasses
+                for (size_t offset : clazz->reference_field_offsets) {
+                    if (!discover || offset != reference_fields.referent) {
+                        enqueue(field(object, offset));
                     }
                 }
+            } else if (!clazz->array_element_type->is_primitive()) {
+                for (s4 i = 0; i < reinterpret_cast<Array *>(object)->length; ++i) {
+                    enqueue(Reference{object}.data<StoredReference>()[i]);
+                }
             }
-        } else if (!clazz->array_element_type->is_primitive()) {
-            for (s4 i = 0; i < object->length; ++i) {
-                enqueue(Reference{object}.data<Reference>()[i]);
+
+            // Classes are also objects. When they are marked we also need to
+            // enqueue references that are stored in their C++ representation:
+            if (clazz->name() == Names::java_lang_Class) {
+                auto class_instance = reinterpret_cast<ClassFile *> (object);
+
+                // A class loader is alive as long as any of its classes is, see Heap::sweep
+                if (class_instance->loader_data != nullptr) {
+                    enqueue(class_instance->loader_data->loader);
+                }
+
+                // TODO this would not be necessary if classloaders keep a list of loaded clases
+                enqueue(Reference{class_instance->super_class});
+                for (const auto &item : class_instance->interfaces) {
+                    enqueue(Reference{item->clazz});
+                }
+
+                // resolved classes can have static variables:
+                if (class_instance->resolved) {
+                    for (const auto &static_field : class_instance->fields) {
+                        if (static_field.is_static() && static_field.is_reference_type()) {
+                            enqueue(class_instance->static_field_values[static_field.index].reference);
+                        }
+                    }
+                }
+
+                // strings that were loaded by ldc
+                for (const auto &entry : class_instance->constant_pool.table) {
+                    if (auto *string = std::get_if<CONSTANT_String_info>(&entry.variant)) {
+                        enqueue(string->java_string);
+                    }
+                }
+
+                // TODO check if ClassFile references any other objects
             }
         }
+    }
+};
 
-        // Classes are also objects. When they are marked we also need to
-        // enqueue references that are stored in their C++ representation:
-        if (clazz->name() == Names::java_lang_Class) {
-            auto class_instance = reinterpret_cast<ClassFile *> (object);
+// Called after everything that is strongly reachable has been marked. Referents that are kept alive can
+// discover further references, which is why the lists are iterated by index.
+void process_references(Marker &marker, Heap &heap) {
+    auto const &fields = heap.reference_fields;
+    auto &lists = marker.discovered;
+    auto referent_of = [&marker, &fields](Object *object) -> StoredReference & {
+        return marker.field(object, fields.referent);
+    };
+    auto make_pending = [&marker, &fields, &heap](Object *object) {
+        marker.field(object, fields.discovered) = heap.reference_pending_list;
+        heap.reference_pending_list = Reference{object};
+    };
 
-            // TODO this would not be necessary if classloaders keep a list of loaded clases
-            enqueue(Reference{class_instance->super_class});
-            for (const auto &item : class_instance->interfaces) {
-                enqueue(Reference{item->clazz});
+    auto &soft = lists[static_cast<size_t>(ReferenceKind::Soft)];
+    if (!soft.empty()) {
+        s8 clock = fields.soft_clock->s8;
+        size_t max_size = max_heap_size();
+        size_t free_size = max_size - std::min(max_size, heap.used_bytes);
+        s8 max_interval = static_cast<s8>(free_size / (1024 * 1024)) * soft_reference_ms_per_free_mb;
+        for (size_t i = 0; i < soft.size(); ++i) {
+            Reference referent = referent_of(soft[i]);
+            s8 timestamp = *Reference{soft[i]}.element_at_offset<s8>(fields.soft_timestamp);
+            if (!marker.is_marked(referent) && clock - timestamp <= max_interval) {
+                marker.mark_recursively(referent);
             }
+        }
+    }
 
-            // resolved classes can have static variables:
-            if (class_instance->resolved) {
-                for (const auto &field : class_instance->fields) {
-                    if (field.is_static() && field.is_reference_type()) {
-                        enqueue(class_instance->static_field_values[field.index].reference);
-                    }
-                }
+    // Referents that are neither strongly nor (kept) softly reachable
+    for (auto kind : {ReferenceKind::Soft, ReferenceKind::Weak}) {
+        for (Object *reference : lists[static_cast<size_t>(kind)]) {
+            if (!marker.is_marked(referent_of(reference))) {
+                referent_of(reference) = JAVA_NULL;
+                make_pending(reference);
             }
+        }
+    }
 
-            // TODO check if ClassFile references any other objects (e.g. inside constant pool entries)
+    // Finalizable objects (and everything they reference) are resurrected until the finalizer has run
+    marker.discover_references = false;
+    for (Object *reference : lists[static_cast<size_t>(ReferenceKind::Final)]) {
+        if (!marker.is_marked(referent_of(reference))) {
+            marker.mark_recursively(referent_of(reference));
+            make_pending(reference);
         }
     }
-};
+
+    for (Object *reference : lists[static_cast<size_t>(ReferenceKind::Phantom)]) {
+        if (!marker.is_marked(referent_of(reference))) {
+            referent_of(reference) = JAVA_NULL;
+            make_pending(reference);
+        }
+    }
+
+    // SoftReference.get() stores the clock as the timestamp of the last access
+    if (fields.soft_clock != nullptr) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        fields.soft_clock->s8 = std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
+    }
+}
 }
 
 // TODO we do not handle references (pointers) in native code!
 void Heap::mark(std::vector<Thread *> &threads, bool gc_bit_marked) {
-    auto is_potential_pointer = [](void *pointer) {
+    auto is_potential_pointer = [this](void *pointer) {
         auto value = reinterpret_cast<std::uintptr_t>(pointer);
-        return value != 0 && (value % alignof(std::max_align_t)) == 0;
+        return region.contains(pointer) && (value % HeapRegion::alignment) == 0;
     };
 
     // Build a hashmap of all known allocations to determine out which
     // values on the operand stack and in local variables are pointers.
-    // TODO statically determine the types instead (see StackMapTable Attribute)
+    // The types of the local variables of verified methods are known (see MethodTypeMap). The operand stacks of the
+    // parent frames are still scanned conservatively: their arguments have become the local variables of the callee.
     std::unordered_set<Object *> all_object_pointers;
     for (const auto &clazz : classes) {
         auto *object = reinterpret_cast<Object *>(clazz.get());
         assert(is_potential_pointer(object));
-        assert(object->clazz == BootstrapClassLoader::constants().java_lang_Class);
+        assert(object->clazz() == BootstrapClassLoader::constants().java_lang_Class);
         all_object_pointers.insert(object);
     }
     for (const auto &allocation : allocations) {
-        auto *object = reinterpret_cast<Object *>(allocation.get());
+        auto *object = allocation.object;
         assert(is_potential_pointer(object));
-        assert(object->clazz != BootstrapClassLoader::constants().java_lang_Class);
+        assert(object->clazz() != BootstrapClassLoader::constants().java_lang_Class);
         all_object_pointers.insert(object);
     }
 
-    std::queue<Object *> queue;
+    Marker marker{gc_bit_marked, all_object_pointers, reference_fields};
+
+    // References that have not been handed to the Reference Handler yet must not be discovered again
+    marker.discover_references = false;
+    marker.mark_recursively(reference_pending_list);
+    marker.discover_references = true;
 
-    // we don't free classes for now so they are always in the root set
+    // Classes of the bootstrap class loader are never unloaded, so they are always in the root set.
+    // The other classes are reachable through their class loader or their instances.
     for (const auto &clazz : classes) {
-        mark_recursively(queue, gc_bit_marked, Reference{clazz.get()}, all_object_pointers);
+        if (clazz->loader_data == nullptr || clazz->loader_data->loader == JAVA_NULL) {
+            marker.mark_recursively(Reference{clazz.get()});
+        }
     }
 
     for (const auto &thread : threads) {
-        mark_recursively(queue, gc_bit_marked, thread->current_exception, all_object_pointers);
-        mark_recursively(queue, gc_bit_marked, thread->thread_object, all_object_pointers);
+        marker.mark_recursively(thread->current_exception);
+        marker.mark_recursively(thread->thread_object);
 
         for (const auto &frame : thread->stack.frames) {
-            for (const auto &value : frame.locals) {
-                if (is_potential_pointer(value.reference.memory) &&
-                    all_object_pointers.contains(value.reference.object())) {
-                    mark_recursively(queue, gc_bit_marked, value.reference, all_object_pointers);
+            MethodTypeMap::Entry const *types = nullptr;
+            if (frame.method != nullptr && frame.method->code_attribute != nullptr) {
+                types = frame.method->code_attribute->type_map.at(frame.pc);
+            }
+            if (types != nullptr) {
+                auto const &type_map = frame.method->code_attribute->type_map;
+                for (size_t i = 0; i < frame.locals.size(); ++i) {
+                    auto type = type_map.types[types->offset + i];
+                    if (type == VerificationType::Reference || type == VerificationType::UninitializedThis ||
+                        type == VerificationType::Uninitialized) {
+                        marker.mark_recursively(frame.locals[i].reference);
+                    }
+                }
+            } else {
+                for (const auto &value : frame.locals) {
+                    if (is_potential_pointer(value.reference.memory) &&
+                        all_object_pointers.contains(value.reference.object())) {
+                        marker.mark_recursively(value.reference);
+                    }
                 }
             }
             for (const auto &value : frame.operands.subspan(0, frame.operands_top)) {
                 if (is_potential_pointer(value.reference.memory) &&
                     all_object_pointers.contains(value.reference.object())) {
-                    mark_recursively(queue, gc_bit_marked, value.reference, all_object_pointers);
+                    marker.mark_recursively(value.reference);
                 }
             }
         }
     }
+
+    process_references(marker, *this);
+}
+
+// Like G1's string deduplication: Live strings that were allocated since the last collection are made to share their
+// value array with an equal string. The arrays that are not used anymore are freed by the next collection.
+void Heap::deduplicate_strings(bool gc_bit_marked) {
+    auto const &constants = BootstrapClassLoader::constants();
+    for (size_t i = deduplication_index; i < allocations.size(); ++i) {
+        Object *object = allocations[i].object;
+        if (object->gc_bit() != gc_bit_marked || object->clazz() != constants.java_lang_String) {
+            continue;
+        }
+        auto &value = *Reference{object}.element_at_offset<StoredReference>(constants.java_lang_String_value);
+        // the constructor might not have run yet
+        if (static_cast<Reference>(value) == JAVA_NULL) {
+            continue;
+        }
+        // The key of the string table refers to the bytes of the array, it has to stay alive
+        if (string_table.contains(Reference{object})) {
+            continue;
+        }
+        JavaString string{Reference{object}};
+        auto coder = static_cast<size_t>(string.coder());
+        if (coder >= deduplication_tables.size()) {
+            continue;
+        }
+
+        auto &table = deduplication_tables[coder];
+        auto [entry, inserted] = table.emplace(StringKey(string), value);
+        if (inserted) {
+            continue;
+        }
+
+        Reference canonical = entry->second;
+        if (canonical.object()->gc_bit() != gc_bit_marked) {
+            // The array is garbage, this one takes its place. The key refers to the bytes of the array.
+            table.erase(entry);
+            table.emplace(StringKey(string), value);
+        } else {
+            value = canonical;
+        }
+    }
 }
 
 size_t Heap::sweep(bool unmarked) {
-    std::erase_if(interned_strings, [unmarked](auto const &a) {
-        return a.second.object()->gc_bit() == unmarked;
-    });
+    string_table.remove_unmarked(unmarked);
+    for (auto &table : deduplication_tables) {
+        std::erase_if(table, [unmarked](auto const &entry) {
+            return entry.second.object()->gc_bit() == unmarked;
+        });
+    }
 
-    size_t erased = std::erase_if(allocations, [unmarked](auto const &a) {
-        Reference reference{a.get()};
-        return reference.object()->gc_bit() == unmarked;
+    // The Java objects of unreachable class loaders are freed below, so they are found first. Their arenas are only
+    // freed at the end, after their classes.
+    auto reachable = [unmarked](auto const &loader_data) {
+        return loader_data->loader == JAVA_NULL || loader_data->loader.object()->gc_bit() != unmarked;
+    };
+    auto unreachable = std::stable_partition(class_loaders.begin(), class_loaders.end(), reachable);
+    decltype(class_loaders) unreachable_loaders(std::make_move_iterator(unreachable),
+                                                std::make_move_iterator(class_loaders.end()));
+    class_loaders.erase(unreachable, class_loaders.end());
+
+    size_t erased = std::erase_if(allocations, [this, unmarked](Allocation const &a) {
+        if (a.object->gc_bit() == unmarked) {
+            region.free(a.object, a.size);
+            used_bytes -= a.size;
+            return true;
+        }
+        return false;
     });
 
-    erased += std::erase_if(classes, [unmarked](auto const &a) {
-        // TODO we don't free classes for now
-        assert(a->header.gc_bit() != unmarked);
-        return a->header.gc_bit() == unmarked;
+    // Class unloading: There are no instances of unmarked classes left, so their slot in the class table is not
+    // needed anymore
+    erased += std::erase_if(classes, [this, unmarked](auto const &clazz) {
+        if (clazz->header.gc_bit() == unmarked) {
+            class_table[clazz->class_table_index] = nullptr;
+            return true;
+        }
+        return false;
     });
 
+    // The classes of an unreachable class loader were unloaded above, the metadata is freed with the arena
+    unreachable_loaders.clear();
+
     return erased;
 }
 
@@ -280,7 +787,12 @@ size_t Heap::garbage_collection(std::vector<Thread *> &threads) {
 
     mark(threads, !gc_bit_unmarked);
 
+    if (string_deduplication) {
+        deduplicate_strings(!gc_bit_unmarked);
+    }
+
     size_t deleted = sweep(gc_bit_unmarked);
+    deduplication_index = allocations.size();
 
     gc_bit_unmarked = !gc_bit_unmarked;
 
@@ -2,17 +2,26 @@
 #define SCHOKOVM_MEMORY_HPP
 
 #include <cstddef>
+#include <array>
+#include <atomic>
 #include <memory>
+#include <memory_resource>
+#include <iosfwd>
+#include <mutex>
+#include <condition_variable>
 #include <cassert>
 #include <vector>
 #include <unordered_map>
 #include <string>
+#include <string_view>
 
 #include "future.hpp"
 #include "types.hpp"
 
 struct Object;
+struct Array;
 struct ClassFile;
+struct JavaString;
 
 template<class Header, class Element>
 consteval size_t offset_of_array_after_header() {
@@ -33,16 +42,20 @@ struct Reference {
         return static_cast<Object *>(memory);
     }
 
+    [[nodiscard]] inline Array *array() const {
+        return static_cast<Array *>(memory);
+    }
+
     template<typename Element>
     [[nodiscard]] inline Element *element_at_offset(size_t offset) const {
         return static_cast<Element *>(static_cast<void *>((static_cast<char *>(memory) + offset)));
     }
 
-    // For instances Element=Value
     // For arrays Element=s1,s2,s4,s8,Object*
+    // Instance fields are accessed with element_at_offset, see field_info::offset
     template<typename Element>
     [[nodiscard]] inline Element *data() const {
-        return element_at_offset<Element>(offset_of_array_after_header<Object, Element>());
+        return element_at_offset<Element>(offset_of_array_after_header<Array, Element>());
     }
 };
 
@@ -80,14 +93,20 @@ union Value {
 
 // NOTE: If this struct contains padding at the end we will *not* use it for fields/elemetns.
 struct Object {
-    ClassFile *clazz;
+    // Index into Heap::class_table, see ClassFile::class_table_index
+    u4 class_index;
     u4 flags;
-    s4 length;
 
     enum Flags : u4 {
         GC_BIT = 1,
+        // TODO reserved for locking, monitors are not implemented yet
+        LOCK_BITS = 0b110,
+        // The remaining bits store the identity hash. Zero means that no hash has been installed yet.
+        HASH_SHIFT = 3,
     };
 
+    [[nodiscard]] inline ClassFile *clazz() const;
+
     [[nodiscard]] bool gc_bit() const {
         return (flags & GC_BIT) != 0;
     }
@@ -99,22 +118,325 @@ struct Object {
             flags &= ~GC_BIT;
         }
     }
+
+    [[nodiscard]] u4 hash() const {
+        return flags >> HASH_SHIFT;
+    }
+
+    // Only the lower 32 - HASH_SHIFT bits of the value are stored
+    void hash(u4 value) {
+        flags = (flags & ((1u << HASH_SHIFT) - 1)) | (value << HASH_SHIFT);
+    }
+
+    // Returns the installed hash. If there is none yet, the one from `generate` is installed with a compare and swap,
+    // so all threads get the hash that was installed first and the other bits of `flags` are kept.
+    template<typename Generate>
+    u4 hash_or_install(Generate generate) {
+        std::atomic_ref<u4> atomic_flags{flags};
+        u4 current = atomic_flags.load(std::memory_order_relaxed);
+        if ((current >> HASH_SHIFT) != 0) {
+            return current >> HASH_SHIFT;
+        }
+        u4 value = generate() << HASH_SHIFT;
+        while ((current >> HASH_SHIFT) == 0) {
+            if (atomic_flags.compare_exchange_weak(current, (current & ((1u << HASH_SHIFT) - 1)) | value,
+                                                   std::memory_order_relaxed)) {
+                return value >> HASH_SHIFT;
+            }
+        }
+        return current >> HASH_SHIFT;
+    }
+};
+
+// Arrays are the only objects that store a length
+struct Array {
+    Object header;
+    s4 length;
+};
+
+struct CONSTANT_String_info;
+
+// All objects (including classes) are allocated inside of one contiguous reservation of virtual memory.
+// This allows us to store references as 32-bit offsets, see StoredReference.
+// Freed blocks are kept in free lists and reused for allocations of the same size.
+struct HeapRegion {
+    // Every allocation is aligned to this
+    static constexpr size_t alignment = 8;
+    // The maximum distance that a 32-bit offset scaled by the alignment can express
+    static constexpr size_t reserved_size = (size_t{1} << 32) * alignment;
+
+    HeapRegion() = default;
+
+    HeapRegion(HeapRegion const &) = delete;
+
+    HeapRegion &operator=(HeapRegion const &) = delete;
+
+    ~HeapRegion();
+
+    [[nodiscard]] void *allocate(size_t size);
+
+    void free(void *pointer, size_t size);
+
+    [[nodiscard]] inline bool contains(void const *pointer) const {
+        return pointer >= base && pointer < top;
+    }
+
+    // The first allocation starts after `alignment` bytes, so an offset of zero can be used for null.
+    char *base = nullptr;
+
+private:
+    char *top = nullptr;
+    char *end = nullptr;
+    std::unordered_map<size_t, std::vector<void *>> free_lists;
+
+    void reserve();
+};
+
+// The characters of a string in either coder (see JavaString::Kind). Strings that are equal in Java compare
+// equal, even if one of them is compressed.
+struct StringKey {
+    s1 coder;
+    std::basic_string_view<u1> bytes;
+    size_t hash;
+
+    StringKey(s1 coder, std::basic_string_view<u1> bytes);
+
+    explicit StringKey(JavaString string);
+
+    bool operator==(StringKey const &other) const;
+
+    struct Hash {
+        size_t operator()(StringKey const &key) const { return key.hash; }
+    };
+};
+
+// The memory resource that new class metadata is allocated from, see ClassLoaderData::Scope
+inline thread_local std::pmr::memory_resource *current_metadata_resource = nullptr;
+
+// Allocator of the containers inside of class metadata (see MetadataVector). Containers that are created while a
+// ClassLoaderData::Scope is active allocate from the arena of that class loader. Unlike
+// std::pmr::polymorphic_allocator the resource moves along with the contents of a container, so that metadata that is
+// built up by the parser and then assigned to a class stays in the arena.
+template<class T>
+struct MetadataAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+    using is_always_equal = std::false_type;
+
+    std::pmr::memory_resource *resource;
+
+    MetadataAllocator() : resource(current_metadata_resource != nullptr
+                                   ? current_metadata_resource
+                                   : std::pmr::new_delete_resource()) {}
+
+    template<class U>
+    MetadataAllocator(MetadataAllocator<U> const &other) : resource(other.resource) {}
+
+    [[nodiscard]] T *allocate(size_t n) {
+        return static_cast<T *>(resource->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, size_t n) {
+        resource->deallocate(pointer, n * sizeof(T), alignof(T));
+    }
+
+    // copies are created in the current scope
+    MetadataAllocator select_on_container_copy_construction() const { return {}; }
+
+    template<class U>
+    bool operator==(MetadataAllocator<U> const &other) const { return *resource == *other.resource; }
 };
 
-struct CONSTANT_Utf8_info;
+template<class T>
+using MetadataVector = std::vector<T, MetadataAllocator<T>>;
+
+// Like HotSpot's metaspace: The metadata of the classes of a class loader is allocated from one arena. When the class
+// loader is unreachable (and thereby all of its classes), the classes are unloaded and the arena is freed at once.
+struct ClassLoaderData {
+    explicit ClassLoaderData(Reference loader) : loader(loader) {}
+
+    ~ClassLoaderData();
+
+    // JAVA_NULL for the bootstrap class loader, its classes are never unloaded
+    Reference loader;
+
+    // Counts the bytes of the chunks of the arena, see Heap::print_metaspace_statistics
+    struct ChunkResource : std::pmr::memory_resource {
+        size_t reserved_bytes = 0;
+
+    private:
+        void *do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void *pointer, size_t bytes, size_t alignment) override;
+
+        [[nodiscard]] bool do_is_equal(memory_resource const &other) const noexcept override { return this == &other; }
+    };
+
+    // NOTE: This needs to be declared before the arena
+    ChunkResource chunks;
+    std::pmr::monotonic_buffer_resource arena{&chunks};
+
+    // Native binding data is rarely needed, so it is kept in this side table instead of in method_info
+    std::mutex native_functions_lock;
+    std::vector<std::unique_ptr<struct NativeFunction>> native_functions;
+
+    NativeFunction *add_native_function(struct method_info *method, void *function_pointer);
+
+    // The arena is not thread-safe, every use of it holds this lock (a Scope holds it as long as it is alive)
+    std::recursive_mutex arena_lock;
+
+    // Copies `string` into the arena, for metadata that is not borrowed from a class file
+    std::string_view store_string(std::string_view string);
+
+    // Uninitialized bytes in the arena, e.g. for class files
+    u1 *allocate_bytes(size_t size);
+
+    // Metadata that is created while the scope is alive is allocated in the arena
+    struct Scope {
+        explicit Scope(ClassLoaderData &loader_data) : lock(loader_data.arena_lock),
+                                                       previous(current_metadata_resource) {
+            current_metadata_resource = &loader_data.arena;
+        }
+
+        Scope(Scope const &) = delete;
+
+        Scope &operator=(Scope const &) = delete;
+
+        ~Scope() { current_metadata_resource = previous; }
+
+    private:
+        std::lock_guard<std::recursive_mutex> lock;
+        std::pmr::memory_resource *previous;
+    };
+
+    // A part of the arena that one class is parsed into, so that classes of the same loader can be parsed in
+    // parallel. It takes its chunks from the arena and has a lock of its own, because the containers that the parser
+    // created keep allocating from it after the class was published.
+    struct ParseBuffer : std::pmr::memory_resource {
+        explicit ParseBuffer(ClassLoaderData &loader_data) : chunks(loader_data) {}
+
+    private:
+        // Locks the arena for every chunk
+        struct ArenaChunks : std::pmr::memory_resource {
+            explicit ArenaChunks(ClassLoaderData &loader_data) : loader_data(loader_data) {}
+
+            ClassLoaderData &loader_data;
+
+        private:
+            void *do_allocate(size_t bytes, size_t alignment) override;
+
+            void do_deallocate(void *, size_t, size_t) override {}
+
+            [[nodiscard]] bool do_is_equal(memory_resource const &other) const noexcept override {
+                return this == &other;
+            }
+        };
+
+        std::mutex lock;
+        ArenaChunks chunks;
+        std::pmr::monotonic_buffer_resource buffer{&chunks};
+
+        void *do_allocate(size_t bytes, size_t alignment) override;
+
+        void do_deallocate(void *, size_t, size_t) override {}
+
+        [[nodiscard]] bool do_is_equal(memory_resource const &other) const noexcept override { return this == &other; }
+    };
+
+    // Like Scope, but the metadata is allocated from a parse buffer that no other thread uses at the same time. The
+    // arena lock is only held to take the buffer, to give it back and when the buffer needs a new chunk.
+    struct ParseScope {
+        explicit ParseScope(ClassLoaderData &loader_data);
+
+        ParseScope(ParseScope const &) = delete;
+
+        ParseScope &operator=(ParseScope const &) = delete;
+
+        ~ParseScope();
+
+    private:
+        ClassLoaderData &loader_data;
+        ParseBuffer *buffer;
+        std::pmr::memory_resource *previous;
+    };
+
+private:
+    // Guarded by the arena lock. The buffers are reused, there are only as many as classes were parsed at once.
+    std::vector<std::unique_ptr<ParseBuffer>> m_parse_buffers;
+    std::vector<ParseBuffer *> m_free_parse_buffers;
+};
+
+// Interned strings, keyed on the characters of the Java strings. The entries are weak, strings that are not reachable
+// anymore are removed by the garbage collector. The table is split into stripes that are locked independently.
+struct StringTable {
+    // Returns the interned string with the same characters, `string` itself is added if there is none yet
+    Reference intern(Reference string);
+
+    // Whether `string` itself is the interned string for its characters
+    bool contains(Reference string);
+
+    void remove_unmarked(bool unmarked);
+
+private:
+    struct Stripe {
+        std::mutex lock;
+        std::unordered_map<StringKey, Reference, StringKey::Hash> strings;
+    };
+
+    static constexpr size_t stripe_count = 16;
+    std::array<Stripe, stripe_count> stripes;
+};
 
 struct Heap {
     static inline Heap &get() { return the_heap; }
 
-    struct OperatorDeleter {
-        void operator()(void *pointer) {
-            operator delete(pointer);
-        }
+    struct Allocation {
+        Object *object;
+        size_t size;
     };
 
-    std::vector<std::unique_ptr<void, OperatorDeleter>> allocations;
-    std::vector<std::unique_ptr<ClassFile>> classes;
-    std::unordered_map<std::string, Reference> interned_strings;
+    struct ClassDeleter {
+        void operator()(ClassFile *clazz);
+    };
+
+    // NOTE: This needs to be declared before any of the containers with objects
+    HeapRegion region;
+
+    std::vector<Allocation> allocations;
+    // NOTE: This needs to be declared before `classes`, their metadata is allocated in the arenas
+    std::vector<std::unique_ptr<ClassLoaderData>> class_loaders;
+    std::vector<std::unique_ptr<ClassFile, ClassDeleter>> classes;
+    // Object headers store an index into this table instead of a pointer, the entries of unloaded classes are nullptr.
+    // Its capacity is reserved up front, so it can be read without a lock while classes are added.
+    static constexpr size_t max_classes = 1 << 20;
+    std::vector<ClassFile *> class_table;
+    // Guards class_loaders, classes and class_table against concurrent class loading
+    std::mutex metadata_lock;
+    StringTable string_table;
+
+    // -XX:+UseStringDeduplication, see deduplicate_strings
+    bool string_deduplication = false;
+
+    // Bytes that are currently used by allocations (excluding classes)
+    size_t used_bytes = 0;
+
+    // Layout of java.lang.ref.Reference and SoftReference, filled in when the classes are resolved
+    struct ReferenceFields {
+        size_t referent;
+        size_t next;
+        size_t discovered;
+        size_t soft_timestamp;
+        Value *soft_clock;
+    };
+    ReferenceFields reference_fields{};
+
+    // References that were cleared (or whose referents became finalizable) by the garbage collector,
+    // linked through Reference.discovered. They are handed to the Reference Handler, see JVM_GC.
+    Reference reference_pending_list = JAVA_NULL;
+    std::mutex reference_pending_list_lock;
+    std::condition_variable reference_pending_list_condition_variable;
 
     // Returns an object of the same class and structure (length), but doens't copy any data
     Reference clone(Reference const &object);
@@ -126,30 +448,55 @@ struct Heap {
         return allocate_array<Element>(clazz, length);
     }
 
+    Reference allocate_object(ClassFile *clazz, size_t total_size);
+
     Reference allocate_array(ClassFile *clazz, size_t total_size, s4 length);
 
     template<class Element>
     Reference allocate_array(ClassFile *clazz, s4 length) {
         assert(length >= 0);
-        size_t size = offset_of_array_after_header<Object, Element>() + static_cast<size_t>(length) * sizeof(Element);
+        size_t size = offset_of_array_after_header<Array, Element>() + static_cast<size_t>(length) * sizeof(Element);
         return allocate_array(clazz, size, length);
     }
 
-    Reference make_string(std::string const &modified_utf8);
+    Reference make_string(std::string_view modified_utf8);
 
     Reference make_string(std::u16string_view const &data);
 
-    Reference load_string(CONSTANT_Utf8_info *data);
+    // `value` is a byte[] in the encoding of `coder`, see JavaString::Kind
+    Reference make_string(Reference value, s1 coder);
+
+    // Returns the interned string of a constant, it is cached in the constant pool entry
+    Reference load_string(CONSTANT_String_info &info);
+
+    // `loader` is JAVA_NULL for the bootstrap class loader
+    ClassLoaderData &class_loader_data(Reference loader);
+
+    // The metadata of the class is allocated in the arena of `loader_data`
+    ClassFile *allocate_class(ClassLoaderData &loader_data);
 
-    ClassFile *allocate_class();
+    // Moves a class that was parsed outside of the heap (see ParsedClass) into it, its metadata stays where it is
+    ClassFile *add_class(ClassLoaderData &loader_data, ClassFile &&parsed);
 
     size_t garbage_collection(std::vector<struct Thread *> &threads);
 
+    // -XX:+PrintMetaspaceStatisticsAtExit, the bytes of class metadata per class loader
+    bool print_metaspace_statistics_at_exit = false;
+
+    void print_metaspace_statistics(std::ostream &out);
+
 private:
     static Heap the_heap;
 
     bool gc_bit_unmarked = false;
 
+    // The value arrays that strings are deduplicated to, one table per coder. The entries are weak.
+    std::array<std::unordered_map<StringKey, Reference, StringKey::Hash>, 2> deduplication_tables;
+    // Allocations before this index survived a collection and have already been deduplicated
+    size_t deduplication_index = 0;
+
+    void deduplicate_strings(bool gc_bit_marked);
+
     bool all_objects_are_unmarked();
 
     void mark(std::vector<struct Thread *> &threads, bool gc_bit_marked);
@@ -157,4 +504,51 @@ private:
     size_t sweep(bool unmarked);
 };
 
+inline ClassFile *Object::clazz() const {
+    return Heap::get().class_table[class_index];
+}
+
+#ifdef SCHOKOVM_COMPRESSED_REFERENCES
+
+// A reference that is stored inside of an object: the offset from the start of the heap region, divided by the
+// alignment. The stack and native code always use full References.
+struct NarrowReference {
+    u4 bits;
+
+    NarrowReference() = default;
+
+    // implicit so that it can be used like a Reference
+    NarrowReference(Reference reference) : bits(encode(reference)) {}
+
+    operator Reference() const { return decode(bits); }
+
+    bool operator==(const NarrowReference &rhs) const { return bits == rhs.bits; };
+
+    static inline u4 encode(Reference reference) {
+        if (reference == JAVA_NULL) {
+            return 0;
+        }
+        auto offset = static_cast<size_t>(static_cast<char *>(reference.memory) - Heap::get().region.base);
+        assert(offset % HeapRegion::alignment == 0 && offset < HeapRegion::reserved_size);
+        return static_cast<u4>(offset / HeapRegion::alignment);
+    }
+
+    static inline Reference decode(u4 bits) {
+        if (bits == 0) {
+            return JAVA_NULL;
+        }
+        return Reference{Heap::get().region.base + static_cast<size_t>(bits) * HeapRegion::alignment};
+    }
+};
+
+using StoredReference = NarrowReference;
+
+#else
+
+using StoredReference = Reference;
+
+#endif
+
+static_assert(sizeof(StoredReference) <= sizeof(Value));
+
 #endif //SCHOKOVM_MEMORY_HPP
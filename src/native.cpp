@@ -48,7 +48,7 @@ std::string get_jni_method_name(method_info *method, bool signature) {
     }
     if (signature) {
         result += "__";
-        MethodDescriptorParts parts{method->descriptor_index->value.c_str()};                                              \
+        MethodDescriptorParts parts{method->descriptor_index->value};                                                      \
         for (; !parts->is_return; ++parts) {
             for (char const c: parts->type_name) {
                 if (c == '_') result += "_1";
@@ -106,29 +106,20 @@ NativeFunction::NativeFunction(method_info *method, void *function_pointer) : m_
     m_argument_types.push_back(&ffi_type_pointer); // JNIEnv *env
     m_argument_types.push_back(&ffi_type_pointer); // jclass or jobject
 
-    ffi_type *return_type;
-    try {
-        u2 offset = 0;
-        if (!method->is_static()) {
-            m_argument_offsets.push_back(offset); // "this" is not included in the descriptor
-            ++offset;
-        }
-
-        MethodDescriptorParts parts{method->descriptor_index->value.c_str()};
-        for (; !parts->is_return; ++parts) {
-            ffi_type *t = ffi_type_from_char(parts->type_name[0]);
-            assert(t);
-            m_argument_types.push_back(t);
-            m_argument_offsets.push_back(offset);
-            offset += parts->category;
-        }
+    if (!method->is_static()) {
+        m_argument_offsets.push_back(0); // "this" is not included in the descriptor
+    }
 
-        return_type = ffi_type_from_char(parts->type_name[0]);
-        assert(return_type);
-    } catch (ParseError &e) {
-        abort();
+    for (auto const &parameter : method->signature.parameters) {
+        ffi_type *t = ffi_type_from_char(parameter.type);
+        assert(t);
+        m_argument_types.push_back(t);
+        m_argument_offsets.push_back(parameter.slot);
     }
 
+    ffi_type *return_type = ffi_type_from_char(method->signature.return_type);
+    assert(return_type);
+
     ffi_status status = ffi_prep_cif(
             &m_cif,
             FFI_DEFAULT_ABI,
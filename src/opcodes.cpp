@@ -0,0 +1,117 @@
+#include "opcodes.hpp"
+
+static s4 s4_at(std::span<u1 const> code, size_t index) {
+    return static_cast<s4>((static_cast<u4>(code[index]) << 24) | (static_cast<u4>(code[index + 1]) << 16) |
+                           (static_cast<u4>(code[index + 2]) << 8) | static_cast<u4>(code[index + 3]));
+}
+
+size_t instruction_length(std::span<u1 const> code, size_t bci) {
+    auto size = code.size();
+    switch (static_cast<OpCodes>(code[bci])) {
+        case OpCodes::bipush:
+        case OpCodes::ldc:
+        case OpCodes::iload:
+        case OpCodes::lload:
+        case OpCodes::fload:
+        case OpCodes::dload:
+        case OpCodes::aload:
+        case OpCodes::istore:
+        case OpCodes::lstore:
+        case OpCodes::fstore:
+        case OpCodes::dstore:
+        case OpCodes::astore:
+        case OpCodes::ret:
+        case OpCodes::newarray:
+            return 2;
+        case OpCodes::sipush:
+        case OpCodes::ldc_w:
+        case OpCodes::ldc2_w:
+        case OpCodes::iinc:
+        case OpCodes::ifeq:
+        case OpCodes::ifne:
+        case OpCodes::iflt:
+        case OpCodes::ifge:
+        case OpCodes::ifgt:
+        case OpCodes::ifle:
+        case OpCodes::if_icmpeq:
+        case OpCodes::if_icmpne:
+        case OpCodes::if_icmplt:
+        case OpCodes::if_icmpge:
+        case OpCodes::if_icmpgt:
+        case OpCodes::if_icmple:
+        case OpCodes::if_acmpeq:
+        case OpCodes::if_acmpne:
+        case OpCodes::goto_:
+        case OpCodes::jsr:
+        case OpCodes::getstatic:
+        case OpCodes::putstatic:
+        case OpCodes::getfield:
+        case OpCodes::putfield:
+        case OpCodes::invokevirtual:
+        case OpCodes::invokespecial:
+        case OpCodes::invokestatic:
+        case OpCodes::new_:
+        case OpCodes::anewarray:
+        case OpCodes::checkcast:
+        case OpCodes::instanceof:
+        case OpCodes::ifnull:
+        case OpCodes::ifnonnull:
+            return 3;
+        case OpCodes::multianewarray:
+            return 4;
+        case OpCodes::invokeinterface:
+        case OpCodes::invokedynamic:
+        case OpCodes::goto_w:
+        case OpCodes::jsr_w:
+            return 5;
+        case OpCodes::wide: {
+            if (bci + 1 >= size) {
+                return 0;
+            }
+            switch (static_cast<OpCodes>(code[bci + 1])) {
+                case OpCodes::iload:
+                case OpCodes::lload:
+                case OpCodes::fload:
+                case OpCodes::dload:
+                case OpCodes::aload:
+                case OpCodes::istore:
+                case OpCodes::lstore:
+                case OpCodes::fstore:
+                case OpCodes::dstore:
+                case OpCodes::astore:
+                case OpCodes::ret:
+                    return 4;
+                case OpCodes::iinc:
+                    return 6;
+                default:
+                    return 0;
+            }
+        }
+        case OpCodes::tableswitch: {
+            // 0-3 bytes of padding, so that the operands are aligned to 4 bytes
+            size_t operands = (bci + 4) & ~size_t{3};
+            if (operands + 12 > size) {
+                return 0;
+            }
+            s4 low = s4_at(code, operands + 4);
+            s4 high = s4_at(code, operands + 8);
+            if (low > high) {
+                return 0;
+            }
+            return operands + 12 + 4 * (static_cast<size_t>(static_cast<s8>(high) - low) + 1) - bci;
+        }
+        case OpCodes::lookupswitch: {
+            size_t operands = (bci + 4) & ~size_t{3};
+            if (operands + 8 > size) {
+                return 0;
+            }
+            s4 npairs = s4_at(code, operands + 4);
+            if (npairs < 0) {
+                return 0;
+            }
+            return operands + 8 + 8 * static_cast<size_t>(npairs) - bci;
+        }
+        default:
+            return code[bci] <= static_cast<u1>(OpCodes::jsr_w) ? 1 : 0;
+    }
+}
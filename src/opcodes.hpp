@@ -1,6 +1,8 @@
 #ifndef SCHOKOVM_OPCODES_HPP
 #define SCHOKOVM_OPCODES_HPP
 
+#include <span>
+
 #include "types.hpp"
 
 /** https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-7.html */
@@ -237,6 +239,31 @@ enum class OpCodes : u1 {
     breakpoint = 202,
     impdep1 = 254,
     impdep2 = 255,
+
+    // Superinstructions, not valid in class files. rewrite_superinstructions replaces the opcode of the first
+    // instruction of these sequences, the operands and the following instructions stay as they are.
+    // aload_0; getfield
+    aload_0_getfield = 203,
+    // iload <n> or iload_<n>; iload <n> or iload_<n>; iadd. The name says which load comes first.
+    iload_iload_iadd = 204,
+    iload_0_iload_iadd = 205,
+    iload_1_iload_iadd = 206,
+    iload_2_iload_iadd = 207,
+    iload_3_iload_iadd = 208,
+    // iload <n> or iload_<n>; iconst_<i> or bipush; if_icmp<cond>
+    iload_iconst_if_icmp = 209,
+    iload_0_iconst_if_icmp = 210,
+    iload_1_iconst_if_icmp = 211,
+    iload_2_iconst_if_icmp = 212,
+    iload_3_iconst_if_icmp = 213,
+    // new; dup; invokespecial
+    new_dup_invokespecial = 214,
+    // iinc; goto
+    iinc_goto = 215,
 };
 
+// The length in bytes of the instruction at `bci` including its operands, or 0 if it is not a valid instruction or
+// does not fit into `code`
+size_t instruction_length(std::span<u1 const> code, size_t bci);
+
 #endif //SCHOKOVM_OPCODES_HPP
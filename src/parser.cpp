@@ -5,7 +5,9 @@
 #include <sstream>
 #include <vector>
 #include <cstring>
+#include <mutex>
 #include "classfile.hpp"
+#include "utf8.hpp"
 
 ParseError::ParseError(std::string message) : message(std::move(message)) {}
 
@@ -13,15 +15,12 @@ const char *ParseError::what() const noexcept {
     return message.c_str();
 }
 
-Parser::Parser(std::istream &in) : in(in) {
-    // TODO How to handle errors?
-    // I think the following enables exceptions for all of these.
-    // Is this a good idea?
-    in.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
-}
+Parser::Parser(std::span<u1 const> bytes) : bytes(bytes), cursor(bytes.data()), end(bytes.data() + bytes.size()) {}
 
 void Parser::parse(ClassFile *memory) {
     ClassFile &result = *memory;
+    clazz = memory;
+    result.class_file_bytes = bytes;
     result.magic = eat_u4();
     if (result.magic != 0xCAFEBABE)
         throw ParseError("expected 0xCAFEBABE, not " + std::to_string(result.magic));
@@ -65,6 +64,7 @@ void Parser::parse(ClassFile *memory) {
     }
 
     u2 methods_count = eat_u2();
+    result.code_attributes.reserve(methods_count);
     for (int i = 0; i < methods_count; ++i) {
         method_info method_info{};
         method_info.clazz = memory;
@@ -74,11 +74,10 @@ void Parser::parse(ClassFile *memory) {
         method_info.attributes = parse_attributes(result.constant_pool);
 
         for (auto &attribute : method_info.attributes) {
-            Code_attribute *code = std::get_if<Code_attribute>(&attribute.variant);
-            if (code) {
+            if (auto *code = std::get_if<Code_attribute *>(&attribute.variant)) {
                 if (method_info.code_attribute)
                     throw ParseError("Method has two code attributes!");
-                method_info.code_attribute = code;
+                method_info.code_attribute = *code;
             }
         }
 
@@ -89,12 +88,17 @@ void Parser::parse(ClassFile *memory) {
         method_info.parameter_count = 0;
         method_info.stack_slots_for_parameters = method_info.is_static() ? 0 : 1;
 
-        MethodDescriptorParts parts{descriptor.c_str()};
+        MethodDescriptorParts parts{descriptor};
         for (; !parts->is_return; ++parts) {
             ++method_info.parameter_count;
+            method_info.signature.parameters.push_back({
+                    parts->array_dimensions > 0 ? 'L' : parts->type_name[0],
+                    method_info.stack_slots_for_parameters
+            });
             method_info.stack_slots_for_parameters += parts->category;
         }
         method_info.return_category = parts->category;
+        method_info.signature.return_type = parts->array_dimensions > 0 ? 'L' : parts->type_name[0];
 
         if (method_info.name_index->value == "<clinit>") {
             if (result.clinit_index >= 0)
@@ -111,22 +115,21 @@ void Parser::parse(ClassFile *memory) {
 
     result.attributes = parse_attributes(result.constant_pool);
 
-    in.exceptions(std::ios::goodbit);
-    u1 unexpected = eat_u1();
-    if (!in.eof())
-        throw ParseError("Expected EOF but got " + std::to_string((int) unexpected));
+    if (cursor != end)
+        throw ParseError("Expected EOF but got " + std::to_string((int) *cursor));
 }
 
-std::string Parser::eat_utf8_string(u4 length) {
-    std::string str;
-    str.resize(length); // not reserve
-    in.read(str.data(), length);
-    for (size_t i = 0; i < length; ++i) {
-        u1 byte = (u1) str[i];
-        if (byte == 0 || byte >= 0xf0)
-            throw ParseError("Invalid byte in utf8 string: " + std::to_string((int) byte));
+std::string_view Parser::eat_utf8_string(u4 length) {
+    require(length);
+    u1 const *data = cursor;
+    cursor += length;
+    if (!utf8::is_valid_modified_utf8(data, length)) {
+        for (size_t i = 0; i < length; ++i) {
+            if (data[i] == 0 || data[i] >= 0xf0)
+                throw ParseError("Invalid byte in utf8 string: " + std::to_string((int) data[i]));
+        }
     }
-    return str;
+    return {reinterpret_cast<char const *>(data), length};
 }
 
 ConstantPool Parser::parse_constant_pool(u2 major_version) {
@@ -312,165 +315,203 @@ ConstantPool Parser::parse_constant_pool(u2 major_version) {
         }
     }
 
+    result.resolved.resize(result.table.size());
+
     return result;
 }
 
 // TODO we probably do not want to store attributes as an array of structs.
 // For example attributes that only go on fields should be stored there as a member variable.
-std::vector<attribute_info> Parser::parse_attributes(ConstantPool &constant_pool) {
-    std::vector<attribute_info> result;
+// Everything else is only needed for reflection and debugging, see find_attribute
+static bool is_parsed_eagerly(std::string_view name) {
+    return name == "Code" || name == "ConstantValue" || name == "Exceptions" || name == "BootstrapMethods";
+}
+
+MetadataVector<attribute_info> Parser::parse_attributes(ConstantPool &constant_pool) {
+    MetadataVector<attribute_info> result;
 
     u2 attributes_count = eat_u2();
+    result.reserve(attributes_count);
 
     for (size_t attribute_index = 0; attribute_index < attributes_count; ++attribute_index) {
         attribute_info info;
         info.attribute_name_index = &check_cp_range_and_type<CONSTANT_Utf8_info>(constant_pool, eat_u2());
         info.attribute_length = eat_u4();
+        require(info.attribute_length);
+        info.bytes = cursor;
 
-        std::string const &s = info.attribute_name_index->value;
+        if (is_parsed_eagerly(info.attribute_name_index->value)) {
+            parse_attribute(constant_pool, info);
+        } else {
+            info.variant = Unparsed_attribute{};
+            cursor += info.attribute_length;
+        }
+        result.push_back(std::move(info));
+    }
 
-        if (s == "ConstantValue") {
-            // TODO: sometimes this info must be silently ignored
+    return result;
+}
 
-            if (info.attribute_length != 2) {
-                throw ParseError("ConstantValue length must be 2, not " + std::to_string(info.attribute_length));
-            }
+void Parser::parse_attribute(ConstantPool &constant_pool, attribute_info &info) {
+    std::string_view s = info.attribute_name_index->value;
 
-            ConstantValue_attribute attribute{};
-            attribute.constantvalue_index = eat_u2();
-            check_cp_range(attribute.constantvalue_index, constant_pool.table.size());
-            auto const &variant = constant_pool.table[attribute.constantvalue_index].variant;
-            if (std::holds_alternative<CONSTANT_Integer_info>(variant)
-                || std::holds_alternative<CONSTANT_Float_info>(variant)
-                || std::holds_alternative<CONSTANT_Long_info>(variant)
-                || std::holds_alternative<CONSTANT_Double_info>(variant)
-                || std::holds_alternative<CONSTANT_String_info>(variant)) {
-            } else {
-                throw ParseError("Unexpected type for constant pool entry of ConstantValue");
-            }
-            info.variant = attribute;
-        } else if (s == "Code") {
-            Code_attribute attribute;
-            attribute.max_stack = eat_u2();
-            attribute.max_locals = eat_u2();
-            u4 code_length = eat_u4();
-            attribute.code.resize(code_length);
-            in.read(reinterpret_cast<char *>(attribute.code.data()), code_length);
-
-            u2 exception_table_length = eat_u2();
-            attribute.exception_table.reserve(exception_table_length);
-            for (int i = 0; i < exception_table_length; ++i) {
-                ExceptionTableEntry entry{};
-                entry.start_pc = eat_u2();
-                entry.end_pc = eat_u2();
-                entry.handler_pc = eat_u2();
-                entry.catch_type = eat_u2();
-                attribute.exception_table.push_back(entry);
-            }
+    if (s == "ConstantValue") {
+        // TODO: sometimes this info must be silently ignored
 
-            attribute.attributes = parse_attributes(constant_pool);
-
-            info.variant = attribute;
-        } else if (s == "StackMapTable") {
-            // I think/hope this is only used for verification
-            for (size_t i = 0; i < info.attribute_length; ++i) eat_u1();
-        } else if (s == "Exceptions") {
-            Exceptions_attribute attribute;
-            u2 number_of_exceptions = eat_u2();
-            attribute.exception_index_table.reserve(number_of_exceptions);
-            for (size_t i = 0; i < number_of_exceptions; ++i) {
-                attribute.exception_index_table.push_back(
-                        &check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2()));
-            }
-            info.variant = attribute;
-        } else if (s == "Signature") {
-            Signature_attribute attribute{};
-            attribute.signature_index = &check_cp_range_and_type<CONSTANT_Utf8_info>(constant_pool, eat_u2());
-            info.variant = attribute;
-        } else if (s == "SourceFile") {
-            SourceFile_attribute attribute{};
-            attribute.sourcefile_index = &check_cp_range_and_type<CONSTANT_Utf8_info>(constant_pool, eat_u2());
-            info.variant = attribute;
-        } else if (s == "SourceDebugExtension") {
-            SourceDebugExtension_attribute attribute;
-            attribute.debug_extension = eat_utf8_string(info.attribute_length);
-            info.variant = attribute;
-        } else if (s == "LineNumberTable") {
-            LineNumberTable_attribute attribute;
-            u2 line_number_table_length = eat_u2();
-            attribute.line_number_table.reserve(line_number_table_length);
-            for (size_t i = 0; i < line_number_table_length; ++i) {
-                LineNumberTableEntry entry{};
-                entry.start_pc = eat_u2();
-                entry.line_number = eat_u2();
-                attribute.line_number_table.push_back(entry);
-            }
-            info.variant = attribute;
-        } else if (s == "Deprecated") {
-            info.variant = Deprecated_attribute{};
-        } else if (s == "BootstrapMethods") {
-            BootstrapMethods_attribute attribute;
-            u2 num_bootstrap_methods = eat_u2();
-            attribute.bootstrap_methods.reserve(num_bootstrap_methods);
-            if (highest_parsed_bootstrap_method_attr_index >= num_bootstrap_methods) {
-                throw ParseError("Constant pool had an invalid bootstrap method attribute index");
-            }
-            for (size_t i = 0; i < num_bootstrap_methods; ++i) {
-                BootstrapMethod method;
-                method.bootstrap_method_ref = &check_cp_range_and_type<CONSTANT_MethodHandle_info>(constant_pool,
-                                                                                                   eat_u2());
-                u2 num_bootstrap_arguments = eat_u2();
-                method.bootstrap_arguments.reserve(num_bootstrap_arguments);
-                for (size_t j = 0; j < num_bootstrap_arguments; ++j) {
-                    u2 index = eat_u2();
-                    check_cp_range(index, constant_pool.table.size());
-                    // TODO check loadable
-                    method.bootstrap_arguments.push_back(index);
-                }
-                attribute.bootstrap_methods.push_back(std::move(method));
-            }
-            info.variant = attribute;
-        } else if (s == "MethodParameters") {
-            MethodParameters_attribute attribute;
-            u1 parameters_count = eat_u1();
-            attribute.parameters.reserve(parameters_count);
-            for (size_t i = 0; i < parameters_count; ++i) {
-                MethodParameter parameter{};
-                parameter.name_index = eat_u2(); // 0 or eat_cp_index()
-                parameter.access_flags = eat_u2();
-                attribute.parameters.push_back(parameter);
-            }
-            info.variant = attribute;
-        } else if (s == "ModuleMainClass") {
-            ModuleMainClass_attribute attribute{};
-            attribute.main_class_index = eat_u2();
-            info.variant = attribute;
-        } else if (s == "NestHost") {
-            NestHost_attribute attribute{};
-            attribute.host_class_index = &check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2());
-            info.variant = attribute;
-        } else if (s == "NestMembers") {
-            NestMembers_attribute attribute;
-            u2 number_of_classes = eat_u2();
-            attribute.classes.reserve(number_of_classes);
-            for (size_t i = 0; i < number_of_classes; ++i) {
-                attribute.classes.push_back(&check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2()));
-            }
-            info.variant = attribute;
+        if (info.attribute_length != 2) {
+            throw ParseError("ConstantValue length must be 2, not " + std::to_string(info.attribute_length));
+        }
+
+        ConstantValue_attribute attribute{};
+        attribute.constantvalue_index = eat_u2();
+        check_cp_range(attribute.constantvalue_index, constant_pool.table.size());
+        auto const &variant = constant_pool.table[attribute.constantvalue_index].variant;
+        if (std::holds_alternative<CONSTANT_Integer_info>(variant)
+            || std::holds_alternative<CONSTANT_Float_info>(variant)
+            || std::holds_alternative<CONSTANT_Long_info>(variant)
+            || std::holds_alternative<CONSTANT_Double_info>(variant)
+            || std::holds_alternative<CONSTANT_String_info>(variant)) {
         } else {
-            for (size_t i = 0; i < info.attribute_length; ++i) {
-                eat_u1();
-            }
-            continue;
+            throw ParseError("Unexpected type for constant pool entry of ConstantValue");
         }
-        result.push_back(std::move(info));
+        info.variant = attribute;
+    } else if (s == "Code") {
+        if (clazz->code_attributes.size() == clazz->code_attributes.capacity()) {
+            throw ParseError("Unexpected Code attribute");
+        }
+        Code_attribute &attribute = clazz->code_attributes.emplace_back();
+        attribute.max_stack = eat_u2();
+        attribute.max_locals = eat_u2();
+        u4 code_length = eat_u4();
+        require(code_length);
+        attribute.code.assign(cursor, cursor + code_length);
+        cursor += code_length;
+
+        u2 exception_table_length = eat_u2();
+        require(exception_table_length * 8u);
+        attribute.exception_table.reserve(exception_table_length);
+        for (int i = 0; i < exception_table_length; ++i) {
+            ExceptionTableEntry entry{};
+            entry.start_pc = read_u2();
+            entry.end_pc = read_u2();
+            entry.handler_pc = read_u2();
+            entry.catch_type = read_u2();
+            attribute.exception_table.push_back(entry);
+        }
+
+        attribute.attributes = parse_attributes(constant_pool);
+
+        info.variant = &attribute;
+    } else if (s == "StackMapTable") {
+        // I think/hope this is only used for verification
+        skip(info.attribute_length);
+    } else if (s == "Exceptions") {
+        Exceptions_attribute attribute;
+        u2 number_of_exceptions = eat_u2();
+        attribute.exception_index_table.reserve(number_of_exceptions);
+        for (size_t i = 0; i < number_of_exceptions; ++i) {
+            attribute.exception_index_table.push_back(
+                    &check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2()));
+        }
+        info.variant = attribute;
+    } else if (s == "Signature") {
+        Signature_attribute attribute{};
+        attribute.signature_index = &check_cp_range_and_type<CONSTANT_Utf8_info>(constant_pool, eat_u2());
+        info.variant = attribute;
+    } else if (s == "SourceFile") {
+        SourceFile_attribute attribute{};
+        attribute.sourcefile_index = &check_cp_range_and_type<CONSTANT_Utf8_info>(constant_pool, eat_u2());
+        info.variant = attribute;
+    } else if (s == "SourceDebugExtension") {
+        SourceDebugExtension_attribute attribute;
+        attribute.debug_extension = eat_utf8_string(info.attribute_length);
+        info.variant = attribute;
+    } else if (s == "LineNumberTable") {
+        LineNumberTable_attribute attribute;
+        u2 line_number_table_length = eat_u2();
+        require(line_number_table_length * 4u);
+        attribute.line_number_table.reserve(line_number_table_length);
+        for (size_t i = 0; i < line_number_table_length; ++i) {
+            LineNumberTableEntry entry{};
+            entry.start_pc = read_u2();
+            entry.line_number = read_u2();
+            attribute.line_number_table.push_back(entry);
+        }
+        info.variant = attribute;
+    } else if (s == "Deprecated") {
+        info.variant = Deprecated_attribute{};
+    } else if (s == "BootstrapMethods") {
+        BootstrapMethods_attribute attribute;
+        u2 num_bootstrap_methods = eat_u2();
+        attribute.bootstrap_methods.reserve(num_bootstrap_methods);
+        if (highest_parsed_bootstrap_method_attr_index >= num_bootstrap_methods) {
+            throw ParseError("Constant pool had an invalid bootstrap method attribute index");
+        }
+        for (size_t i = 0; i < num_bootstrap_methods; ++i) {
+            BootstrapMethod method;
+            method.bootstrap_method_ref = &check_cp_range_and_type<CONSTANT_MethodHandle_info>(constant_pool,
+                                                                                               eat_u2());
+            u2 num_bootstrap_arguments = eat_u2();
+            method.bootstrap_arguments.reserve(num_bootstrap_arguments);
+            for (size_t j = 0; j < num_bootstrap_arguments; ++j) {
+                u2 index = eat_u2();
+                check_cp_range(index, constant_pool.table.size());
+                // TODO check loadable
+                method.bootstrap_arguments.push_back(index);
+            }
+            attribute.bootstrap_methods.push_back(std::move(method));
+        }
+        info.variant = attribute;
+    } else if (s == "MethodParameters") {
+        MethodParameters_attribute attribute;
+        u1 parameters_count = eat_u1();
+        attribute.parameters.reserve(parameters_count);
+        for (size_t i = 0; i < parameters_count; ++i) {
+            MethodParameter parameter{};
+            parameter.name_index = eat_u2(); // 0 or eat_cp_index()
+            parameter.access_flags = eat_u2();
+            attribute.parameters.push_back(parameter);
+        }
+        info.variant = attribute;
+    } else if (s == "ModuleMainClass") {
+        ModuleMainClass_attribute attribute{};
+        attribute.main_class_index = eat_u2();
+        info.variant = attribute;
+    } else if (s == "NestHost") {
+        NestHost_attribute attribute{};
+        attribute.host_class_index = &check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2());
+        info.variant = attribute;
+    } else if (s == "NestMembers") {
+        NestMembers_attribute attribute;
+        u2 number_of_classes = eat_u2();
+        attribute.classes.reserve(number_of_classes);
+        for (size_t i = 0; i < number_of_classes; ++i) {
+            attribute.classes.push_back(&check_cp_range_and_type<CONSTANT_Class_info>(constant_pool, eat_u2()));
+        }
+        info.variant = attribute;
+    } else {
+        // Unknown attributes and those that are not decoded (yet), e.g. annotations, stay raw bytes
+        skip(info.attribute_length);
     }
+}
 
-    return result;
+namespace {
+std::mutex lazy_attribute_lock;
+}
+
+attribute_info &decode_attribute(ClassFile *clazz, attribute_info &info) {
+    std::lock_guard lock{lazy_attribute_lock};
+    if (std::holds_alternative<Unparsed_attribute>(info.variant)) {
+        ClassLoaderData::Scope scope{*clazz->loader_data};
+        Parser parser{{info.bytes, info.attribute_length}};
+        parser.parse_attribute(clazz->constant_pool, info);
+    }
+    return info;
 }
 
-MethodDescriptorParts::MethodDescriptorParts(const char *ptr) : m_start(ptr), m_length(0), m_part() {
-    if (m_start[0] != '(') {
+MethodDescriptorParts::MethodDescriptorParts(std::string_view descriptor)
+        : m_start(descriptor.data()), m_end(descriptor.data() + descriptor.size()), m_length(0), m_part() {
+    if (at(0) != '(') {
         throw ParseError("Descriptor must start with '('");
     }
     ++m_start;
@@ -488,7 +529,7 @@ MethodDescriptorParts &MethodDescriptorParts::operator++() {
 }
 
 void MethodDescriptorParts::token() {
-    switch (m_start[m_length]) {
+    switch (at(m_length)) {
         case '[': {
             ++m_length; // skip '['
             token();
@@ -498,10 +539,10 @@ void MethodDescriptorParts::token() {
         }
         case 'L': {
             ++m_length; // skip 'L'
-            while (m_start[m_length] && m_start[m_length] != ';') {
+            while (at(m_length) && at(m_length) != ';') {
                 ++m_length;
             }
-            if (!m_start[m_length]) {
+            if (!at(m_length)) {
                 throw ParseError("");
             }
             ++m_length; // skip ';'
@@ -535,13 +576,13 @@ void MethodDescriptorParts::token() {
             }
             m_part.is_return = true;
 
-            if (m_start[m_length] == 'V') {
+            if (at(m_length) == 'V') {
                 ++m_length;
                 m_part.category = 0;
             } else {
                 token();
             }
-            if (m_start[m_length] != 0) {
+            if (at(m_length) != 0) {
                 throw ParseError("Expected end");
             }
             return;
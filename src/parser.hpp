@@ -1,9 +1,9 @@
 #ifndef SCHOKOVM_PARSER_HPP
 #define SCHOKOVM_PARSER_HPP
 
-#include <fstream>
-#include <iostream>
 #include <optional>
+#include <span>
+#include <string_view>
 
 #include "classfile.hpp"
 #include "future.hpp"
@@ -30,36 +30,58 @@ inline T &check_cp_range_and_type(ConstantPool &pool, u2 index) {
     return pool.get<T>(index);
 }
 
+// Parses a class file from memory. The bytes have to outlive the class, Utf8 constants are borrowed from them.
 class Parser {
-    std::istream &in;
+    std::span<u1 const> bytes;
+    u1 const *cursor;
+    u1 const *end;
+    // The class that is being parsed, it owns the Code attributes
+    ClassFile *clazz = nullptr;
     int highest_parsed_bootstrap_method_attr_index = -1;
 
+    // Checks the bounds once for the next `count` bytes, which can then be read with the read_* functions
+    inline void require(size_t count) {
+        if (static_cast<size_t>(end - cursor) < count) {
+            throw ParseError("Unexpected end of class file");
+        }
+    }
+
+    inline u1 read_u1() { return *cursor++; }
+
+    inline u2 read_u2() {
+        u2 result = static_cast<u2>((cursor[0] << 8) | (cursor[1] << 0));
+        cursor += 2;
+        return result;
+    }
+
+    inline u4 read_u4() {
+        u4 result = ((u4) cursor[0] << 24) | ((u4) cursor[1] << 16) | ((u4) cursor[2] << 8) | ((u4) cursor[3] << 0);
+        cursor += 4;
+        return result;
+    }
+
+    inline u8 read_u8() {
+        return ((u8) read_u4() << 32) | (u8) read_u4();
+    }
+
     inline u1 eat_u1() {
-        // WARNING: >> and .get() are intended for text. They would filter out 0x0A characters...
-        u1 a;
-        in.read((char *) &a, 1);
-        return a;
+        require(1);
+        return read_u1();
     }
 
     inline u2 eat_u2() {
-        u1 bytes[2];
-        in.read((char *) bytes, 2);
-        return (u2) ((bytes[0] << 8) | (bytes[1] << 0));
+        require(2);
+        return read_u2();
     }
 
     inline u4 eat_u4() {
-        // NOTE: This is u1 because casting negative chars to u4 would cause problems with sign extension.
-        // Correct cast: (u4)(unsigned char)(char) 'x'
-        u1 bytes[4];
-        in.read((char *) bytes, 4);
-        return ((u4) bytes[0] << 24) | ((u4) bytes[1] << 16) | ((u4) bytes[2] << 8) | ((u4) bytes[3] << 0);
+        require(4);
+        return read_u4();
     }
 
     inline u8 eat_u8() {
-        u1 bytes[8];
-        in.read((char *) bytes, 8);
-        return ((u8) bytes[0] << 56) | ((u8) bytes[1] << 48) | ((u8) bytes[2] << 40) | ((u8) bytes[3] << 32) |
-               ((u8) bytes[4] << 24) | ((u8) bytes[5] << 16) | ((u8) bytes[6] << 8) | ((u8) bytes[7] << 0);
+        require(8);
+        return read_u8();
     }
 
     inline s4 eat_s4() { return future::bit_cast<s4>(eat_u4()); }
@@ -70,18 +92,41 @@ class Parser {
 
     inline double eat_double() { return future::bit_cast<double>(eat_u8()); }
 
+    inline void skip(size_t count) {
+        require(count);
+        cursor += count;
+    }
+
 public:
-    explicit Parser(std::istream &in);
+    explicit Parser(std::span<u1 const> bytes);
 
     void parse(ClassFile *memory);
 
     ConstantPool parse_constant_pool(u2 major_version);
 
-    std::string eat_utf8_string(u4 length);
+    // The returned string points into the class file bytes
+    std::string_view eat_utf8_string(u4 length);
+
+    MetadataVector<attribute_info> parse_attributes(ConstantPool &constant_pool);
 
-    std::vector<attribute_info> parse_attributes(ConstantPool &constant_pool);
+    // Decodes the contents of `info`, the parser has to be positioned at its start
+    void parse_attribute(ConstantPool &constant_pool, attribute_info &info);
 };
 
+// Decodes an attribute that the parser kept as raw bytes, `clazz` is the class that declares it
+attribute_info &decode_attribute(ClassFile *clazz, attribute_info &info);
+
+// Returns the first attribute with the given name (decoding it if necessary), or nullptr
+template<class T>
+T *find_attribute(ClassFile *clazz, MetadataVector<attribute_info> &attributes, std::string_view name) {
+    for (auto &info : attributes) {
+        if (info.attribute_name_index->value == name) {
+            return std::get_if<T>(&decode_attribute(clazz, info).variant);
+        }
+    }
+    return nullptr;
+}
+
 struct DescriptorPart {
     std::string_view type_name{}; // examples:   I   [[I   Ljava.lang.String;
     size_t array_dimensions = 0; // how many [
@@ -90,7 +135,7 @@ struct DescriptorPart {
 };
 
 struct MethodDescriptorParts : std::iterator<std::forward_iterator_tag, DescriptorPart> {
-    explicit MethodDescriptorParts(char const *ptr);
+    explicit MethodDescriptorParts(std::string_view descriptor);
 
     reference operator*() { return m_part; }
     pointer operator->() { return &m_part; }
@@ -102,9 +147,13 @@ struct MethodDescriptorParts : std::iterator<std::forward_iterator_tag, Descript
 
 private:
     char const  *m_start;
+    char const *m_end;
     size_t m_length;
     DescriptorPart m_part;
 
+    // The descriptor is not null-terminated, the end reads as '\0'
+    [[nodiscard]] char at(size_t index) const { return m_start + index < m_end ? m_start[index] : '\0'; }
+
     void token();
 };
 
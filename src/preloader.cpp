@@ -0,0 +1,83 @@
+#include "preloader.hpp"
+
+ClassPreloader::ClassPreloader(size_t thread_count, Fetch fetch) : m_fetch(std::move(fetch)) {
+    for (size_t i = 0; i < thread_count; ++i) {
+        m_threads.emplace_back([this]() { run(); });
+    }
+}
+
+ClassPreloader::~ClassPreloader() {
+    {
+        std::lock_guard lock{m_mutex};
+        m_stopping = true;
+    }
+    m_queue_changed.notify_all();
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ClassPreloader::request(std::string_view name) {
+    {
+        std::lock_guard lock{m_mutex};
+        if (m_requests.contains(name)) {
+            return;
+        }
+        m_requests.emplace(std::string(name), Request{State::Queued, {nullptr, 0, false}});
+        m_queue.emplace_back(name);
+    }
+    m_queue_changed.notify_one();
+}
+
+std::optional<ParsedClass> ClassPreloader::take(std::string_view name) {
+    std::unique_lock lock{m_mutex};
+    auto found = m_requests.find(name);
+    if (found == m_requests.end()) {
+        return {};
+    }
+    auto &request = found->second;
+    // The class is parsed by the caller, the worker skips it when it reaches it in the queue
+    if (request.state == State::Queued) {
+        request.state = State::Taken;
+        return {};
+    }
+    m_request_done.wait(lock, [&request]() { return request.state != State::Reading; });
+    if (request.state != State::Done) {
+        return {};
+    }
+    request.state = State::Taken;
+    return request.result;
+}
+
+void ClassPreloader::run() {
+    std::unique_lock lock{m_mutex};
+    while (true) {
+        m_queue_changed.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+        if (m_stopping) {
+            return;
+        }
+        std::string name = std::move(m_queue.front());
+        m_queue.pop_front();
+        // References to elements of an unordered_map stay valid on insertion
+        auto &request = m_requests.find(name)->second;
+        if (request.state != State::Queued) {
+            continue;
+        }
+        request.state = State::Reading;
+
+        lock.unlock();
+        ParsedClass result{nullptr, 0, false};
+        bool failed = false;
+        try {
+            result = m_fetch(name);
+        } catch (std::exception const &) {
+            // Reported when the class is loaded for real
+            failed = true;
+        }
+        lock.lock();
+
+        request.result = std::move(result);
+        request.state = failed ? State::Failed : State::Done;
+        m_request_done.notify_all();
+    }
+}
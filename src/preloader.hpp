@@ -0,0 +1,72 @@
+#ifndef SCHOKOVM_PRELOADER_HPP
+#define SCHOKOVM_PRELOADER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "util.hpp"
+
+// A class that was parsed, but not added to the heap yet (see Heap::add_class). The ClassFile is allocated in the
+// arena of its class loader, it is nullptr if the class was not found.
+struct ParsedClass {
+    struct ClassFile *clazz;
+    // The class path entry that the class was read from
+    size_t entry_index;
+    bool decompressed;
+};
+
+// Reads, inflates and parses classes on background threads before they are loaded. The loading thread only adds the
+// parsed class to the heap.
+struct ClassPreloader {
+    using Fetch = std::function<ParsedClass(std::string const &name)>;
+
+    ClassPreloader(size_t thread_count, Fetch fetch);
+
+    ClassPreloader(ClassPreloader const &) = delete;
+
+    ClassPreloader &operator=(ClassPreloader const &) = delete;
+
+    ~ClassPreloader();
+
+    // Queues the class if it was not requested before
+    void request(std::string_view name);
+
+    // The parsed class. Waits if it is being parsed right now. Returns an empty optional if the class was not
+    // requested, not parsed yet (it is dequeued then) or parsing it failed; the caller has to parse it itself.
+    std::optional<ParsedClass> take(std::string_view name);
+
+private:
+    enum class State {
+        Queued,
+        Reading,
+        Done,
+        Failed,
+        Taken,
+    };
+
+    struct Request {
+        State state;
+        ParsedClass result;
+    };
+
+    Fetch m_fetch;
+    std::mutex m_mutex;
+    std::condition_variable m_queue_changed;
+    std::condition_variable m_request_done;
+    std::deque<std::string> m_queue;
+    std::unordered_map<std::string, Request, NameHash, std::equal_to<>> m_requests;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+
+    void run();
+};
+
+#endif //SCHOKOVM_PRELOADER_HPP
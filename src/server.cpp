@@ -0,0 +1,254 @@
+#include "server.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "types.hpp"
+#include "util.hpp"
+
+namespace {
+// The request is a u4 length with the client's stdin, stdout and stderr attached (SCM_RIGHTS), followed by the
+// working directory, the class path, the main class, the number of arguments, the arguments and the environment, each
+// terminated by a 0 byte.
+// The response is the exit status as an s4.
+constexpr int passed_fd_count = 3;
+
+sockaddr_un socket_address(std::string const &socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("Socket path is too long: " + socket_path);
+    }
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+    return address;
+}
+
+bool write_all(int fd, void const *data, size_t size) {
+    auto *bytes = static_cast<char const *>(data);
+    while (size > 0) {
+        auto written = write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+bool read_all(int fd, void *data, size_t size) {
+    auto *bytes = static_cast<char *>(data);
+    while (size > 0) {
+        auto n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        bytes += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Returns false if the request is malformed. On success, `fds` are the client's standard streams.
+bool receive_request(int connection, ServerRequest &request, int (&fds)[passed_fd_count]) {
+    u4 length;
+    iovec io{&length, sizeof(length)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(connection, &message, MSG_WAITALL) != sizeof(length)) {
+        return false;
+    }
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        return false;
+    }
+    std::memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+    std::string payload(length, '\0');
+    if (!read_all(connection, payload.data(), payload.size())) {
+        return false;
+    }
+    std::vector<std::string> strings;
+    for (size_t start = 0; start < payload.size();) {
+        auto end = payload.find('\0', start);
+        if (end == std::string::npos) {
+            return false;
+        }
+        strings.push_back(payload.substr(start, end - start));
+        start = end + 1;
+    }
+    if (strings.size() < 4) {
+        return false;
+    }
+    request.working_directory = std::move(strings[0]);
+    request.classpath = std::move(strings[1]);
+    request.mainclass = std::move(strings[2]);
+    char *end;
+    auto argument_count = std::strtoul(strings[3].c_str(), &end, 10);
+    if (*end != '\0' || argument_count > strings.size() - 4) {
+        return false;
+    }
+    auto arguments_end = strings.begin() + 4 + static_cast<std::ptrdiff_t>(argument_count);
+    request.arguments.assign(std::make_move_iterator(strings.begin() + 4), std::make_move_iterator(arguments_end));
+    request.environment.assign(std::make_move_iterator(arguments_end), std::make_move_iterator(strings.end()));
+    return true;
+}
+
+// Runs in a fork of the server, the run itself is forked once more so its exit status can be reported even if it
+// exits on its own
+[[noreturn]] void handle_connection(int connection, std::string const &classpath,
+                                    std::function<int(ServerRequest const &)> const &run) {
+    signal(SIGCHLD, SIG_DFL);
+
+    ServerRequest request;
+    int fds[passed_fd_count];
+    if (!receive_request(connection, request, fds)) {
+        _exit(1);
+    }
+
+    s4 status;
+    if (request.classpath != classpath) {
+        std::string error = "Error: the classpath " + request.classpath + " differs from the classpath of the server " +
+                            classpath + "\n";
+        write_all(fds[2], error.data(), error.size());
+        status = 1;
+    } else if (pid_t pid = fork(); pid == 0) {
+        close(connection);
+        for (int fd = 0; fd < passed_fd_count; ++fd) {
+            dup2(fds[fd], fd);
+            close(fds[fd]);
+        }
+        if (chdir(request.working_directory.c_str()) != 0) {
+            std::cerr << "Error: can't change to the working directory " << request.working_directory << "\n";
+            std::exit(1);
+        }
+        // putenv keeps the strings, the request lives until the exit
+        clearenv();
+        for (auto &variable : request.environment) {
+            putenv(variable.data());
+        }
+        std::exit(run(request));
+    } else if (pid < 0) {
+        status = 1;
+    } else {
+        int wait_status = 0;
+        while (waitpid(pid, &wait_status, 0) < 0 && errno == EINTR) {
+        }
+        status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : 128 + WTERMSIG(wait_status);
+    }
+
+    write_all(connection, &status, sizeof(status));
+    _exit(0);
+}
+}
+
+std::string absolute_classpath(std::string const &classpath) {
+    std::string result;
+    for (auto const &path : split(classpath, ':')) {
+        if (!result.empty()) {
+            result += ':';
+        }
+        if (!path.empty()) {
+            result += std::filesystem::absolute(path).lexically_normal().string();
+        }
+    }
+    return result;
+}
+
+void serve(std::string const &socket_path, std::string const &classpath,
+           std::function<int(ServerRequest const &)> const &run) {
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        throw std::runtime_error("Failed to create the server socket");
+    }
+    auto address = socket_address(socket_path);
+    unlink(socket_path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0) {
+        throw std::runtime_error("Failed to listen on " + socket_path + ": " + std::strerror(errno));
+    }
+    // The handlers are never waited for
+    signal(SIGCHLD, SIG_IGN);
+
+    while (true) {
+        int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connection < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            throw std::runtime_error("accept failed: " + std::string(std::strerror(errno)));
+        }
+        if (fork() == 0) {
+            close(listener);
+            handle_connection(connection, classpath, run);
+        }
+        close(connection);
+    }
+}
+
+int run_on_server(std::string const &socket_path, ServerRequest const &request) {
+    int connection = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (connection < 0) {
+        throw std::runtime_error("Failed to create a socket");
+    }
+    auto address = socket_address(socket_path);
+    if (connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        throw std::runtime_error("Failed to connect to " + socket_path + ": " + std::strerror(errno));
+    }
+
+    std::string payload;
+    auto const argument_count = std::to_string(request.arguments.size());
+    for (auto const *string : {&request.working_directory, &request.classpath, &request.mainclass, &argument_count}) {
+        payload += *string;
+        payload += '\0';
+    }
+    for (auto const *strings : {&request.arguments, &request.environment}) {
+        for (auto const &string : *strings) {
+            payload += string;
+            payload += '\0';
+        }
+    }
+
+    auto length = static_cast<u4>(payload.size());
+    int fds[passed_fd_count] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    iovec io{&length, sizeof(length)};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+    msghdr message{};
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    s4 status;
+    if (sendmsg(connection, &message, 0) != sizeof(length) || !write_all(connection, payload.data(), payload.size()) ||
+        !read_all(connection, &status, sizeof(status))) {
+        close(connection);
+        throw std::runtime_error("The server at " + socket_path + " did not respond");
+    }
+    close(connection);
+    return status;
+}
@@ -0,0 +1,34 @@
+#ifndef SCHOKOVM_SERVER_HPP
+#define SCHOKOVM_SERVER_HPP
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A VM that was booted once serves many runs: every connection is handled in a fork of the server process, which
+// shares the initialized heap and class metadata copy-on-write. The client passes its stdin, stdout and stderr, its
+// working directory, its environment and the main class, and gets the exit status back.
+
+struct ServerRequest {
+    std::string working_directory;
+    // Absolute paths, it has to match the class path of the server
+    std::string classpath;
+    std::string mainclass;
+    std::vector<std::string> arguments;
+    // NAME=value
+    std::vector<std::string> environment;
+};
+
+// Never returns. `run` is called in a forked process whose standard streams, working directory and environment are
+// the client's, its result is the exit status. The system properties that the JDK derived from them when the server
+// booted are up to `run`.
+[[noreturn]] void serve(std::string const &socket_path, std::string const &classpath,
+                        std::function<int(ServerRequest const &)> const &run);
+
+// Returns the exit status of the run
+int run_on_server(std::string const &socket_path, ServerRequest const &request);
+
+// The class path with absolute paths, so it can be compared and does not depend on the working directory
+std::string absolute_classpath(std::string const &classpath);
+
+#endif //SCHOKOVM_SERVER_HPP
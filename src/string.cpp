@@ -1,5 +1,7 @@
 #include "string.hpp"
 
+#include "utf8.hpp"
+
 ModifiedUtf8::ModifiedUtf8(char16_t code_point) : chars() {
     u2 c = code_point;
 
@@ -29,35 +31,44 @@ ModifiedUtf8::ModifiedUtf8(char16_t code_point) : chars() {
     }
 }
 
+namespace {
+// Latin chars are widened, every char is encoded on its own (there are no surrogate pairs in modified UTF-8)
+template<typename Char>
+size_t copy_to_modified_utf8(std::basic_string_view<Char> view, u1 *optional_buffer) {
+    // leading ASCII chars are copied as a block
+    size_t length = utf8::ascii_prefix(view.data(), view.size());
+    if (optional_buffer != nullptr) {
+        if constexpr (sizeof(Char) == 1) {
+            std::memcpy(optional_buffer, view.data(), length);
+        } else {
+            utf8::narrow(view.data(), length, optional_buffer);
+        }
+    }
+
+    for (const auto &c : view.substr(length)) {
+        ModifiedUtf8 m{static_cast<char16_t>(c)};
+        if (optional_buffer != nullptr) {
+            std::copy(m.chars, m.chars + m.count, optional_buffer + length);
+        }
+        length += m.count;
+    }
+    if (optional_buffer != nullptr) {
+        optional_buffer[length] = 0;
+    }
+    return length + 1;
+}
+}
+
 size_t JavaString::copy_to_modified_utf8_buffer(s4 start_16, s4 length_16, u1 *optional_buffer) {
     assert(start_16 >= 0);
     assert(length_16 >= 0);
 
     if (coder() == Latin) {
-        // we know that each latin char is one code point
-        auto view = view8().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16));
-        if (optional_buffer) {
-            std::copy(view.begin(), view.end(), optional_buffer);
-            optional_buffer[view.length()] = 0;
-        }
-        return view8().length() + 1;
+        return copy_to_modified_utf8(view8().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16)),
+                                     optional_buffer);
     } else {
-        size_t length = 0;
-        auto view = view16().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16));
-        for (const auto &c : view) {
-            ModifiedUtf8 m{c};
-            if (optional_buffer != nullptr) {
-                for (size_t i = 0; i < m.count; ++i) {
-                    *optional_buffer = m.chars[i];
-                    ++optional_buffer;
-                }
-            }
-            length += m.count;
-        }
-        if (optional_buffer != nullptr) {
-            *optional_buffer = 0;
-        }
-        return length + 1;
+        return copy_to_modified_utf8(view16().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16)),
+                                     optional_buffer);
     }
 }
 
@@ -69,9 +80,9 @@ size_t JavaString::copy_to_buffer(s4 start_16, s4 length_16, u2 *optional_buffer
         // we know that each latin char is one code point
         auto view = view8().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16));
         if (optional_buffer) {
-            std::copy(view.begin(), view.end(), optional_buffer);
+            utf8::widen(view.data(), view.length(), optional_buffer);
         }
-        return view8().length();
+        return view.length();
     } else {
         auto view = view16().substr(static_cast<size_t>(start_16), static_cast<size_t>(length_16));
         if (optional_buffer != nullptr) {
@@ -18,44 +18,39 @@ struct ModifiedUtf8 {
 struct JavaString {
     explicit JavaString(const Reference &instance) : instance(instance) {
         assert(instance != JAVA_NULL);
-        assert(instance.object()->clazz == BootstrapClassLoader::constants().java_lang_String);
+        assert(instance.object()->clazz() == BootstrapClassLoader::constants().java_lang_String);
         assert(value() != JAVA_NULL);
-        assert(value().object()->clazz == BootstrapClassLoader::primitive(Primitive::Byte).array);
+        assert(value().object()->clazz() == BootstrapClassLoader::primitive(Primitive::Byte).array);
     }
 
     [[nodiscard]] Reference reference() const { return instance; }
 
     // java fields:
 
-    Reference &value() { return instance.data<Value>()[0].reference; }
+    Reference value() {
+        return *instance.element_at_offset<StoredReference>(BootstrapClassLoader::constants().java_lang_String_value);
+    }
 
     enum Kind : s1 {
         Latin = 0,
         Utf16 = 1,
     };
 
-    s4 &coder() { return instance.data<Value>()[1].s4; }
+    s1 &coder() { return *instance.element_at_offset<s1>(BootstrapClassLoader::constants().java_lang_String_coder); }
 
     // utiltiy functions:
 
     s4 array_length() {
-        assert(value().object()->length >= 0);
+        assert(value().array()->length >= 0);
         if (coder() == Utf16) {
-            assert(value().object()->length % 2 == 0);
+            assert(value().array()->length % 2 == 0);
         }
-        return value().object()->length;
+        return value().array()->length;
     }
 
+    // without the zero at the end
     size_t count_utf8() {
-        if (coder() == Latin) {
-            return static_cast<size_t>(array_length());
-        } else {
-            size_t length = 0;
-            for (const auto &c : view16()) {
-                length += ModifiedUtf8{c}.count;
-            }
-            return length;
-        }
+        return copy_to_modified_utf8_buffer(0, length()) - 1;
     }
 
     s4 length() {
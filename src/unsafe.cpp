@@ -13,15 +13,15 @@
 JNICALL static jobject Unsafe_GetObjectVolatile(JNIEnv *env, jobject unsafe, jobject obj, jlong offset) {
     LOG("Unsafe_GetObjectVolatile");
     // TODO "get with volatile load semantics, otherwise identical to getObject()"
-    auto field = reinterpret_cast<Value *>(reinterpret_cast<char *>(obj) + offset);
-    return reinterpret_cast<jobject>(field->reference.memory);
+    auto field = reinterpret_cast<StoredReference *>(reinterpret_cast<char *>(obj) + offset);
+    return reinterpret_cast<jobject>(static_cast<Reference>(*field).memory);
 }
 
 JNICALL static jint Unsafe_GetIntVolatile(JNIEnv *env, jobject unsafe, jobject obj, jlong offset) {
     LOG("Unsafe_GetIntVolatile");
     // TODO "volatile"
-    auto field = reinterpret_cast<Value *>(reinterpret_cast<char *>(obj) + offset);
-    return field->s4;
+    auto field = reinterpret_cast<jint *>(reinterpret_cast<char *>(obj) + offset);
+    return *field;
 }
 
 JNICALL static jlong Unsafe_ObjectFieldOffset1(JNIEnv *env, jobject unsafe, jclass cls, jstring name) {
@@ -34,7 +34,7 @@ JNICALL static jlong Unsafe_ObjectFieldOffset1(JNIEnv *env, jobject unsafe, jcla
     for (const auto &f : clazz->fields) {
         if (f.name_index->value == str) {
             env->ReleaseStringUTFChars(name, data);
-            return static_cast<jlong>(offset_of_array_after_header<Object, Value>() + sizeof(Value) * f.index);
+            return static_cast<jlong>(f.offset);
         }
     }
 
@@ -90,7 +90,12 @@ JNICALL static jboolean
 Unsafe_CompareAndSetObject(JNIEnv *env, jobject unsafe, jobject obj, jlong offset, jobject expected, jobject desired) {
     LOG("Unsafe_CompareAndSetObject");
     // TODO "volatile semantics"
+#ifdef SCHOKOVM_COMPRESSED_REFERENCES
+    return compare_and_set(obj, offset, NarrowReference::encode(Reference{expected}),
+                           NarrowReference::encode(Reference{desired}));
+#else
     return compare_and_set(obj, offset, expected, desired);
+#endif
 }
 
 JNICALL static jboolean
@@ -0,0 +1,289 @@
+#include "utf8.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCHOKOVM_UTF8_X86 1
+#include <immintrin.h>
+#else
+#define SCHOKOVM_UTF8_X86 0
+#endif
+
+namespace {
+namespace scalar {
+    size_t ascii_prefix(u1 const *data, size_t size) {
+        size_t i = 0;
+        while (i < size && data[i] != 0 && data[i] < 0x80) {
+            ++i;
+        }
+        return i;
+    }
+
+    size_t ascii_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        while (i < size && data[i] != 0 && data[i] < 0x80) {
+            ++i;
+        }
+        return i;
+    }
+
+    size_t latin1_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        while (i < size && data[i] <= 0xFF) {
+            ++i;
+        }
+        return i;
+    }
+
+    void narrow(u2 const *source, size_t size, u1 *destination) {
+        for (size_t i = 0; i < size; ++i) {
+            destination[i] = static_cast<u1>(source[i]);
+        }
+    }
+
+    void widen(u1 const *source, size_t size, u2 *destination) {
+        for (size_t i = 0; i < size; ++i) {
+            destination[i] = source[i];
+        }
+    }
+
+    bool is_valid_modified_utf8(u1 const *data, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            if (data[i] == 0 || data[i] >= 0xF0) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+#if SCHOKOVM_UTF8_X86
+
+// Index of the first set bit of a movemask, in bytes
+inline size_t first_byte(int mask) {
+    return static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+}
+
+namespace sse {
+    // every byte is either 0 or 0xFF
+    __attribute__((target("sse4.1")))
+    inline __m128i non_ascii8(__m128i v) {
+        return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()), _mm_cmplt_epi8(v, _mm_setzero_si128()));
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t ascii_prefix(u1 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+            if (int mask = _mm_movemask_epi8(non_ascii8(v)); mask != 0) {
+                return i + first_byte(mask);
+            }
+        }
+        return i + scalar::ascii_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t ascii_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+            __m128i high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF80)));
+            __m128i bad = _mm_or_si128(_mm_cmpeq_epi16(v, _mm_setzero_si128()),
+                                       _mm_xor_si128(_mm_cmpeq_epi16(high, _mm_setzero_si128()),
+                                                     _mm_set1_epi16(-1)));
+            if (int mask = _mm_movemask_epi8(bad); mask != 0) {
+                return i + first_byte(mask) / 2;
+            }
+        }
+        return i + scalar::ascii_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("sse4.1")))
+    size_t latin1_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+            __m128i high = _mm_and_si128(v, _mm_set1_epi16(static_cast<short>(0xFF00)));
+            __m128i bad = _mm_xor_si128(_mm_cmpeq_epi16(high, _mm_setzero_si128()), _mm_set1_epi16(-1));
+            if (int mask = _mm_movemask_epi8(bad); mask != 0) {
+                return i + first_byte(mask) / 2;
+            }
+        }
+        return i + scalar::latin1_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("sse4.1")))
+    void narrow(u2 const *source, size_t size, u1 *destination) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i low = _mm_loadu_si128(reinterpret_cast<__m128i const *>(source + i));
+            __m128i high = _mm_loadu_si128(reinterpret_cast<__m128i const *>(source + i + 8));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_packus_epi16(low, high));
+        }
+        scalar::narrow(source + i, size - i, destination + i);
+    }
+
+    __attribute__((target("sse4.1")))
+    void widen(u1 const *source, size_t size, u2 *destination) {
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<__m128i const *>(source + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i), _mm_cvtepu8_epi16(v));
+        }
+        scalar::widen(source + i, size - i, destination + i);
+    }
+
+    __attribute__((target("sse4.1")))
+    bool is_valid_modified_utf8(u1 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + i));
+            // v >= 0xF0 iff max(v, 0xF0) == v
+            __m128i bad = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+                                       _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(static_cast<char>(0xF0))), v));
+            if (_mm_movemask_epi8(bad) != 0) {
+                return false;
+            }
+        }
+        return scalar::is_valid_modified_utf8(data + i, size - i);
+    }
+}
+
+namespace avx2 {
+    __attribute__((target("avx2")))
+    size_t ascii_prefix(u1 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+            __m256i bad = _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                                          _mm256_cmpgt_epi8(_mm256_setzero_si256(), v));
+            if (int mask = _mm256_movemask_epi8(bad); mask != 0) {
+                return i + first_byte(mask);
+            }
+        }
+        return i + sse::ascii_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("avx2")))
+    size_t ascii_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+            __m256i high = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFF80)));
+            __m256i bad = _mm256_or_si256(_mm256_cmpeq_epi16(v, _mm256_setzero_si256()),
+                                          _mm256_xor_si256(_mm256_cmpeq_epi16(high, _mm256_setzero_si256()),
+                                                           _mm256_set1_epi16(-1)));
+            if (int mask = _mm256_movemask_epi8(bad); mask != 0) {
+                return i + first_byte(mask) / 2;
+            }
+        }
+        return i + sse::ascii_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("avx2")))
+    size_t latin1_prefix(u2 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+            __m256i high = _mm256_and_si256(v, _mm256_set1_epi16(static_cast<short>(0xFF00)));
+            __m256i bad = _mm256_xor_si256(_mm256_cmpeq_epi16(high, _mm256_setzero_si256()),
+                                           _mm256_set1_epi16(-1));
+            if (int mask = _mm256_movemask_epi8(bad); mask != 0) {
+                return i + first_byte(mask) / 2;
+            }
+        }
+        return i + sse::latin1_prefix(data + i, size - i);
+    }
+
+    __attribute__((target("avx2")))
+    void narrow(u2 const *source, size_t size, u1 *destination) {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i low = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(source + i));
+            __m256i high = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(source + i + 16));
+            // packus works on 128-bit lanes, the permutation restores the order
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), 0b11011000);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), packed);
+        }
+        sse::narrow(source + i, size - i, destination + i);
+    }
+
+    __attribute__((target("avx2")))
+    void widen(u1 const *source, size_t size, u2 *destination) {
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(source + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i), _mm256_cvtepu8_epi16(v));
+        }
+        sse::widen(source + i, size - i, destination + i);
+    }
+
+    __attribute__((target("avx2")))
+    bool is_valid_modified_utf8(u1 const *data, size_t size) {
+        size_t i = 0;
+        for (; i + 32 <= size; i += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<__m256i const *>(data + i));
+            __m256i bad = _mm256_or_si256(
+                    _mm256_cmpeq_epi8(v, _mm256_setzero_si256()),
+                    _mm256_cmpeq_epi8(_mm256_max_epu8(v, _mm256_set1_epi8(static_cast<char>(0xF0))), v));
+            if (_mm256_movemask_epi8(bad) != 0) {
+                return false;
+            }
+        }
+        return sse::is_valid_modified_utf8(data + i, size - i);
+    }
+}
+
+#endif
+
+struct Kernels {
+    size_t (*ascii_prefix8)(u1 const *, size_t);
+    size_t (*ascii_prefix16)(u2 const *, size_t);
+    size_t (*latin1_prefix)(u2 const *, size_t);
+    void (*narrow)(u2 const *, size_t, u1 *);
+    void (*widen)(u1 const *, size_t, u2 *);
+    bool (*is_valid_modified_utf8)(u1 const *, size_t);
+};
+
+Kernels const &kernels() {
+    static Kernels const selected = [] {
+#if SCHOKOVM_UTF8_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return Kernels{avx2::ascii_prefix, avx2::ascii_prefix, avx2::latin1_prefix, avx2::narrow,
+                           avx2::widen, avx2::is_valid_modified_utf8};
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return Kernels{sse::ascii_prefix, sse::ascii_prefix, sse::latin1_prefix, sse::narrow,
+                           sse::widen, sse::is_valid_modified_utf8};
+        }
+#endif
+        return Kernels{scalar::ascii_prefix, scalar::ascii_prefix, scalar::latin1_prefix, scalar::narrow,
+                       scalar::widen, scalar::is_valid_modified_utf8};
+    }();
+    return selected;
+}
+}
+
+size_t utf8::ascii_prefix(u1 const *data, size_t size) {
+    return kernels().ascii_prefix8(data, size);
+}
+
+size_t utf8::ascii_prefix(u2 const *data, size_t size) {
+    return kernels().ascii_prefix16(data, size);
+}
+
+size_t utf8::latin1_prefix(u2 const *data, size_t size) {
+    return kernels().latin1_prefix(data, size);
+}
+
+void utf8::narrow(u2 const *source, size_t size, u1 *destination) {
+    kernels().narrow(source, size, destination);
+}
+
+void utf8::widen(u1 const *source, size_t size, u2 *destination) {
+    kernels().widen(source, size, destination);
+}
+
+bool utf8::is_valid_modified_utf8(u1 const *data, size_t size) {
+    return kernels().is_valid_modified_utf8(data, size);
+}
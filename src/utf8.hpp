@@ -0,0 +1,29 @@
+#ifndef SCHOKOVM_UTF8_HPP
+#define SCHOKOVM_UTF8_HPP
+
+#include <cstddef>
+
+#include "types.hpp"
+
+// Kernels for the conversions between modified UTF-8, Latin-1 and UTF-16.
+// Vectorized implementations (SSE4.1, AVX2) are selected at runtime depending on the CPU, otherwise a scalar
+// implementation is used.
+namespace utf8 {
+    // Number of leading chars that are encoded as a single byte in modified UTF-8 (0x01 to 0x7F)
+    size_t ascii_prefix(u1 const *data, size_t size);
+
+    size_t ascii_prefix(u2 const *data, size_t size);
+
+    // Number of leading chars that fit into Latin-1 (0x00 to 0xFF)
+    size_t latin1_prefix(u2 const *data, size_t size);
+
+    // All chars have to fit into Latin-1
+    void narrow(u2 const *source, size_t size, u1 *destination);
+
+    void widen(u1 const *source, size_t size, u2 *destination);
+
+    // Modified UTF-8 in class files must not contain zero bytes or bytes in the range 0xF0 to 0xFF
+    bool is_valid_modified_utf8(u1 const *data, size_t size);
+}
+
+#endif //SCHOKOVM_UTF8_HPP
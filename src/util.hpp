@@ -1,11 +1,32 @@
 #ifndef SCHOKOVM_UTIL_HPP
 #define SCHOKOVM_UTIL_HPP
 
+#include <atomic>
 #include <vector>
 #include <string>
+#include <string_view>
 
 std::vector<std::string> split(std::string const &string, char separator);
 
 int get_signal_number(const char *signal_name);
 
+// Lazily resolved data is published with a release store after it is complete, other threads check it with an
+// acquire load
+template<typename T>
+inline T load_acquire(T &value) {
+    return std::atomic_ref<T>(value).load(std::memory_order_acquire);
+}
+
+template<typename T>
+inline void store_release(T &value, T desired) {
+    std::atomic_ref<T>(value).store(desired, std::memory_order_release);
+}
+
+// Allows lookups in maps with std::string keys without copying a string_view
+struct NameHash {
+    using is_transparent = void;
+
+    size_t operator()(std::string_view name) const { return std::hash<std::string_view>{}(name); }
+};
+
 #endif //SCHOKOVM_UTIL_HPP
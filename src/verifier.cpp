@@ -0,0 +1,1374 @@
+#include "verifier.hpp"
+
+#include <optional>
+#include <vector>
+
+#include "opcodes.hpp"
+#include "parser.hpp"
+
+VerifyError::VerifyError(std::string message) : message(std::move(message)) {}
+
+const char *VerifyError::what() const noexcept {
+    return message.c_str();
+}
+
+namespace {
+struct Type {
+    VerificationType kind = VerificationType::Top;
+    // Uninitialized: the offset of the new instruction that created the object
+    u2 bci = 0;
+
+    bool operator==(Type const &) const = default;
+};
+
+bool is_category2(VerificationType kind) {
+    return kind == VerificationType::Long || kind == VerificationType::Double;
+}
+
+bool is_initialized_reference(VerificationType kind) {
+    return kind == VerificationType::Reference || kind == VerificationType::Null;
+}
+
+bool is_reference(VerificationType kind) {
+    return is_initialized_reference(kind) || kind == VerificationType::UninitializedThis ||
+           kind == VerificationType::Uninitialized;
+}
+
+// https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-4.html#jvms-4.10.1.2
+bool is_assignable(Type from, Type to) {
+    return to.kind == VerificationType::Top || from == to ||
+           (from.kind == VerificationType::Null && to.kind == VerificationType::Reference);
+}
+
+// The type of a value whose field descriptor starts with `c`
+std::optional<VerificationType> descriptor_kind(char c) {
+    switch (c) {
+        case 'B':
+        case 'C':
+        case 'I':
+        case 'S':
+        case 'Z':
+            return VerificationType::Integer;
+        case 'F':
+            return VerificationType::Float;
+        case 'J':
+            return VerificationType::Long;
+        case 'D':
+            return VerificationType::Double;
+        case 'L':
+        case '[':
+            return VerificationType::Reference;
+        default:
+            return {};
+    }
+}
+
+// The locals and the operands before an instruction. Like on the stack of the interpreter, values of category 2
+// occupy two slots.
+struct State {
+    std::vector<Type> locals;
+    std::vector<Type> stack;
+
+    bool operator==(State const &) const = default;
+};
+
+class MethodVerifier {
+public:
+    MethodVerifier(ClassFile *clazz, method_info &method)
+            : m_clazz(clazz), m_method(method), m_code(*method.code_attribute), m_bytes(m_code.code),
+              m_check_stack_maps(clazz->major_version >= 50) {}
+
+    // Returns false if the method was not verified because it uses jsr or ret
+    bool verify();
+
+    // Builds the type map from the verified states (in the current metadata scope)
+    [[nodiscard]] MethodTypeMap type_map() const;
+
+private:
+    ClassFile *m_clazz;
+    method_info &m_method;
+    Code_attribute &m_code;
+    MetadataVector<u1> const &m_bytes;
+    bool m_check_stack_maps;
+
+    std::vector<bool> m_instruction_start;
+    // The frames of the StackMapTable, they are not changed by merging
+    std::vector<bool> m_declared;
+    std::vector<std::optional<State>> m_states;
+    std::vector<bool> m_queued;
+    std::vector<size_t> m_worklist;
+
+    // The instruction that is being verified, and the state while it is executed
+    size_t m_bci = 0;
+    State m_state;
+
+    [[noreturn]] void fail(std::string const &message) const {
+        throw VerifyError("(class: " + std::string(m_clazz->name()) + ", method: " +
+                          std::string(m_method.name_index->value) + " signature: " +
+                          std::string(m_method.descriptor_index->value) + ") at bci " + std::to_string(m_bci) +
+                          ": " + message);
+    }
+
+    [[nodiscard]] u1 u1_at(size_t index) const { return m_bytes[index]; }
+
+    [[nodiscard]] u2 u2_at(size_t index) const { return static_cast<u2>((m_bytes[index] << 8) | m_bytes[index + 1]); }
+
+    [[nodiscard]] s4 s4_at(size_t index) const {
+        return static_cast<s4>((static_cast<u4>(m_bytes[index]) << 24) | (static_cast<u4>(m_bytes[index + 1]) << 16) |
+                               (static_cast<u4>(m_bytes[index + 2]) << 8) | static_cast<u4>(m_bytes[index + 3]));
+    }
+
+    // 0 if the instruction is invalid or does not fit into the code
+    void find_instructions();
+
+    void check_exception_table();
+
+    [[nodiscard]] std::vector<Type> initial_locals() const;
+
+    [[nodiscard]] std::vector<Type> expand(std::vector<Type> const &types, size_t size, char const *what) const;
+
+    void read_stack_map_table(std::vector<Type> const &initial);
+
+    void enqueue(size_t bci);
+
+    void flow(size_t target, State const &state, bool falls_through);
+
+    [[nodiscard]] bool merge(State &into, State const &state) const;
+
+    void execute();
+
+    void check_handlers(std::vector<Type> const &locals);
+
+    [[nodiscard]] size_t branch_target(s4 offset) const;
+
+    template<class T>
+    T &constant(u2 index) const {
+        auto &table = m_clazz->constant_pool.table;
+        T *result = index == 0 || index >= table.size() ? nullptr : std::get_if<T>(&table[index].variant);
+        if (result == nullptr) {
+            fail("Illegal constant pool index " + std::to_string(index));
+        }
+        return *result;
+    }
+
+    [[nodiscard]] VerificationType field_kind(std::string_view descriptor) const {
+        auto kind = descriptor.empty() ? std::nullopt : descriptor_kind(descriptor[0]);
+        if (!kind) {
+            fail("Illegal field descriptor " + std::string(descriptor));
+        }
+        return *kind;
+    }
+
+    // The kinds of the arguments, and the kind of the return value (empty for void)
+    void method_kinds(std::string_view descriptor, std::vector<VerificationType> &arguments,
+                      std::optional<VerificationType> &result) const;
+
+    void push(Type type) {
+        if (m_state.stack.size() >= m_code.max_stack) {
+            fail("Operand stack overflow");
+        }
+        m_state.stack.push_back(type);
+    }
+
+    void push(VerificationType kind) {
+        push(Type{kind});
+        if (is_category2(kind)) {
+            push(Type{});
+        }
+    }
+
+    Type pop_slot() {
+        if (m_state.stack.empty()) {
+            fail("Operand stack underflow");
+        }
+        Type type = m_state.stack.back();
+        m_state.stack.pop_back();
+        return type;
+    }
+
+    void pop(VerificationType kind) {
+        if (is_category2(kind) && pop_slot().kind != VerificationType::Top) {
+            fail("Bad type on operand stack");
+        }
+        auto type = pop_slot();
+        if (kind == VerificationType::Reference ? !is_initialized_reference(type.kind) : type.kind != kind) {
+            fail("Bad type on operand stack");
+        }
+    }
+
+    // An object or an uninitialized object
+    Type pop_any_reference() {
+        auto type = pop_slot();
+        if (!is_reference(type.kind)) {
+            fail("Expecting a reference on the operand stack");
+        }
+        return type;
+    }
+
+    // The slots of the untyped stack instructions, they must not split a value of category 2
+    std::vector<Type> pop_slots(size_t count) {
+        std::vector<Type> slots(count);
+        for (size_t i = count; i-- > 0;) {
+            slots[i] = pop_slot();
+        }
+        if (slots[0].kind == VerificationType::Top) {
+            fail("Untyped stack instruction splits a value of category 2");
+        }
+        return slots;
+    }
+
+    void push_slots(std::vector<Type> const &slots) {
+        for (auto const &slot : slots) {
+            push(slot);
+        }
+    }
+
+    Type local(size_t index) const {
+        if (index >= m_state.locals.size()) {
+            fail("Illegal local variable number " + std::to_string(index));
+        }
+        return m_state.locals[index];
+    }
+
+    void load(size_t index, VerificationType kind) {
+        if (local(index).kind != kind || (is_category2(kind) && index + 1 >= m_state.locals.size())) {
+            fail("Bad local variable type " + std::to_string(index));
+        }
+        push(kind);
+    }
+
+    void store(size_t index, Type type) {
+        size_t size = is_category2(type.kind) ? 2 : 1;
+        if (index + size > m_state.locals.size()) {
+            fail("Illegal local variable number " + std::to_string(index));
+        }
+        // Overwriting the second half of a long or double invalidates it
+        if (index > 0 && is_category2(m_state.locals[index - 1].kind)) {
+            m_state.locals[index - 1] = {};
+        }
+        m_state.locals[index] = type;
+        if (size == 2) {
+            m_state.locals[index + 1] = {};
+        }
+    }
+
+    void load_array_element(VerificationType kind) {
+        pop(VerificationType::Integer);
+        pop(VerificationType::Reference);
+        push(kind);
+    }
+
+    void store_array_element(VerificationType kind) {
+        pop(kind);
+        pop(VerificationType::Integer);
+        pop(VerificationType::Reference);
+    }
+
+    void binary(VerificationType kind) {
+        pop(kind);
+        pop(kind);
+        push(kind);
+    }
+
+    void convert(VerificationType from, VerificationType to) {
+        pop(from);
+        push(to);
+    }
+
+    void ldc(u2 index, bool category2);
+
+    void invoke(OpCodes opcode, u2 index);
+
+    void do_return(std::optional<VerificationType> kind);
+};
+
+void MethodVerifier::find_instructions() {
+    auto size = m_bytes.size();
+    if (size == 0) {
+        fail("Code is empty");
+    }
+    m_instruction_start.assign(size, false);
+    for (size_t bci = 0; bci < size;) {
+        m_bci = bci;
+        m_instruction_start[bci] = true;
+        auto length = instruction_length(m_bytes, bci);
+        if (length == 0 || length > size - bci) {
+            fail("Illegal instruction");
+        }
+        bci += length;
+    }
+    m_bci = 0;
+}
+
+void MethodVerifier::check_exception_table() {
+    auto size = m_bytes.size();
+    for (auto const &entry : m_code.exception_table) {
+        if (entry.start_pc >= entry.end_pc || !m_instruction_start[entry.start_pc] ||
+            (entry.end_pc < size && !m_instruction_start[entry.end_pc]) || entry.end_pc > size ||
+            entry.handler_pc >= size || !m_instruction_start[entry.handler_pc]) {
+            fail("Illegal exception table range");
+        }
+        if (entry.catch_type != 0) {
+            constant<CONSTANT_Class_info>(entry.catch_type);
+        }
+    }
+}
+
+std::vector<Type> MethodVerifier::initial_locals() const {
+    // One entry per value, see expand
+    std::vector<Type> locals;
+    if (!m_method.is_static()) {
+        if (m_method.name_index->value == "<init>" && m_clazz->super_class_ref != nullptr) {
+            locals.push_back({VerificationType::UninitializedThis});
+        } else {
+            locals.push_back({VerificationType::Reference});
+        }
+    }
+    std::vector<VerificationType> arguments;
+    std::optional<VerificationType> result;
+    method_kinds(m_method.descriptor_index->value, arguments, result);
+    for (auto kind : arguments) {
+        locals.push_back({kind});
+    }
+    return locals;
+}
+
+// The StackMapTable lists values of category 2 once, on the stack of the interpreter they occupy two slots
+std::vector<Type> MethodVerifier::expand(std::vector<Type> const &types, size_t size, char const *what) const {
+    std::vector<Type> slots;
+    for (auto type : types) {
+        slots.push_back(type);
+        if (is_category2(type.kind)) {
+            slots.emplace_back();
+        }
+    }
+    if (slots.size() > size) {
+        fail(std::string("Too many ") + what);
+    }
+    return slots;
+}
+
+// https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-4.html#jvms-4.7.4
+void MethodVerifier::read_stack_map_table(std::vector<Type> const &initial) {
+    attribute_info const *attribute = nullptr;
+    for (auto const &info : m_code.attributes) {
+        if (info.attribute_name_index->value == "StackMapTable") {
+            attribute = &info;
+        }
+    }
+    if (attribute == nullptr) {
+        return;
+    }
+
+    u1 const *cursor = attribute->bytes;
+    u1 const *end = attribute->bytes + attribute->attribute_length;
+    auto eat_u1 = [&]() {
+        if (cursor >= end) {
+            fail("Truncated StackMapTable");
+        }
+        return *cursor++;
+    };
+    auto eat_u2 = [&]() {
+        u1 high = eat_u1();
+        return static_cast<u2>((high << 8) | eat_u1());
+    };
+    auto eat_type = [&]() {
+        switch (u1 tag = eat_u1()) {
+            case 0:
+                return Type{VerificationType::Top};
+            case 1:
+                return Type{VerificationType::Integer};
+            case 2:
+                return Type{VerificationType::Float};
+            case 3:
+                return Type{VerificationType::Double};
+            case 4:
+                return Type{VerificationType::Long};
+            case 5:
+                return Type{VerificationType::Null};
+            case 6:
+                return Type{VerificationType::UninitializedThis};
+            case 7:
+                constant<CONSTANT_Class_info>(eat_u2());
+                return Type{VerificationType::Reference};
+            case 8: {
+                u2 offset = eat_u2();
+                if (offset >= m_bytes.size() || !m_instruction_start[offset] ||
+                    static_cast<OpCodes>(m_bytes[offset]) != OpCodes::new_) {
+                    fail("Uninitialized type does not refer to a new instruction");
+                }
+                return Type{VerificationType::Uninitialized, offset};
+            }
+            default:
+                fail("Illegal verification type " + std::to_string(tag));
+        }
+    };
+
+    std::vector<Type> locals = initial;
+    std::vector<Type> stack;
+    size_t bci = 0;
+    u2 number_of_entries = eat_u2();
+    for (size_t i = 0; i < number_of_entries; ++i) {
+        u1 frame_type = eat_u1();
+        u2 offset_delta;
+        stack.clear();
+        if (frame_type <= 63) {
+            // same_frame
+            offset_delta = frame_type;
+        } else if (frame_type <= 127) {
+            // same_locals_1_stack_item_frame
+            offset_delta = static_cast<u2>(frame_type - 64);
+            stack.push_back(eat_type());
+        } else if (frame_type < 247) {
+            fail("Reserved stack map frame type " + std::to_string(frame_type));
+        } else if (frame_type == 247) {
+            // same_locals_1_stack_item_frame_extended
+            offset_delta = eat_u2();
+            stack.push_back(eat_type());
+        } else if (frame_type <= 250) {
+            // chop_frame
+            offset_delta = eat_u2();
+            size_t chopped = 251u - frame_type;
+            if (chopped > locals.size()) {
+                fail("Stack map frame chops too many locals");
+            }
+            locals.resize(locals.size() - chopped);
+        } else if (frame_type == 251) {
+            // same_frame_extended
+            offset_delta = eat_u2();
+        } else if (frame_type <= 254) {
+            // append_frame
+            offset_delta = eat_u2();
+            for (size_t j = 251; j < frame_type; ++j) {
+                locals.push_back(eat_type());
+            }
+        } else {
+            // full_frame
+            offset_delta = eat_u2();
+            locals.clear();
+            for (u2 count = eat_u2(); count > 0; --count) {
+                locals.push_back(eat_type());
+            }
+            for (u2 count = eat_u2(); count > 0; --count) {
+                stack.push_back(eat_type());
+            }
+        }
+
+        // The offset of the first frame is offset_delta, the next ones are offset_delta + 1 after their predecessor
+        bci = i == 0 ? offset_delta : bci + offset_delta + 1;
+        if (bci >= m_bytes.size() || !m_instruction_start[bci]) {
+            fail("Stack map frame at " + std::to_string(bci) + " is not at an instruction");
+        }
+
+        State state{expand(locals, m_code.max_locals, "locals in stack map frame"),
+                    expand(stack, m_code.max_stack, "operands in stack map frame")};
+        state.locals.resize(m_code.max_locals);
+        m_states[bci] = std::move(state);
+        m_declared[bci] = true;
+    }
+    if (cursor != end) {
+        fail("Unexpected data at the end of the StackMapTable");
+    }
+}
+
+void MethodVerifier::method_kinds(std::string_view descriptor, std::vector<VerificationType> &arguments,
+                                  std::optional<VerificationType> &result) const {
+    try {
+        MethodDescriptorParts parts{descriptor};
+        for (; !parts->is_return; ++parts) {
+            arguments.push_back(field_kind(parts->type_name));
+        }
+        result = parts->category == 0 ? std::nullopt : std::optional{field_kind(parts->type_name)};
+    } catch (ParseError const &) {
+        fail("Illegal method descriptor " + std::string(descriptor));
+    }
+}
+
+void MethodVerifier::enqueue(size_t bci) {
+    if (!m_queued[bci]) {
+        m_queued[bci] = true;
+        m_worklist.push_back(bci);
+    }
+}
+
+bool MethodVerifier::merge(State &into, State const &state) const {
+    if (into.stack.size() != state.stack.size()) {
+        fail("Inconsistent stack height " + std::to_string(into.stack.size()) + " != " +
+             std::to_string(state.stack.size()));
+    }
+    auto merge_type = [](Type a, Type b) -> std::optional<Type> {
+        if (a == b) {
+            return a;
+        }
+        if (is_initialized_reference(a.kind) && is_initialized_reference(b.kind)) {
+            return Type{VerificationType::Reference};
+        }
+        return {};
+    };
+
+    bool changed = false;
+    for (size_t i = 0; i < into.stack.size(); ++i) {
+        auto merged = merge_type(into.stack[i], state.stack[i]);
+        if (!merged) {
+            fail("Inconsistent types on the operand stack");
+        }
+        changed |= *merged != into.stack[i];
+        into.stack[i] = *merged;
+    }
+    for (size_t i = 0; i < into.locals.size(); ++i) {
+        auto merged = merge_type(into.locals[i], state.locals[i]).value_or(Type{});
+        changed |= merged != into.locals[i];
+        into.locals[i] = merged;
+    }
+    return changed;
+}
+
+void MethodVerifier::flow(size_t target, State const &state, bool falls_through) {
+    if (m_declared[target]) {
+        auto const &frame = *m_states[target];
+        bool assignable = frame.stack.size() == state.stack.size();
+        for (size_t i = 0; assignable && i < frame.stack.size(); ++i) {
+            assignable = is_assignable(state.stack[i], frame.stack[i]);
+        }
+        for (size_t i = 0; assignable && i < frame.locals.size(); ++i) {
+            assignable = is_assignable(state.locals[i], frame.locals[i]);
+        }
+        if (!assignable) {
+            fail("Type state is not assignable to the stack map frame at " + std::to_string(target));
+        }
+        // The frames do not change, they are only verified once
+        return;
+    }
+    if (m_check_stack_maps && !falls_through) {
+        fail("Expecting a stack map frame at " + std::to_string(target));
+    }
+
+    auto &existing = m_states[target];
+    if (!existing) {
+        existing = state;
+        enqueue(target);
+    } else if (merge(*existing, state)) {
+        enqueue(target);
+    }
+}
+
+size_t MethodVerifier::branch_target(s4 offset) const {
+    auto target = static_cast<s8>(m_bci) + offset;
+    if (target < 0 || static_cast<u8>(target) >= m_bytes.size() || !m_instruction_start[static_cast<size_t>(target)]) {
+        fail("Illegal target of jump or branch");
+    }
+    return static_cast<size_t>(target);
+}
+
+void MethodVerifier::check_handlers(std::vector<Type> const &locals) {
+    for (auto const &entry : m_code.exception_table) {
+        if (entry.start_pc <= m_bci && m_bci < entry.end_pc) {
+            flow(entry.handler_pc, State{locals, {Type{VerificationType::Reference}}}, false);
+        }
+    }
+}
+
+void MethodVerifier::ldc(u2 index, bool category2) {
+    auto &table = m_clazz->constant_pool.table;
+    if (index == 0 || index >= table.size()) {
+        fail("Illegal constant pool index " + std::to_string(index));
+    }
+    auto const &variant = table[index].variant;
+    std::optional<VerificationType> kind;
+    if (std::holds_alternative<CONSTANT_Integer_info>(variant)) {
+        kind = VerificationType::Integer;
+    } else if (std::holds_alternative<CONSTANT_Float_info>(variant)) {
+        kind = VerificationType::Float;
+    } else if (std::holds_alternative<CONSTANT_Long_info>(variant)) {
+        kind = VerificationType::Long;
+    } else if (std::holds_alternative<CONSTANT_Double_info>(variant)) {
+        kind = VerificationType::Double;
+    } else if (std::holds_alternative<CONSTANT_String_info>(variant) ||
+               std::holds_alternative<CONSTANT_Class_info>(variant) ||
+               std::holds_alternative<CONSTANT_MethodHandle_info>(variant) ||
+               std::holds_alternative<CONSTANT_MethodType_info>(variant)) {
+        kind = VerificationType::Reference;
+    } else if (auto *dynamic = std::get_if<CONSTANT_Dynamic_info>(&variant)) {
+        kind = field_kind(constant<CONSTANT_NameAndType_info>(dynamic->name_and_type_index).descriptor->value);
+    }
+    if (!kind || is_category2(*kind) != category2) {
+        fail("Illegal type in constant pool");
+    }
+    push(*kind);
+}
+
+void MethodVerifier::invoke(OpCodes opcode, u2 index) {
+    std::string_view name;
+    std::string_view descriptor;
+    if (opcode == OpCodes::invokedynamic) {
+        auto &name_and_type = constant<CONSTANT_NameAndType_info>(
+                constant<CONSTANT_InvokeDynamic_info>(index).name_and_type_index);
+        name = name_and_type.name->value;
+        descriptor = name_and_type.descriptor->value;
+    } else {
+        auto &table = m_clazz->constant_pool.table;
+        ClassInterface_Methodref *method = nullptr;
+        if (opcode == OpCodes::invokeinterface) {
+            method = &constant<CONSTANT_InterfaceMethodref_info>(index).method;
+        } else if (opcode == OpCodes::invokevirtual || index >= table.size() ||
+                   !std::holds_alternative<CONSTANT_InterfaceMethodref_info>(table[index].variant)) {
+            method = &constant<CONSTANT_Methodref_info>(index).method;
+        } else {
+            method = &constant<CONSTANT_InterfaceMethodref_info>(index).method;
+        }
+        name = method->name_and_type->name->value;
+        descriptor = method->name_and_type->descriptor->value;
+    }
+
+    bool is_constructor = name == "<init>";
+    if (name.starts_with('<') && (!is_constructor || opcode != OpCodes::invokespecial)) {
+        fail("Illegal call to " + std::string(name));
+    }
+
+    std::vector<VerificationType> arguments;
+    std::optional<VerificationType> result;
+    method_kinds(descriptor, arguments, result);
+    for (size_t i = arguments.size(); i-- > 0;) {
+        pop(arguments[i]);
+    }
+
+    if (is_constructor) {
+        if (result) {
+            fail("Constructor must return void");
+        }
+        // All copies of the uninitialized object are initialized
+        auto receiver = pop_any_reference();
+        if (receiver.kind != VerificationType::Uninitialized && receiver.kind != VerificationType::UninitializedThis) {
+            fail("Constructor called on an initialized object");
+        }
+        for (auto *types : {&m_state.locals, &m_state.stack}) {
+            for (auto &type : *types) {
+                if (type == receiver) {
+                    type = Type{VerificationType::Reference};
+                }
+            }
+        }
+    } else if (opcode != OpCodes::invokestatic && opcode != OpCodes::invokedynamic) {
+        pop(VerificationType::Reference);
+    }
+
+    if (result) {
+        push(*result);
+    }
+}
+
+void MethodVerifier::do_return(std::optional<VerificationType> kind) {
+    std::vector<VerificationType> arguments;
+    std::optional<VerificationType> result;
+    method_kinds(m_method.descriptor_index->value, arguments, result);
+    if (kind != result) {
+        fail("Wrong return instruction for the return type");
+    }
+    if (kind) {
+        pop(*kind);
+    }
+    for (auto const &type : m_state.locals) {
+        if (type.kind == VerificationType::UninitializedThis) {
+            fail("Constructor must call another constructor before it returns");
+        }
+    }
+}
+
+void MethodVerifier::execute() {
+    using VT = VerificationType;
+
+    auto opcode = static_cast<OpCodes>(m_bytes[m_bci]);
+    auto length = instruction_length(m_bytes, m_bci);
+    bool falls_through = true;
+
+    switch (opcode) {
+        // Constants
+        case OpCodes::nop:
+            break;
+        case OpCodes::aconst_null:
+            push(VT::Null);
+            break;
+        case OpCodes::iconst_m1:
+        case OpCodes::iconst_0:
+        case OpCodes::iconst_1:
+        case OpCodes::iconst_2:
+        case OpCodes::iconst_3:
+        case OpCodes::iconst_4:
+        case OpCodes::iconst_5:
+        case OpCodes::bipush:
+        case OpCodes::sipush:
+            push(VT::Integer);
+            break;
+        case OpCodes::lconst_0:
+        case OpCodes::lconst_1:
+            push(VT::Long);
+            break;
+        case OpCodes::fconst_0:
+        case OpCodes::fconst_1:
+        case OpCodes::fconst_2:
+            push(VT::Float);
+            break;
+        case OpCodes::dconst_0:
+        case OpCodes::dconst_1:
+            push(VT::Double);
+            break;
+        case OpCodes::ldc:
+            ldc(u1_at(m_bci + 1), false);
+            break;
+        case OpCodes::ldc_w:
+            ldc(u2_at(m_bci + 1), false);
+            break;
+        case OpCodes::ldc2_w:
+            ldc(u2_at(m_bci + 1), true);
+            break;
+
+        // Loads
+        case OpCodes::iload:
+            load(u1_at(m_bci + 1), VT::Integer);
+            break;
+        case OpCodes::lload:
+            load(u1_at(m_bci + 1), VT::Long);
+            break;
+        case OpCodes::fload:
+            load(u1_at(m_bci + 1), VT::Float);
+            break;
+        case OpCodes::dload:
+            load(u1_at(m_bci + 1), VT::Double);
+            break;
+        case OpCodes::iload_0:
+        case OpCodes::iload_1:
+        case OpCodes::iload_2:
+        case OpCodes::iload_3:
+            load(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::iload_0), VT::Integer);
+            break;
+        case OpCodes::lload_0:
+        case OpCodes::lload_1:
+        case OpCodes::lload_2:
+        case OpCodes::lload_3:
+            load(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::lload_0), VT::Long);
+            break;
+        case OpCodes::fload_0:
+        case OpCodes::fload_1:
+        case OpCodes::fload_2:
+        case OpCodes::fload_3:
+            load(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::fload_0), VT::Float);
+            break;
+        case OpCodes::dload_0:
+        case OpCodes::dload_1:
+        case OpCodes::dload_2:
+        case OpCodes::dload_3:
+            load(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::dload_0), VT::Double);
+            break;
+        case OpCodes::aload:
+        case OpCodes::aload_0:
+        case OpCodes::aload_1:
+        case OpCodes::aload_2:
+        case OpCodes::aload_3: {
+            auto type = local(opcode == OpCodes::aload
+                              ? u1_at(m_bci + 1)
+                              : static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::aload_0));
+            if (!is_reference(type.kind)) {
+                fail("Bad local variable type for aload");
+            }
+            push(type);
+            break;
+        }
+        case OpCodes::iaload:
+        case OpCodes::baload:
+        case OpCodes::caload:
+        case OpCodes::saload:
+            load_array_element(VT::Integer);
+            break;
+        case OpCodes::laload:
+            load_array_element(VT::Long);
+            break;
+        case OpCodes::faload:
+            load_array_element(VT::Float);
+            break;
+        case OpCodes::daload:
+            load_array_element(VT::Double);
+            break;
+        case OpCodes::aaload:
+            load_array_element(VT::Reference);
+            break;
+
+        // Stores
+        case OpCodes::istore:
+            pop(VT::Integer);
+            store(u1_at(m_bci + 1), {VT::Integer});
+            break;
+        case OpCodes::lstore:
+            pop(VT::Long);
+            store(u1_at(m_bci + 1), {VT::Long});
+            break;
+        case OpCodes::fstore:
+            pop(VT::Float);
+            store(u1_at(m_bci + 1), {VT::Float});
+            break;
+        case OpCodes::dstore:
+            pop(VT::Double);
+            store(u1_at(m_bci + 1), {VT::Double});
+            break;
+        case OpCodes::istore_0:
+        case OpCodes::istore_1:
+        case OpCodes::istore_2:
+        case OpCodes::istore_3:
+            pop(VT::Integer);
+            store(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::istore_0), {VT::Integer});
+            break;
+        case OpCodes::lstore_0:
+        case OpCodes::lstore_1:
+        case OpCodes::lstore_2:
+        case OpCodes::lstore_3:
+            pop(VT::Long);
+            store(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::lstore_0), {VT::Long});
+            break;
+        case OpCodes::fstore_0:
+        case OpCodes::fstore_1:
+        case OpCodes::fstore_2:
+        case OpCodes::fstore_3:
+            pop(VT::Float);
+            store(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::fstore_0), {VT::Float});
+            break;
+        case OpCodes::dstore_0:
+        case OpCodes::dstore_1:
+        case OpCodes::dstore_2:
+        case OpCodes::dstore_3:
+            pop(VT::Double);
+            store(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::dstore_0), {VT::Double});
+            break;
+        case OpCodes::astore:
+            store(u1_at(m_bci + 1), pop_any_reference());
+            break;
+        case OpCodes::astore_0:
+        case OpCodes::astore_1:
+        case OpCodes::astore_2:
+        case OpCodes::astore_3:
+            store(static_cast<size_t>(opcode) - static_cast<size_t>(OpCodes::astore_0), pop_any_reference());
+            break;
+        case OpCodes::iastore:
+        case OpCodes::bastore:
+        case OpCodes::castore:
+        case OpCodes::sastore:
+            store_array_element(VT::Integer);
+            break;
+        case OpCodes::lastore:
+            store_array_element(VT::Long);
+            break;
+        case OpCodes::fastore:
+            store_array_element(VT::Float);
+            break;
+        case OpCodes::dastore:
+            store_array_element(VT::Double);
+            break;
+        case OpCodes::aastore:
+            store_array_element(VT::Reference);
+            break;
+
+        // Stack
+        case OpCodes::pop:
+            pop_slots(1);
+            break;
+        case OpCodes::pop2:
+            pop_slots(2);
+            break;
+        case OpCodes::dup: {
+            auto value = pop_slots(1);
+            push_slots(value);
+            push_slots(value);
+            break;
+        }
+        case OpCodes::dup_x1: {
+            auto value1 = pop_slots(1);
+            auto value2 = pop_slots(1);
+            push_slots(value1);
+            push_slots(value2);
+            push_slots(value1);
+            break;
+        }
+        case OpCodes::dup_x2: {
+            auto value1 = pop_slots(1);
+            auto value2 = pop_slots(2);
+            push_slots(value1);
+            push_slots(value2);
+            push_slots(value1);
+            break;
+        }
+        case OpCodes::dup2: {
+            auto value = pop_slots(2);
+            push_slots(value);
+            push_slots(value);
+            break;
+        }
+        case OpCodes::dup2_x1: {
+            auto value1 = pop_slots(2);
+            auto value2 = pop_slots(1);
+            push_slots(value1);
+            push_slots(value2);
+            push_slots(value1);
+            break;
+        }
+        case OpCodes::dup2_x2: {
+            auto value1 = pop_slots(2);
+            auto value2 = pop_slots(2);
+            push_slots(value1);
+            push_slots(value2);
+            push_slots(value1);
+            break;
+        }
+        case OpCodes::swap: {
+            auto value1 = pop_slots(1);
+            auto value2 = pop_slots(1);
+            push_slots(value1);
+            push_slots(value2);
+            break;
+        }
+
+        // Math
+        case OpCodes::iadd:
+        case OpCodes::isub:
+        case OpCodes::imul:
+        case OpCodes::idiv:
+        case OpCodes::irem:
+        case OpCodes::ishl:
+        case OpCodes::ishr:
+        case OpCodes::iushr:
+        case OpCodes::iand:
+        case OpCodes::ior:
+        case OpCodes::ixor:
+            binary(VT::Integer);
+            break;
+        case OpCodes::ladd:
+        case OpCodes::lsub:
+        case OpCodes::lmul:
+        case OpCodes::ldiv:
+        case OpCodes::lrem:
+        case OpCodes::land:
+        case OpCodes::lor:
+        case OpCodes::lxor:
+            binary(VT::Long);
+            break;
+        case OpCodes::fadd:
+        case OpCodes::fsub:
+        case OpCodes::fmul:
+        case OpCodes::fdiv:
+        case OpCodes::frem:
+            binary(VT::Float);
+            break;
+        case OpCodes::dadd:
+        case OpCodes::dsub:
+        case OpCodes::dmul:
+        case OpCodes::ddiv:
+        case OpCodes::drem:
+            binary(VT::Double);
+            break;
+        case OpCodes::lshl:
+        case OpCodes::lshr:
+        case OpCodes::lushr:
+            pop(VT::Integer);
+            pop(VT::Long);
+            push(VT::Long);
+            break;
+        case OpCodes::ineg:
+            convert(VT::Integer, VT::Integer);
+            break;
+        case OpCodes::lneg:
+            convert(VT::Long, VT::Long);
+            break;
+        case OpCodes::fneg:
+            convert(VT::Float, VT::Float);
+            break;
+        case OpCodes::dneg:
+            convert(VT::Double, VT::Double);
+            break;
+        case OpCodes::iinc:
+            if (local(u1_at(m_bci + 1)).kind != VT::Integer) {
+                fail("Bad local variable type for iinc");
+            }
+            break;
+
+        // Conversions
+        case OpCodes::i2l:
+            convert(VT::Integer, VT::Long);
+            break;
+        case OpCodes::i2f:
+            convert(VT::Integer, VT::Float);
+            break;
+        case OpCodes::i2d:
+            convert(VT::Integer, VT::Double);
+            break;
+        case OpCodes::l2i:
+            convert(VT::Long, VT::Integer);
+            break;
+        case OpCodes::l2f:
+            convert(VT::Long, VT::Float);
+            break;
+        case OpCodes::l2d:
+            convert(VT::Long, VT::Double);
+            break;
+        case OpCodes::f2i:
+            convert(VT::Float, VT::Integer);
+            break;
+        case OpCodes::f2l:
+            convert(VT::Float, VT::Long);
+            break;
+        case OpCodes::f2d:
+            convert(VT::Float, VT::Double);
+            break;
+        case OpCodes::d2i:
+            convert(VT::Double, VT::Integer);
+            break;
+        case OpCodes::d2l:
+            convert(VT::Double, VT::Long);
+            break;
+        case OpCodes::d2f:
+            convert(VT::Double, VT::Float);
+            break;
+        case OpCodes::i2b:
+        case OpCodes::i2c:
+        case OpCodes::i2s:
+            convert(VT::Integer, VT::Integer);
+            break;
+
+        // Comparisons
+        case OpCodes::lcmp:
+            pop(VT::Long);
+            pop(VT::Long);
+            push(VT::Integer);
+            break;
+        case OpCodes::fcmpl:
+        case OpCodes::fcmpg:
+            pop(VT::Float);
+            pop(VT::Float);
+            push(VT::Integer);
+            break;
+        case OpCodes::dcmpl:
+        case OpCodes::dcmpg:
+            pop(VT::Double);
+            pop(VT::Double);
+            push(VT::Integer);
+            break;
+        case OpCodes::ifeq:
+        case OpCodes::ifne:
+        case OpCodes::iflt:
+        case OpCodes::ifge:
+        case OpCodes::ifgt:
+        case OpCodes::ifle:
+            pop(VT::Integer);
+            flow(branch_target(static_cast<s2>(u2_at(m_bci + 1))), m_state, false);
+            break;
+        case OpCodes::if_icmpeq:
+        case OpCodes::if_icmpne:
+        case OpCodes::if_icmplt:
+        case OpCodes::if_icmpge:
+        case OpCodes::if_icmpgt:
+        case OpCodes::if_icmple:
+            pop(VT::Integer);
+            pop(VT::Integer);
+            flow(branch_target(static_cast<s2>(u2_at(m_bci + 1))), m_state, false);
+            break;
+        case OpCodes::if_acmpeq:
+        case OpCodes::if_acmpne:
+            pop_any_reference();
+            pop_any_reference();
+            flow(branch_target(static_cast<s2>(u2_at(m_bci + 1))), m_state, false);
+            break;
+        case OpCodes::ifnull:
+        case OpCodes::ifnonnull:
+            pop_any_reference();
+            flow(branch_target(static_cast<s2>(u2_at(m_bci + 1))), m_state, false);
+            break;
+
+        // Control
+        case OpCodes::goto_:
+            flow(branch_target(static_cast<s2>(u2_at(m_bci + 1))), m_state, false);
+            falls_through = false;
+            break;
+        case OpCodes::goto_w:
+            flow(branch_target(s4_at(m_bci + 1)), m_state, false);
+            falls_through = false;
+            break;
+        case OpCodes::tableswitch:
+        case OpCodes::lookupswitch: {
+            pop(VT::Integer);
+            size_t operands = (m_bci + 4) & ~size_t{3};
+            flow(branch_target(s4_at(operands)), m_state, false);
+            if (opcode == OpCodes::tableswitch) {
+                for (size_t offset = operands + 12; offset < m_bci + length; offset += 4) {
+                    flow(branch_target(s4_at(offset)), m_state, false);
+                }
+            } else {
+                for (size_t offset = operands + 8; offset < m_bci + length; offset += 8) {
+                    flow(branch_target(s4_at(offset + 4)), m_state, false);
+                }
+            }
+            falls_through = false;
+            break;
+        }
+        case OpCodes::ireturn:
+            do_return(VT::Integer);
+            falls_through = false;
+            break;
+        case OpCodes::lreturn:
+            do_return(VT::Long);
+            falls_through = false;
+            break;
+        case OpCodes::freturn:
+            do_return(VT::Float);
+            falls_through = false;
+            break;
+        case OpCodes::dreturn:
+            do_return(VT::Double);
+            falls_through = false;
+            break;
+        case OpCodes::areturn:
+            do_return(VT::Reference);
+            falls_through = false;
+            break;
+        case OpCodes::return_:
+            do_return({});
+            falls_through = false;
+            break;
+
+        // References
+        case OpCodes::getstatic:
+        case OpCodes::putstatic:
+        case OpCodes::getfield:
+        case OpCodes::putfield: {
+            auto &field = constant<CONSTANT_Fieldref_info>(u2_at(m_bci + 1));
+            auto kind = field_kind(field.name_and_type->descriptor->value);
+            if (opcode == OpCodes::getstatic) {
+                push(kind);
+            } else if (opcode == OpCodes::putstatic) {
+                pop(kind);
+            } else if (opcode == OpCodes::getfield) {
+                pop(VT::Reference);
+                push(kind);
+            } else {
+                pop(kind);
+                // Constructors may assign their fields before they call the other constructor
+                auto object = pop_any_reference();
+                if (object.kind == VT::Uninitialized) {
+                    fail("Bad type on operand stack for putfield");
+                }
+            }
+            break;
+        }
+        case OpCodes::invokevirtual:
+        case OpCodes::invokespecial:
+        case OpCodes::invokestatic:
+        case OpCodes::invokeinterface:
+        case OpCodes::invokedynamic:
+            invoke(opcode, u2_at(m_bci + 1));
+            break;
+        case OpCodes::new_:
+            constant<CONSTANT_Class_info>(u2_at(m_bci + 1));
+            push(Type{VT::Uninitialized, static_cast<u2>(m_bci)});
+            break;
+        case OpCodes::newarray:
+            if (u1_at(m_bci + 1) < 4 || u1_at(m_bci + 1) > 11) {
+                fail("Illegal array type");
+            }
+            convert(VT::Integer, VT::Reference);
+            break;
+        case OpCodes::anewarray:
+            constant<CONSTANT_Class_info>(u2_at(m_bci + 1));
+            convert(VT::Integer, VT::Reference);
+            break;
+        case OpCodes::arraylength:
+            convert(VT::Reference, VT::Integer);
+            break;
+        case OpCodes::athrow:
+            pop(VT::Reference);
+            falls_through = false;
+            break;
+        case OpCodes::checkcast:
+            constant<CONSTANT_Class_info>(u2_at(m_bci + 1));
+            convert(VT::Reference, VT::Reference);
+            break;
+        case OpCodes::instanceof:
+            constant<CONSTANT_Class_info>(u2_at(m_bci + 1));
+            convert(VT::Reference, VT::Integer);
+            break;
+        case OpCodes::monitorenter:
+        case OpCodes::monitorexit:
+            pop(VT::Reference);
+            break;
+
+        // Extended
+        case OpCodes::wide: {
+            auto wide_opcode = static_cast<OpCodes>(u1_at(m_bci + 1));
+            u2 index = u2_at(m_bci + 2);
+            switch (wide_opcode) {
+                case OpCodes::iload:
+                    load(index, VT::Integer);
+                    break;
+                case OpCodes::lload:
+                    load(index, VT::Long);
+                    break;
+                case OpCodes::fload:
+                    load(index, VT::Float);
+                    break;
+                case OpCodes::dload:
+                    load(index, VT::Double);
+                    break;
+                case OpCodes::aload: {
+                    auto type = local(index);
+                    if (!is_reference(type.kind)) {
+                        fail("Bad local variable type for aload");
+                    }
+                    push(type);
+                    break;
+                }
+                case OpCodes::istore:
+                    pop(VT::Integer);
+                    store(index, {VT::Integer});
+                    break;
+                case OpCodes::lstore:
+                    pop(VT::Long);
+                    store(index, {VT::Long});
+                    break;
+                case OpCodes::fstore:
+                    pop(VT::Float);
+                    store(index, {VT::Float});
+                    break;
+                case OpCodes::dstore:
+                    pop(VT::Double);
+                    store(index, {VT::Double});
+                    break;
+                case OpCodes::astore:
+                    store(index, pop_any_reference());
+                    break;
+                case OpCodes::iinc:
+                    if (local(index).kind != VT::Integer) {
+                        fail("Bad local variable type for iinc");
+                    }
+                    break;
+                default:
+                    // ret is handled by verify
+                    fail("Illegal wide instruction");
+            }
+            break;
+        }
+        case OpCodes::multianewarray: {
+            constant<CONSTANT_Class_info>(u2_at(m_bci + 1));
+            u1 dimensions = u1_at(m_bci + 3);
+            if (dimensions == 0) {
+                fail("Illegal dimension in multianewarray");
+            }
+            for (size_t i = 0; i < dimensions; ++i) {
+                pop(VT::Integer);
+            }
+            push(VT::Reference);
+            break;
+        }
+
+        default:
+            fail("Illegal instruction " + std::to_string(static_cast<int>(opcode)));
+    }
+
+    if (falls_through) {
+        if (m_bci + length >= m_bytes.size()) {
+            fail("Falling off the end of the code");
+        }
+        flow(m_bci + length, m_state, true);
+    }
+}
+
+bool MethodVerifier::verify() {
+    find_instructions();
+    for (size_t bci = 0; bci < m_bytes.size(); bci += instruction_length(m_bytes, bci)) {
+        auto opcode = static_cast<OpCodes>(m_bytes[bci]);
+        if (opcode == OpCodes::wide) {
+            opcode = static_cast<OpCodes>(m_bytes[bci + 1]);
+        }
+        if (opcode == OpCodes::jsr || opcode == OpCodes::jsr_w || opcode == OpCodes::ret) {
+            // Subroutines are not supported by the interpreter either
+            if (m_clazz->major_version >= 51) {
+                m_bci = bci;
+                fail("jsr and ret are not allowed in class files of version 51 and above");
+            }
+            return false;
+        }
+    }
+    check_exception_table();
+
+    m_declared.assign(m_bytes.size(), false);
+    m_states.assign(m_bytes.size(), std::nullopt);
+    m_queued.assign(m_bytes.size(), false);
+
+    auto initial = initial_locals();
+    State initial_state{expand(initial, m_code.max_locals, "arguments for the locals"), {}};
+    initial_state.locals.resize(m_code.max_locals);
+
+    if (m_check_stack_maps) {
+        read_stack_map_table(initial);
+        // Code that is only reachable through a frame is checked too
+        for (size_t bci = 0; bci < m_bytes.size(); ++bci) {
+            if (m_declared[bci]) {
+                enqueue(bci);
+            }
+        }
+    }
+    flow(0, initial_state, true);
+
+    while (!m_worklist.empty()) {
+        m_bci = m_worklist.back();
+        m_worklist.pop_back();
+        m_queued[m_bci] = false;
+
+        m_state = *m_states[m_bci];
+        auto incoming_locals = m_state.locals;
+        check_handlers(incoming_locals);
+        execute();
+        // A handler can also be reached after an instruction changed the locals
+        if (m_state.locals != incoming_locals) {
+            check_handlers(m_state.locals);
+        }
+    }
+    return true;
+}
+
+MethodTypeMap MethodVerifier::type_map() const {
+    MethodTypeMap map;
+    size_t count = 0;
+    size_t types = 0;
+    for (auto const &state : m_states) {
+        if (state) {
+            ++count;
+            types += state->locals.size() + state->stack.size();
+        }
+    }
+    map.entries.reserve(count);
+    map.types.reserve(types);
+    for (size_t bci = 0; bci < m_states.size(); ++bci) {
+        if (auto const &state = m_states[bci]) {
+            map.entries.push_back({static_cast<u2>(bci), static_cast<u2>(state->stack.size()),
+                                   static_cast<u4>(map.types.size())});
+            for (auto *types : {&state->locals, &state->stack}) {
+                for (auto const &type : *types) {
+                    map.types.push_back(type.kind);
+                }
+            }
+        }
+    }
+    return map;
+}
+}
+
+void verify_class(ClassFile *clazz) {
+    for (auto &method : clazz->methods) {
+        if (method.code_attribute == nullptr) {
+            if (!method.is_native() && !method.is_abstract()) {
+                throw VerifyError("Missing Code attribute in " + std::string(clazz->name()) + "." +
+                                  std::string(method.name_index->value));
+            }
+            continue;
+        }
+        MethodVerifier verifier{clazz, method};
+        if (verifier.verify()) {
+            ClassLoaderData::Scope scope{*clazz->loader_data};
+            method.code_attribute->type_map = verifier.type_map();
+        }
+    }
+}
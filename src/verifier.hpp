@@ -0,0 +1,34 @@
+#ifndef SCHOKOVM_VERIFIER_HPP
+#define SCHOKOVM_VERIFIER_HPP
+
+#include <string>
+
+#include "classfile.hpp"
+
+struct VerifyError : std::exception {
+    std::string message;
+
+    explicit VerifyError(std::string message);
+
+    [[nodiscard]] const char *what() const noexcept override;
+};
+
+// -Xverify
+enum class VerifyMode {
+    None,
+    // Only classes that are not loaded from the runtime image (the default)
+    Remote,
+    All,
+};
+
+// Verifies the code of all methods of `clazz` and stores their type maps in the Code attributes, see
+// https://docs.oracle.com/javase/specs/jvms/se16/html/jvms-4.html#jvms-4.10
+//
+// Class files of version 50 and above are type checked with their StackMapTable, the types of older ones are
+// inferred. The types are only checked on the level of VerificationType, whether an object is an instance of the
+// class that an instruction expects is not checked.
+//
+// Methods that use jsr or ret (only allowed before version 51) are not verified and get no type map.
+void verify_class(ClassFile *clazz);
+
+#endif //SCHOKOVM_VERIFIER_HPP
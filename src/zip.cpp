@@ -1,73 +1,211 @@
-#include <optional>
-#include <vector>
-#include <zip.h>
-
 #include "zip.hpp"
 
+#include <cassert>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
 ZipException::ZipException(std::string message) : message(std::move(message)) {}
 
 const char *ZipException::what() const noexcept {
     return message.c_str();
 }
 
-ZipArchive::ZipArchive() : archive(), path(), entries() {
+namespace {
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+constexpr u4 local_file_header_signature = 0x04034b50;
+constexpr u4 central_directory_header_signature = 0x02014b50;
+constexpr u4 end_of_central_directory_signature = 0x06054b50;
+constexpr size_t local_file_header_size = 30;
+constexpr size_t central_directory_header_size = 46;
+constexpr size_t end_of_central_directory_size = 22;
+
+// All values are little-endian
+inline u2 read_u2(u1 const *data) {
+    return static_cast<u2>(data[0] | (data[1] << 8));
+}
+
+inline u4 read_u4(u1 const *data) {
+    return (u4) data[0] | ((u4) data[1] << 8) | ((u4) data[2] << 16) | ((u4) data[3] << 24);
 }
 
-ZipArchive::ZipArchive(std::string path) : archive(), path(std::move(path)), entries() {
-    int error = 0;
-    archive.reset(zip_open(this->path.c_str(), ZIP_RDONLY, &error));
-    if (archive == nullptr) {
-        throw ZipException("zip_open: " + std::to_string(error));
+// FNV-1a
+inline u4 hash_name(std::string_view name) {
+    u4 hash = 0x811c9dc5;
+    for (char c : name) {
+        hash = (hash ^ static_cast<u1>(c)) * 0x01000193;
     }
+    return hash;
+}
+}
 
-    zip_int64_t num_entries = zip_get_num_entries(archive.get(), 0);
+ZipArchive::ZipArchive(std::string path) : path(std::move(path)) {
+    int fd = open(this->path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw ZipException("Failed to open " + this->path);
+    }
+    struct stat status{};
+    if (fstat(fd, &status) != 0 || status.st_size < static_cast<off_t>(end_of_central_directory_size)) {
+        close(fd);
+        throw ZipException("Not a zip file: " + this->path);
+    }
+    m_size = static_cast<size_t>(status.st_size);
+    void *memory = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED) {
+        throw ZipException("Failed to map " + this->path);
+    }
+    m_data = static_cast<u1 const *>(memory);
+}
 
-    for (zip_uint64_t index = 0; index < (zip_uint64_t) num_entries; index++) {
-        zip_stat_t stat;
-        zip_stat_init(&stat);
-        zip_stat_index(archive.get(), index, 0, &stat);
+ZipArchive::~ZipArchive() {
+    if (m_data != nullptr) {
+        munmap(const_cast<u1 *>(m_data), m_size);
+    }
+}
 
-        if ((stat.valid & ZIP_STAT_NAME) == 0) {
-            throw ZipException("zip_stat name");
+void ZipArchive::build_index() {
+    // The end of central directory record is followed by a comment of up to 65535 bytes
+    size_t minimum = m_size > end_of_central_directory_size + 0xFFFF ? m_size - end_of_central_directory_size - 0xFFFF
+                                                                     : 0;
+    u1 const *end_record = nullptr;
+    for (size_t offset = m_size - end_of_central_directory_size + 1; offset-- > minimum;) {
+        if (read_u4(m_data + offset) == end_of_central_directory_signature) {
+            end_record = m_data + offset;
+            break;
         }
+    }
+    if (end_record == nullptr) {
+        throw ZipException("End of central directory not found in " + path);
+    }
 
-        if ((stat.valid & ZIP_STAT_SIZE) == 0) {
-            throw ZipException("zip_stat size");
+    u2 entry_count = read_u2(end_record + 10);
+    u4 directory_size = read_u4(end_record + 12);
+    u4 directory_offset = read_u4(end_record + 16);
+    if (entry_count == 0xFFFF || directory_offset == 0xFFFFFFFF) {
+        throw ZipException("ZIP64 is not supported: " + path);
+    }
+    if (static_cast<size_t>(directory_offset) + directory_size > m_size) {
+        throw ZipException("Invalid central directory in " + path);
+    }
+
+    size_t capacity = 16;
+    while (capacity < static_cast<size_t>(entry_count) * 2) {
+        capacity *= 2;
+    }
+    m_index.assign(capacity, {0, empty_slot});
+
+    size_t offset = directory_offset;
+    for (size_t i = 0; i < entry_count; ++i) {
+        if (offset + central_directory_header_size > m_size ||
+            read_u4(m_data + offset) != central_directory_header_signature) {
+            throw ZipException("Invalid central directory header in " + path);
+        }
+        u2 name_length = read_u2(m_data + offset + 28);
+        u2 extra_length = read_u2(m_data + offset + 30);
+        u2 comment_length = read_u2(m_data + offset + 32);
+        if (offset + central_directory_header_size + name_length > m_size) {
+            throw ZipException("Invalid central directory header in " + path);
         }
 
-        entries.insert({{stat.name}, {index, stat.size}});
+        std::string_view name{reinterpret_cast<char const *>(m_data + offset + central_directory_header_size),
+                              name_length};
+        u4 hash = hash_name(name);
+        size_t slot = hash & (capacity - 1);
+        while (m_index[slot].central_directory_offset != empty_slot) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        m_index[slot] = {hash, static_cast<u4>(offset)};
+
+        offset += central_directory_header_size + name_length + extra_length + comment_length;
     }
 }
 
-ZipEntry const *ZipArchive::entry_for_path(std::string const &filepath) const {
-    if (auto found = entries.find(filepath); found != entries.end()) {
-        return &found->second;
-    } else {
-        return nullptr;
+std::optional<ZipEntry> ZipArchive::entry_for_path(std::string_view filepath) {
+    std::call_once(m_index_built, [this]() { build_index(); });
+
+    u4 hash = hash_name(filepath);
+    size_t mask = m_index.size() - 1;
+    for (size_t slot = hash & mask; m_index[slot].central_directory_offset != empty_slot; slot = (slot + 1) & mask) {
+        if (m_index[slot].hash != hash) {
+            continue;
+        }
+        u1 const *header = m_data + m_index[slot].central_directory_offset;
+        std::string_view name{reinterpret_cast<char const *>(header + central_directory_header_size),
+                              read_u2(header + 28)};
+        if (name == filepath) {
+            return ZipEntry{read_u4(header + 42), read_u4(header + 20), read_u4(header + 24), read_u2(header + 10)};
+        }
     }
+    return {};
 }
 
-void ZipArchive::read(ZipEntry const &entry, std::vector<char> &buffer) const {
-    buffer.resize(entry.size);
+std::vector<std::string_view> ZipArchive::entry_names() {
+    std::call_once(m_index_built, [this]() { build_index(); });
 
-    zip_file_t *file = zip_fopen_index(archive.get(), entry.index, 0);
-    if (file == nullptr) {
-        throw ZipException("zip_fopen_index");
+    std::vector<std::string_view> names;
+    for (auto const &slot : m_index) {
+        if (slot.central_directory_offset != empty_slot) {
+            u1 const *header = m_data + slot.central_directory_offset;
+            names.emplace_back(reinterpret_cast<char const *>(header + central_directory_header_size),
+                               read_u2(header + 28));
+        }
     }
+    return names;
+}
 
-    zip_int64_t length = zip_fread(file, buffer.data(), buffer.size());
-
-    if (zip_fclose(file) != 0) {
-        throw ZipException("zip_fclose failed (zip_fread length was " + std::to_string(length) + ")");
+std::span<u1 const> ZipArchive::raw_contents(ZipEntry const &entry) const {
+    // read and stored_contents use the contents as the uncompressed data of stored entries
+    if (entry.is_stored() && entry.size != entry.compressed_size) {
+        throw ZipException("Stored entry with different sizes in " + path);
+    }
+    if (static_cast<size_t>(entry.offset) + local_file_header_size > m_size ||
+        read_u4(m_data + entry.offset) != local_file_header_signature) {
+        throw ZipException("Invalid local file header in " + path);
+    }
+    // The lengths can differ from those in the central directory
+    u1 const *header = m_data + entry.offset;
+    size_t start = entry.offset + local_file_header_size + read_u2(header + 26) + read_u2(header + 28);
+    if (start + entry.compressed_size > m_size) {
+        throw ZipException("Entry exceeds the end of " + path);
     }
+    return {m_data + start, entry.compressed_size};
+}
 
-    if (length == -1) {
-        throw ZipException("zip_fread failed");
+std::span<u1 const> ZipArchive::stored_contents(ZipEntry const &entry) const {
+    assert(entry.is_stored());
+    return raw_contents(entry);
+}
+
+void ZipArchive::read(ZipEntry const &entry, u1 *destination) const {
+    auto contents = raw_contents(entry);
+    if (entry.is_stored()) {
+        std::memcpy(destination, contents.data(), entry.size);
+        return;
+    }
+    if (entry.method != Z_DEFLATED) {
+        throw ZipException("Unsupported compression method " + std::to_string(entry.method) + " in " + path);
     }
 
-    if (static_cast<size_t>(length) != entry.size) {
-        throw ZipException("zip_fread: length was " + std::to_string(length) + " but the expected size was " +
-                           std::to_string(entry.size));
+    z_stream stream{};
+    // negative window bits: raw deflate data without a zlib header
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+        throw ZipException("inflateInit2 failed");
+    }
+    stream.next_in = const_cast<u1 *>(contents.data());
+    stream.avail_in = static_cast<uInt>(contents.size());
+    stream.next_out = destination;
+    stream.avail_out = entry.size;
+    int result = inflate(&stream, Z_FINISH);
+    auto length = stream.total_out;
+    inflateEnd(&stream);
+
+    if (result != Z_STREAM_END || length != entry.size) {
+        throw ZipException("inflate failed (" + std::to_string(result) + "): length was " + std::to_string(length) +
+                           " but the expected size was " + std::to_string(entry.size));
     }
 }
-
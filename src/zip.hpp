@@ -1,10 +1,14 @@
 #ifndef SCHOKOVM_ZIP_HPP
 #define SCHOKOVM_ZIP_HPP
 
-#include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
-#include <unordered_map>
-#include <zip.h>
+#include <string_view>
+#include <vector>
+
+#include "types.hpp"
 
 struct ZipException : std::exception {
     std::string message;
@@ -15,28 +19,57 @@ struct ZipException : std::exception {
 };
 
 struct ZipEntry {
-    zip_uint64_t index;
-    size_t size;
-};
+    // Offset of the local file header
+    u4 offset;
+    u4 compressed_size;
+    u4 size;
+    // 0 (stored) or 8 (deflated)
+    u2 method;
 
-struct ZipDeleter {
-    void operator()(zip_t *pointer) noexcept {
-        zip_discard(pointer);
-    }
+    [[nodiscard]] bool is_stored() const { return method == 0; }
 };
 
+// A zip (or jar) file that is mapped into memory. The central directory is only indexed on the first lookup.
+// ZIP64 archives are not supported.
 struct ZipArchive {
-    std::unique_ptr<zip_t, ZipDeleter> archive;
+    explicit ZipArchive(std::string path);
+
+    ZipArchive(ZipArchive const &) = delete;
+
+    ZipArchive &operator=(ZipArchive const &) = delete;
+
+    ~ZipArchive();
+
     std::string path;
-    std::unordered_map<std::string, ZipEntry> entries;
 
-    ZipArchive();
+    std::optional<ZipEntry> entry_for_path(std::string_view filepath);
 
-    explicit ZipArchive(std::string path);
+    // The names of all entries, in no particular order. They point into the mapping of the archive.
+    std::vector<std::string_view> entry_names();
+
+    // The contents of a stored entry, they point into the mapping of the archive
+    [[nodiscard]] std::span<u1 const> stored_contents(ZipEntry const &entry) const;
+
+    // `destination` has to be large enough for ZipEntry::size bytes
+    void read(ZipEntry const &entry, u1 *destination) const;
+
+private:
+    u1 const *m_data = nullptr;
+    size_t m_size = 0;
+
+    // Open addressing with linear probing, the entries are offsets of central directory headers
+    struct Slot {
+        u4 hash;
+        u4 central_directory_offset;
+    };
+    static constexpr u4 empty_slot = 0xFFFFFFFF;
+
+    std::once_flag m_index_built;
+    std::vector<Slot> m_index;
 
-    ZipEntry const *entry_for_path(std::string const &filepath) const;
+    void build_index();
 
-    void read(ZipEntry const &entry, std::vector<char> &buffer) const;
+    [[nodiscard]] std::span<u1 const> raw_contents(ZipEntry const &entry) const;
 };
 
 #endif //SCHOKOVM_ZIP_HPP
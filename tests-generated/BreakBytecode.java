@@ -0,0 +1,125 @@
+import java.io.IOException;
+import java.io.InputStream;
+import java.io.OutputStream;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.nio.file.Files;
+import java.nio.file.Path;
+import java.nio.file.Paths;
+import java.util.LinkedHashMap;
+import java.util.Map;
+import java.util.zip.ZipEntry;
+import java.util.zip.ZipInputStream;
+import java.util.zip.ZipOutputStream;
+
+// javac does not produce bytecode that fails verification: This replaces the first instruction of a method of a class
+// in a jar with aconst_null.
+// Usage: BreakBytecode <jar> <class> <method>
+public class BreakBytecode {
+    public static void main(String[] args) throws IOException {
+        Path jar = Paths.get(args[0]);
+        String entryName = args[1] + ".class";
+
+        Map<String, byte[]> entries = new LinkedHashMap<>();
+        try (InputStream file = Files.newInputStream(jar); ZipInputStream in = new ZipInputStream(file)) {
+            for (ZipEntry entry = in.getNextEntry(); entry != null; entry = in.getNextEntry()) {
+                entries.put(entry.getName(), in.readAllBytes());
+            }
+        }
+        byte[] bytes = entries.get(entryName);
+        if (bytes == null) {
+            throw new IllegalArgumentException(entryName + " is not in " + jar);
+        }
+        bytes[codeOffset(bytes, args[2])] = 0x01; // aconst_null
+
+        try (OutputStream file = Files.newOutputStream(jar); ZipOutputStream out = new ZipOutputStream(file)) {
+            for (Map.Entry<String, byte[]> entry : entries.entrySet()) {
+                out.putNextEntry(new ZipEntry(entry.getKey()));
+                out.write(entry.getValue());
+                out.closeEntry();
+            }
+        }
+    }
+
+    // The offset of the code of the method in the class file
+    static int codeOffset(byte[] bytes, String method) {
+        ByteBuffer in = ByteBuffer.wrap(bytes);
+        in.position(8);
+        int constantCount = u2(in);
+        String[] utf8 = new String[constantCount];
+        for (int i = 1; i < constantCount; i++) {
+            int tag = in.get();
+            switch (tag) {
+                case 1: // Utf8, the names that are looked up are ASCII
+                    int length = u2(in);
+                    utf8[i] = new String(bytes, in.position(), length, StandardCharsets.UTF_8);
+                    skip(in, length);
+                    break;
+                case 5: // Long
+                case 6: // Double
+                    skip(in, 8);
+                    i++;
+                    break;
+                case 3: // Integer
+                case 4: // Float
+                case 9: // Fieldref
+                case 10: // Methodref
+                case 11: // InterfaceMethodref
+                case 12: // NameAndType
+                case 17: // Dynamic
+                case 18: // InvokeDynamic
+                    skip(in, 4);
+                    break;
+                case 15: // MethodHandle
+                    skip(in, 3);
+                    break;
+                case 7: // Class
+                case 8: // String
+                case 16: // MethodType
+                case 19: // Module
+                case 20: // Package
+                    skip(in, 2);
+                    break;
+                default:
+                    throw new IllegalArgumentException("Unknown constant pool tag " + tag);
+            }
+        }
+
+        skip(in, 6); // access flags, this class, super class
+        skip(in, 2 * u2(in)); // interfaces
+        int fieldCount = u2(in);
+        for (int i = 0; i < fieldCount; i++) {
+            skip(in, 6); // access flags, name, descriptor
+            int attributeCount = u2(in);
+            for (int j = 0; j < attributeCount; j++) {
+                skip(in, 2);
+                skip(in, in.getInt());
+            }
+        }
+        int methodCount = u2(in);
+        for (int i = 0; i < methodCount; i++) {
+            skip(in, 2); // access flags
+            String name = utf8[u2(in)];
+            skip(in, 2); // descriptor
+            int attributeCount = u2(in);
+            for (int j = 0; j < attributeCount; j++) {
+                String attributeName = utf8[u2(in)];
+                int length = in.getInt();
+                if (name.equals(method) && attributeName.equals("Code")) {
+                    // max_stack, max_locals, code_length
+                    return in.position() + 8;
+                }
+                skip(in, length);
+            }
+        }
+        throw new IllegalArgumentException("No method " + method + " with code");
+    }
+
+    static int u2(ByteBuffer in) {
+        return in.getShort() & 0xffff;
+    }
+
+    static void skip(ByteBuffer in, int count) {
+        in.position(in.position() + count);
+    }
+}
@@ -44,6 +44,14 @@ public class Fields {
         int child2;
     }
 
+    static class MyObjectGrandChild extends MyObjectChild {
+        byte grandChild1;
+        long grandChild2;
+        short grandChild3;
+        Object grandChild4;
+        char grandChild5;
+    }
+
     static class MyStatic {
         static boolean bool = true;
         static byte b = 99;
@@ -130,6 +138,27 @@ public class Fields {
         object3.child2 = 42;
         printMyObjectChild(object3);
 
+        // fields that fill the gaps left by the superclasses
+        MyObjectGrandChild object4 = new MyObjectGrandChild();
+        object4.child1 = true;
+        object4.child2 = -7;
+        object4.grandChild1 = -3;
+        object4.grandChild2 = Long.MIN_VALUE;
+        object4.grandChild3 = Short.MIN_VALUE;
+        object4.grandChild4 = object4;
+        object4.grandChild5 = Character.MAX_VALUE;
+        object4.b = Byte.MAX_VALUE;
+        printMyObjectChild(object4);
+        println(object4.grandChild1);
+        println(object4.grandChild2);
+        println(object4.grandChild3);
+        println(object4.grandChild4 == object4);
+        println(object4.grandChild5);
+        MyObjectGrandChild object5 = (MyObjectGrandChild) object4.clone();
+        println(object5.grandChild2);
+        println(object5.grandChild4 == object4);
+        println(object5.grandChild5);
+
         // initial static values
         println(MyStaticSub.b);
         println(MyStaticSub.i);
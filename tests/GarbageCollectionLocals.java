@@ -0,0 +1,63 @@
+public class GarbageCollectionLocals {
+    static int[] garbage() {
+        int[] last = null;
+        for (int i = 0; i < 200; i++) {
+            last = new int[16];
+            last[0] = i;
+        }
+        return last;
+    }
+
+    static String string(char first, char second) {
+        return new String(new char[]{first, second});
+    }
+
+    // The references of the callers are only in their locals while this collects
+    static int nested(int[] array, String string, int depth) {
+        if (depth == 0) {
+            garbage();
+            System.gc();
+            return array.length + string.length();
+        }
+        Object[] local = new Object[]{string(string.charAt(0), (char) ('0' + depth))};
+        int result = nested(array, string, depth - 1);
+        System.gc();
+        return result + ((String) local[0]).length() + local.length;
+    }
+
+    public static void main(String[] args) {
+        int[] ints = new int[]{1, 2, 3};
+        long wide = 0x123456789L;
+        String string = string('a', 'b');
+        double other = 1.5;
+        StringBuilder builder = new StringBuilder();
+        builder.append("sb");
+        String kept = null;
+
+        for (int i = 0; i < 10; i++) {
+            // A slot that holds an int in one block and a reference in the other
+            if (i % 2 == 0) {
+                int count = i * 3;
+                garbage();
+                System.gc();
+                builder.append(count);
+            } else {
+                String temporary = string('x', (char) ('a' + i));
+                garbage();
+                System.gc();
+                builder.append(temporary);
+                kept = temporary;
+            }
+        }
+
+        System.out.println(nested(ints, string, 5));
+        System.gc();
+
+        System.out.println(ints[0] + ints[1] + ints[2]);
+        System.out.println(wide);
+        System.out.println(string);
+        System.out.println(other);
+        System.out.println(builder.toString());
+        System.out.println(kept);
+    }
+}
@@ -0,0 +1,47 @@
+import java.util.Arrays;
+
+public class IdentityHashCode {
+
+    public static void main(String[] args) {
+        Object[] objects = new Object[10000];
+        int[] hashes = new int[objects.length];
+        for (int i = 0; i < objects.length; i++) {
+            objects[i] = new Object();
+            hashes[i] = System.identityHashCode(objects[i]);
+        }
+
+        // allocate garbage and collect it
+        for (int i = 0; i < objects.length; i++) {
+            new Object();
+        }
+        System.gc();
+
+        boolean stable = true;
+        for (int i = 0; i < objects.length; i++) {
+            stable &= hashes[i] == objects[i].hashCode();
+        }
+        System.out.println(stable);
+
+        // hashes should be well distributed
+        int[] sorted = hashes.clone();
+        Arrays.sort(sorted);
+        int distinct = 1;
+        for (int i = 1; i < sorted.length; i++) {
+            if (sorted[i] != sorted[i - 1]) {
+                distinct++;
+            }
+        }
+        System.out.println(distinct > objects.length * 99 / 100);
+
+        // the lowest bits are used by HashMap
+        int[] buckets = new int[16];
+        for (int hash : hashes) {
+            buckets[hash & 15]++;
+        }
+        boolean balanced = true;
+        for (int bucket : buckets) {
+            balanced &= bucket > objects.length / 32;
+        }
+        System.out.println(balanced);
+    }
+}
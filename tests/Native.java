@@ -32,6 +32,26 @@ public class Native {
     public static native byte[] strings(String str, int start, int len);
     public static native byte[] strings8(String str, int start, int len);
 
+    // Call back into received with Call*Method and Call*MethodA
+    public static native long callStatic(int i, float f, long j, double d);
+    public native long callVirtual(int i, float f, long j, double d);
+
+    public static long received(int i, float f, long j, double d) {
+        println(i);
+        println(f);
+        println(j);
+        println(d);
+        return j - i;
+    }
+
+    public long receivedVirtual(int i, float f, long j, double d) {
+        println(d);
+        println(j);
+        println(f);
+        println(i);
+        return j + i;
+    }
+
     public static native int summm(
                   int a1, int a2, int a3, int a4, int a5, int a6, int a7, int a8, int a9, int a10,
                   int a11, int a12, int a13, int a14, int a15, int a16, int a17, int a18, int a19
@@ -66,6 +86,9 @@ public class Native {
 
         println(summm(1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19));
 
+        println(callStatic(-7, 2.5f, 0x123456789ABL, -0.125));
+        println(n.callVirtual(Integer.MAX_VALUE, -1e-3f, Long.MIN_VALUE, 1e300));
+
         println(overloaded(123));
         println(overloaded(123L));
         println(overloaded("abcdef"));
@@ -74,5 +97,10 @@ public class Native {
         println(x);
         println(java.util.Arrays.toString(strings(x, 3, 10)));
         println(java.util.Arrays.toString(strings8(x, 3, 10)));
+        // compressed (Latin-1) strings
+        String latin = "Gr\u00fc\u00dfe, \u00a5 world!";
+        println(latin);
+        println(java.util.Arrays.toString(strings(latin, 2, 6)));
+        println(java.util.Arrays.toString(strings8(latin, 2, 6)));
     }
 }
@@ -70,6 +70,35 @@ Java_Native_third(JNIEnv *, jobject, jint, jint, jint x) {
     return x;
 }
 
+// Variadic arguments are promoted (float to double), the jvalues are not
+JNIEXPORT jlong JNICALL
+Java_Native_callStatic(JNIEnv *env, jclass clazz, jint i, jfloat f, jlong j, jdouble d) {
+    jmethodID method = env->GetStaticMethodID(clazz, "received", "(IFJD)J");
+    jlong first = env->CallStaticLongMethod(clazz, method, i, static_cast<jdouble>(f), j, d);
+
+    jvalue args[4];
+    args[0].i = i;
+    args[1].f = f;
+    args[2].j = j;
+    args[3].d = d;
+    jlong second = env->CallStaticLongMethodA(clazz, method, args);
+    return first ^ second;
+}
+
+JNIEXPORT jlong JNICALL
+Java_Native_callVirtual(JNIEnv *env, jobject object, jint i, jfloat f, jlong j, jdouble d) {
+    jmethodID method = env->GetMethodID(env->GetObjectClass(object), "receivedVirtual", "(IFJD)J");
+    jlong first = env->CallLongMethod(object, method, i, static_cast<jdouble>(f), j, d);
+
+    jvalue args[4];
+    args[0].i = i;
+    args[1].f = f;
+    args[2].j = j;
+    args[3].d = d;
+    jlong second = env->CallLongMethodA(object, method, args);
+    return first ^ second;
+}
+
 JNIEXPORT jint JNICALL
 Java_Native_summm(JNIEnv *, jclass,
                   jint a1, jint a2, jint a3, jint a4, jint a5, jint a6, jint a7, jint a8, jint a9, jint a10,
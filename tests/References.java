@@ -0,0 +1,71 @@
+import java.lang.ref.PhantomReference;
+import java.lang.ref.Reference;
+import java.lang.ref.ReferenceQueue;
+import java.lang.ref.SoftReference;
+import java.lang.ref.WeakReference;
+import java.util.WeakHashMap;
+
+public class References {
+
+    static Object strong = new Object();
+
+    // The referents are created in separate methods, so that they are not left in a local variable
+    static WeakReference<Object> weak(ReferenceQueue<Object> queue) {
+        return new WeakReference<>(new Object(), queue);
+    }
+
+    static PhantomReference<Object> phantom(ReferenceQueue<Object> queue) {
+        return new PhantomReference<>(new Object(), queue);
+    }
+
+    static SoftReference<Object> soft() {
+        return new SoftReference<>(new Object());
+    }
+
+    static void fill(WeakHashMap<Object, String> map) {
+        for (int i = 0; i < 100; i++) {
+            map.put(new Object(), "value");
+        }
+        map.put(strong, "strong");
+    }
+
+    public static void main(String[] args) {
+        ReferenceQueue<Object> queue = new ReferenceQueue<>();
+        WeakReference<Object> weak = weak(queue);
+        WeakReference<Object> weakStrong = new WeakReference<>(strong, queue);
+        PhantomReference<Object> phantom = phantom(queue);
+        SoftReference<Object> soft = soft();
+
+        System.out.println(weak.get() != null);
+        System.out.println(weakStrong.get() == strong);
+        System.out.println(phantom.get() == null);
+
+        System.gc();
+
+        System.out.println(weak.get() == null);
+        System.out.println(weakStrong.get() == strong);
+        // there is no memory pressure
+        System.out.println(soft.get() != null);
+
+        // The Reference Handler enqueues the cleared references
+        try {
+            Reference<?> first = queue.remove();
+            Reference<?> second = queue.remove();
+            System.out.println(first == weak || second == weak);
+            System.out.println(first == phantom || second == phantom);
+            System.out.println(queue.poll() == null);
+        } catch (InterruptedException e) {
+            System.out.println(e);
+        }
+
+        WeakHashMap<Object, String> map = new WeakHashMap<>();
+        fill(map);
+        System.out.println(map.size());
+        // stale entries are expunged once the Reference Handler enqueued them
+        for (int i = 0; i < 100 && map.size() > 1; i++) {
+            System.gc();
+        }
+        System.out.println(map.size());
+        System.out.println(map.get(strong));
+    }
+}
@@ -0,0 +1,29 @@
+public class StringDeduplication {
+    static String make(char... chars) {
+        return new String(chars);
+    }
+
+    public static void main(String[] args) {
+        String interned = make('d', 'e', 'd', 'u', 'p').intern();
+        String equal = make('d', 'e', 'd', 'u', 'p');
+        String other = make('d', 'e', 'd', 'u', 'p');
+        System.out.println(interned == equal);
+
+        // Deduplication happens for strings that survive a collection, the arrays that were replaced are freed by the
+        // next one and their memory is reused by the allocations after it
+        System.gc();
+        System.gc();
+        for (int i = 0; i < 1000; i++) {
+            byte[] garbage = new byte[5];
+            garbage[0] = (byte) i;
+        }
+
+        System.out.println(equal.intern() == interned);
+        System.out.println(other.intern() == interned);
+        System.out.println(make('d', 'e', 'd', 'u', 'p').intern() == interned);
+        System.out.println(make('d', 'e', 'd', 'u', 'x').intern() == interned);
+        System.out.println(interned);
+        System.out.println(equal);
+        System.out.println(other.equals(interned));
+    }
+}
@@ -0,0 +1,279 @@
+public class StringTranscoding {
+    static void println(int i) { System.out.println(i); }
+    static void println(boolean b) { System.out.println(b); }
+
+    // String literals go from the modified UTF-8 of the class file to Latin-1 or UTF-16 strings, and the JNI calls of
+    // Native.strings and Native.strings8 copy them back out. The ASCII runs are transcoded in blocks of 8, 16 or 32
+    // bytes or chars: Every string has one special char (Latin-1, beyond Latin-1, a surrogate pair or U+0000, which is
+    // C0 80 in modified UTF-8) right before or at such a boundary, or at the end.
+    static final String[][] STRINGS = {
+            {"abcdefg\u00e9ABCDEFG", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEF", "\u00e9"},
+            {"abcdefghijklmn\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFG", "\u0080"},
+            {"abcdefgh\u0080ABCDEF", "\u0080"},
+            {"abcdefghijklmn\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFG", "\u00ff"},
+            {"abcdefgh\u00ffABCDEF", "\u00ff"},
+            {"abcdefghijklmn\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFG", "\u0100"},
+            {"abcdefgh\u0100ABCDEF", "\u0100"},
+            {"abcdefghijklmn\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFG", "\u20ac"},
+            {"abcdefgh\u20acABCDEF", "\u20ac"},
+            {"abcdefghijklmn\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEF", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDE", "\ud83d\udc1f"},
+            {"abcdefghijklm\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFG", "\u0000"},
+            {"abcdefgh\u0000ABCDEF", "\u0000"},
+            {"abcdefghijklmn\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGH", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFG", "\u00e9"},
+            {"abcdefghijklmno\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGH", "\u0080"},
+            {"abcdefgh\u0080ABCDEFG", "\u0080"},
+            {"abcdefghijklmno\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGH", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFG", "\u00ff"},
+            {"abcdefghijklmno\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGH", "\u0100"},
+            {"abcdefgh\u0100ABCDEFG", "\u0100"},
+            {"abcdefghijklmno\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGH", "\u20ac"},
+            {"abcdefgh\u20acABCDEFG", "\u20ac"},
+            {"abcdefghijklmno\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFG", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEF", "\ud83d\udc1f"},
+            {"abcdefghijklmn\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGH", "\u0000"},
+            {"abcdefgh\u0000ABCDEFG", "\u0000"},
+            {"abcdefghijklmno\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGHI", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFGH", "\u00e9"},
+            {"abcdefghijklmno\u00e9A", "\u00e9"},
+            {"abcdefghijklmnop\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGHI", "\u0080"},
+            {"abcdefgh\u0080ABCDEFGH", "\u0080"},
+            {"abcdefghijklmno\u0080A", "\u0080"},
+            {"abcdefghijklmnop\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGHI", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFGH", "\u00ff"},
+            {"abcdefghijklmno\u00ffA", "\u00ff"},
+            {"abcdefghijklmnop\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGHI", "\u0100"},
+            {"abcdefgh\u0100ABCDEFGH", "\u0100"},
+            {"abcdefghijklmno\u0100A", "\u0100"},
+            {"abcdefghijklmnop\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGHI", "\u20ac"},
+            {"abcdefgh\u20acABCDEFGH", "\u20ac"},
+            {"abcdefghijklmno\u20acA", "\u20ac"},
+            {"abcdefghijklmnop\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFGH", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEFG", "\ud83d\udc1f"},
+            {"abcdefghijklmno\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGHI", "\u0000"},
+            {"abcdefgh\u0000ABCDEFGH", "\u0000"},
+            {"abcdefghijklmno\u0000A", "\u0000"},
+            {"abcdefghijklmnop\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGHIJKLMNOPQRSTUVW", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFGHIJKLMNOPQRSTUV", "\u00e9"},
+            {"abcdefghijklmno\u00e9ABCDEFGHIJKLMNO", "\u00e9"},
+            {"abcdefghijklmnop\u00e9ABCDEFGHIJKLMN", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGHIJKLMNOPQRSTUVW", "\u0080"},
+            {"abcdefgh\u0080ABCDEFGHIJKLMNOPQRSTUV", "\u0080"},
+            {"abcdefghijklmno\u0080ABCDEFGHIJKLMNO", "\u0080"},
+            {"abcdefghijklmnop\u0080ABCDEFGHIJKLMN", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGHIJKLMNOPQRSTUVW", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFGHIJKLMNOPQRSTUV", "\u00ff"},
+            {"abcdefghijklmno\u00ffABCDEFGHIJKLMNO", "\u00ff"},
+            {"abcdefghijklmnop\u00ffABCDEFGHIJKLMN", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGHIJKLMNOPQRSTUVW", "\u0100"},
+            {"abcdefgh\u0100ABCDEFGHIJKLMNOPQRSTUV", "\u0100"},
+            {"abcdefghijklmno\u0100ABCDEFGHIJKLMNO", "\u0100"},
+            {"abcdefghijklmnop\u0100ABCDEFGHIJKLMN", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGHIJKLMNOPQRSTUVW", "\u20ac"},
+            {"abcdefgh\u20acABCDEFGHIJKLMNOPQRSTUV", "\u20ac"},
+            {"abcdefghijklmno\u20acABCDEFGHIJKLMNO", "\u20ac"},
+            {"abcdefghijklmnop\u20acABCDEFGHIJKLMN", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUV", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEFGHIJKLMNOPQRSTU", "\ud83d\udc1f"},
+            {"abcdefghijklmno\ud83d\udc1fABCDEFGHIJKLMN", "\ud83d\udc1f"},
+            {"abcdefghijklmnop\ud83d\udc1fABCDEFGHIJKLM", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabc\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGHIJKLMNOPQRSTUVW", "\u0000"},
+            {"abcdefgh\u0000ABCDEFGHIJKLMNOPQRSTUV", "\u0000"},
+            {"abcdefghijklmno\u0000ABCDEFGHIJKLMNO", "\u0000"},
+            {"abcdefghijklmnop\u0000ABCDEFGHIJKLMN", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGHIJKLMNOPQRSTUVWX", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFGHIJKLMNOPQRSTUVW", "\u00e9"},
+            {"abcdefghijklmno\u00e9ABCDEFGHIJKLMNOP", "\u00e9"},
+            {"abcdefghijklmnop\u00e9ABCDEFGHIJKLMNO", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGHIJKLMNOPQRSTUVWX", "\u0080"},
+            {"abcdefgh\u0080ABCDEFGHIJKLMNOPQRSTUVW", "\u0080"},
+            {"abcdefghijklmno\u0080ABCDEFGHIJKLMNOP", "\u0080"},
+            {"abcdefghijklmnop\u0080ABCDEFGHIJKLMNO", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGHIJKLMNOPQRSTUVWX", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFGHIJKLMNOPQRSTUVW", "\u00ff"},
+            {"abcdefghijklmno\u00ffABCDEFGHIJKLMNOP", "\u00ff"},
+            {"abcdefghijklmnop\u00ffABCDEFGHIJKLMNO", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGHIJKLMNOPQRSTUVWX", "\u0100"},
+            {"abcdefgh\u0100ABCDEFGHIJKLMNOPQRSTUVW", "\u0100"},
+            {"abcdefghijklmno\u0100ABCDEFGHIJKLMNOP", "\u0100"},
+            {"abcdefghijklmnop\u0100ABCDEFGHIJKLMNO", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGHIJKLMNOPQRSTUVWX", "\u20ac"},
+            {"abcdefgh\u20acABCDEFGHIJKLMNOPQRSTUVW", "\u20ac"},
+            {"abcdefghijklmno\u20acABCDEFGHIJKLMNOP", "\u20ac"},
+            {"abcdefghijklmnop\u20acABCDEFGHIJKLMNO", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVW", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUV", "\ud83d\udc1f"},
+            {"abcdefghijklmno\ud83d\udc1fABCDEFGHIJKLMNO", "\ud83d\udc1f"},
+            {"abcdefghijklmnop\ud83d\udc1fABCDEFGHIJKLMN", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabcd\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGHIJKLMNOPQRSTUVWX", "\u0000"},
+            {"abcdefgh\u0000ABCDEFGHIJKLMNOPQRSTUVW", "\u0000"},
+            {"abcdefghijklmno\u0000ABCDEFGHIJKLMNOP", "\u0000"},
+            {"abcdefghijklmnop\u0000ABCDEFGHIJKLMNO", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGHIJKLMNOPQRSTUVWXY", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFGHIJKLMNOPQRSTUVWX", "\u00e9"},
+            {"abcdefghijklmno\u00e9ABCDEFGHIJKLMNOPQ", "\u00e9"},
+            {"abcdefghijklmnop\u00e9ABCDEFGHIJKLMNOP", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00e9A", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGHIJKLMNOPQRSTUVWXY", "\u0080"},
+            {"abcdefgh\u0080ABCDEFGHIJKLMNOPQRSTUVWX", "\u0080"},
+            {"abcdefghijklmno\u0080ABCDEFGHIJKLMNOPQ", "\u0080"},
+            {"abcdefghijklmnop\u0080ABCDEFGHIJKLMNOP", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0080A", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGHIJKLMNOPQRSTUVWXY", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFGHIJKLMNOPQRSTUVWX", "\u00ff"},
+            {"abcdefghijklmno\u00ffABCDEFGHIJKLMNOPQ", "\u00ff"},
+            {"abcdefghijklmnop\u00ffABCDEFGHIJKLMNOP", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00ffA", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGHIJKLMNOPQRSTUVWXY", "\u0100"},
+            {"abcdefgh\u0100ABCDEFGHIJKLMNOPQRSTUVWX", "\u0100"},
+            {"abcdefghijklmno\u0100ABCDEFGHIJKLMNOPQ", "\u0100"},
+            {"abcdefghijklmnop\u0100ABCDEFGHIJKLMNOP", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0100A", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGHIJKLMNOPQRSTUVWXY", "\u20ac"},
+            {"abcdefgh\u20acABCDEFGHIJKLMNOPQRSTUVWX", "\u20ac"},
+            {"abcdefghijklmno\u20acABCDEFGHIJKLMNOPQ", "\u20ac"},
+            {"abcdefghijklmnop\u20acABCDEFGHIJKLMNOP", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u20acA", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWX", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVW", "\ud83d\udc1f"},
+            {"abcdefghijklmno\ud83d\udc1fABCDEFGHIJKLMNOP", "\ud83d\udc1f"},
+            {"abcdefghijklmnop\ud83d\udc1fABCDEFGHIJKLMNO", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGHIJKLMNOPQRSTUVWXY", "\u0000"},
+            {"abcdefgh\u0000ABCDEFGHIJKLMNOPQRSTUVWX", "\u0000"},
+            {"abcdefghijklmno\u0000ABCDEFGHIJKLMNOPQ", "\u0000"},
+            {"abcdefghijklmnop\u0000ABCDEFGHIJKLMNOP", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0000A", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0000", "\u0000"},
+            {"abcdefg\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u00e9"},
+            {"abcdefgh\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u00e9"},
+            {"abcdefghijklmno\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u00e9"},
+            {"abcdefghijklmnop\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u00e9ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u00e9"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u00e9", "\u00e9"},
+            {"abcdefg\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u0080"},
+            {"abcdefgh\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u0080"},
+            {"abcdefghijklmno\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u0080"},
+            {"abcdefghijklmnop\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0080ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u0080"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u0080", "\u0080"},
+            {"abcdefg\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u00ff"},
+            {"abcdefgh\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u00ff"},
+            {"abcdefghijklmno\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u00ff"},
+            {"abcdefghijklmnop\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u00ffABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u00ff"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u00ff", "\u00ff"},
+            {"abcdefg\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u0100"},
+            {"abcdefgh\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u0100"},
+            {"abcdefghijklmno\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u0100"},
+            {"abcdefghijklmnop\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0100ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u0100"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u0100", "\u0100"},
+            {"abcdefg\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u20ac"},
+            {"abcdefgh\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u20ac"},
+            {"abcdefghijklmno\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u20ac"},
+            {"abcdefghijklmnop\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u20acABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u20ac"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u20ac", "\u20ac"},
+            {"abcdefg\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\ud83d\udc1f"},
+            {"abcdefgh\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABC", "\ud83d\udc1f"},
+            {"abcdefghijklmno\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\ud83d\udc1f"},
+            {"abcdefghijklmnop\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTU", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\ud83d\udc1fABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\ud83d\udc1f"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijk\ud83d\udc1f", "\ud83d\udc1f"},
+            {"abcdefg\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCDE", "\u0000"},
+            {"abcdefgh\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVWXYZABCD", "\u0000"},
+            {"abcdefghijklmno\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUVW", "\u0000"},
+            {"abcdefghijklmnop\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFGHIJKLMNOPQRSTUV", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcde\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEFG", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcdef\u0000ABCDEFGHIJKLMNOPQRSTUVWXYZABCDEF", "\u0000"},
+            {"abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijkl\u0000", "\u0000"},
+    };
+    static final int[] POSITIONS = {
+            7, 8, 14, 7, 8, 14, 7, 8, 14, 7, 8, 14, 7, 8, 14, 7, 8, 13, 7, 8, 14, 7, 8, 15, 7, 8, 15, 7, 8, 15, 7, 8,
+            15, 7, 8, 15, 7, 8, 14, 7, 8, 15, 7, 8, 15, 16, 7, 8, 15, 16, 7, 8, 15, 16, 7, 8, 15, 16, 7, 8, 15, 16, 7,
+            8, 15, 7, 8, 15, 16, 7, 8, 15, 16, 30, 7, 8, 15, 16, 30, 7, 8, 15, 16, 30, 7, 8, 15, 16, 30, 7, 8, 15, 16,
+            30, 7, 8, 15, 16, 29, 7, 8, 15, 16, 30, 7, 8, 15, 16, 31, 7, 8, 15, 16, 31, 7, 8, 15, 16, 31, 7, 8, 15, 16,
+            31, 7, 8, 15, 16, 31, 7, 8, 15, 16, 30, 7, 8, 15, 16, 31, 7, 8, 15, 16, 31, 32, 7, 8, 15, 16, 31, 32, 7, 8,
+            15, 16, 31, 32, 7, 8, 15, 16, 31, 32, 7, 8, 15, 16, 31, 32, 7, 8, 15, 16, 31, 7, 8, 15, 16, 31, 32, 7, 8,
+            15, 16, 31, 32, 64, 7, 8, 15, 16, 31, 32, 64, 7, 8, 15, 16, 31, 32, 64, 7, 8, 15, 16, 31, 32, 64, 7, 8, 15,
+            16, 31, 32, 64, 7, 8, 15, 16, 31, 32, 63, 7, 8, 15, 16, 31, 32, 64
+    };
+
+    // The same string without a literal, the chars before the special one are 'a'..'z', the ones after it 'A'..'Z'
+    static String build(int length, int position, String special) {
+        char[] chars = new char[length];
+        for (int i = 0; i < position; i++) {
+            chars[i] = (char) ('a' + i % 26);
+        }
+        for (int i = 0; i < special.length(); i++) {
+            chars[position + i] = special.charAt(i);
+        }
+        for (int i = position + special.length(); i < length; i++) {
+            chars[i] = (char) ('A' + (i - position - special.length()) % 26);
+        }
+        return new String(chars);
+    }
+
+    public static void main(String[] args) {
+        for (int i = 0; i < STRINGS.length; i++) {
+            String literal = STRINGS[i][0];
+            String built = build(literal.length(), POSITIONS[i], STRINGS[i][1]);
+            println(literal.length());
+            println(literal.equals(built));
+            println(literal.hashCode());
+            println(built.intern() == literal);
+            println(java.util.Arrays.hashCode(Native.strings(literal, 0, literal.length())));
+            println(java.util.Arrays.hashCode(Native.strings8(literal, 0, literal.length())));
+            println(java.util.Arrays.hashCode(Native.strings(built, POSITIONS[i], literal.length() - POSITIONS[i])));
+        }
+    }
+}
@@ -33,5 +33,12 @@ public class Strings {
 		println(a);
 		println(b);
 		println(a == b);
+
+		String c = new StringBuilder("ab").append('c').toString();
+		println(c == a);
+		println(c.intern() == a);
+		String d = new StringBuilder("interned at runtime").append('\u00e9').toString();
+		println(d.intern() == d);
+		println(new String(d).intern() == d);
     }
 }
@@ -0,0 +1,97 @@
+public class Superinstructions {
+    int value = 5;
+
+    static class Initialized {
+        static {
+            System.out.println("Initialized.<clinit>");
+        }
+
+        final int x;
+
+        Initialized(int x) {
+            this.x = x;
+        }
+    }
+
+    static class FailingInitializer {
+        static {
+            if (true) {
+                throw new IllegalStateException();
+            }
+        }
+    }
+
+    // aload_0; getfield
+    static int read(Superinstructions holder) {
+        return holder
+                .value;
+    }
+
+    int readThis() {
+        return value + this.value;
+    }
+
+    // iload; bipush; if_icmp<cond> and iinc; goto, with iload_<n> and with iload for locals after the fourth
+    static int loops(int limit) {
+        int a = 0, b = 0, c = 0, d = 0;
+        for (int i = 0; i < limit; i++) {
+            if (i > 100) {
+                a += 2;
+            } else if (i == 7) {
+                b += 3;
+            } else if (i <= -50) {
+                c -= 1;
+            }
+            if (limit >= 3) {
+                d++;
+            }
+            if (limit < 2 && limit != 1) {
+                d--;
+            }
+        }
+        for (int i = limit; i >= -100; i -= 3) {
+            c += i;
+        }
+        return a + b * 10 + c * 100 + d * 1000;
+    }
+
+    // iload; iload; iadd
+    static int sum(int x, int y, int z, int w, int v) {
+        int s = x + y;
+        s = s + z;
+        return v + w + s;
+    }
+
+    public static void main(String[] args) {
+        System.out.println(read(new Superinstructions()));
+        System.out.println(new Superinstructions().readThis());
+        try {
+            System.out.println(read(null));
+        } catch (NullPointerException e) {
+            StackTraceElement top = e.getStackTrace()[0];
+            System.out.println(top.getMethodName());
+            System.out.println(top.getLineNumber());
+        }
+
+        System.out.println(loops(0));
+        System.out.println(loops(1));
+        System.out.println(loops(8));
+        System.out.println(loops(150));
+        System.out.println(sum(1, 2, 3, 4, 5));
+
+        // new; dup; invokespecial, the first one initializes the class
+        System.out.println("before");
+        int total = 0;
+        for (int i = 0; i < 3; i++) {
+            total += new Initialized(i).x;
+        }
+        System.out.println(total);
+        for (int i = 0; i < 2; i++) {
+            try {
+                System.out.println(new FailingInitializer());
+            } catch (Error e) {
+                System.out.println(e.getClass().getName());
+            }
+        }
+    }
+}
@@ -0,0 +1,39 @@
+public class VerifyErrors {
+    // The build replaces the iconst_1 of broken() with aconst_null in tests.jar (see BreakBytecode), so a reference is
+    // returned where an int is expected
+    static class Invalid {
+        static int broken() {
+            return 1;
+        }
+    }
+
+    static class FailingInitializer {
+        static int value = 1 / zero();
+    }
+
+    static int zero() {
+        return 0;
+    }
+
+    public static void main(String[] args) {
+        // Every attempt to link the class fails with the same error
+        for (int i = 0; i < 2; i++) {
+            try {
+                System.out.println(Invalid.broken());
+            } catch (LinkageError e) {
+                System.out.println(e.getClass().getName());
+            }
+        }
+
+        // Unlike a class that failed to initialize, it is in an erroneous state afterwards
+        for (int i = 0; i < 2; i++) {
+            try {
+                System.out.println(FailingInitializer.value);
+            } catch (Error e) {
+                System.out.println(e.getClass().getName());
+            }
+        }
+
+        System.out.println(zero());
+    }
+}